@@ -0,0 +1,686 @@
+#include "CC1101Sim.h"
+
+// Register addresses used by the model
+#define R_IOCFG2 0x00
+#define R_IOCFG0 0x02
+#define R_FIFOTHR 0x03
+#define R_PKTLEN 0x06
+#define R_PKTCTRL1 0x07
+#define R_PKTCTRL0 0x08
+#define R_FREQ2 0x0D
+#define R_FREQ1 0x0E
+#define R_FREQ0 0x0F
+#define R_MDMCFG4 0x10
+#define R_MDMCFG3 0x11
+#define R_MDMCFG2 0x12
+#define R_MDMCFG1 0x13
+#define R_MCSM1 0x17
+#define R_MCSM0 0x18
+#define R_AGCCTRL2 0x1B
+#define R_AGCCTRL1 0x1C
+#define R_FSCAL3 0x23
+#define R_FSCAL2 0x24
+#define R_FSCAL1 0x25
+
+#define S_SRES 0x30
+#define S_SFSTXON 0x31
+#define S_SXOFF 0x32
+#define S_SCAL 0x33
+#define S_SRX 0x34
+#define S_STX 0x35
+#define S_SIDLE 0x36
+#define S_SWOR 0x38
+#define S_SPWD 0x39
+#define S_SFRX 0x3A
+#define S_SFTX 0x3B
+
+#define A_PATABLE 0x3E
+#define A_FIFO 0x3F
+
+// Datasheet table 43
+static const uint8_t RESET_VALUES[CC1101_SIM_REGS] = {
+    0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F,
+    0x00, 0x1E, 0xC4, 0xEC, 0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30,
+    0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B, 0xF8, 0x56, 0x10, 0xA9,
+    0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B};
+
+static const uint8_t PREAMBLE_BYTES[8] = {2, 3, 4, 6, 8, 12, 16, 24};
+static const uint8_t MAGN_TARGET_DB[8] = {24, 27, 30, 33, 36, 38, 40, 42};
+
+CC1101Sim::CC1101Sim(void) { powerOn(); }
+
+CC1101Sim::~CC1101Sim(void) { detach(); }
+
+void CC1101Sim::attach(uint8_t csn, uint8_t g0, uint8_t g2) {
+  cs = csn;
+  gdo0Pin = g0;
+  gdo2Pin = g2;
+  attached = true;
+  simAddDevice(this);
+  updatePins();
+}
+
+void CC1101Sim::detach(void) {
+  if (attached)
+    simRemoveDevice(this);
+  attached = false;
+}
+
+void CC1101Sim::powerOn(void) {
+  resetRegisters();
+  selected = false;
+  expectHeader = true;
+  powerDown = false;
+  rssiRaw = 0x80;
+  rssiDbm = -138;
+  serial = LOW;
+  air.clear();
+  txLog.clear();
+  edges.clear();
+  clearCounters();
+}
+
+void CC1101Sim::clearCounters(void) { memset(&count, 0, sizeof(count)); }
+
+void CC1101Sim::resetRegisters(void) {
+  memcpy(regs, RESET_VALUES, CC1101_SIM_REGS);
+  memset(pa, 0, sizeof(pa));
+  pa[0] = 0xC6;
+  paIndex = 0;
+  rxCount = 0;
+  txCount = 0;
+  rxOverflow = false;
+  txUnderflow = false;
+  marc = CC1101_SIM_IDLE;
+  phase = IDLE_PHASE;
+  eventAt = UINT64_MAX;
+  syncActive = false;
+  packetEnd = false;
+}
+
+// ==========================================
+// DERIVED SETTINGS
+// ==========================================
+double CC1101Sim::frequency(void) const {
+  uint32_t f = ((uint32_t)regs[R_FREQ2] << 16) |
+               ((uint32_t)regs[R_FREQ1] << 8) | regs[R_FREQ0];
+  return f * 26.0 / 65536.0;
+}
+
+double CC1101Sim::dataRate(void) const {
+  uint8_t e = regs[R_MDMCFG4] & 0x0F;
+  uint8_t m = regs[R_MDMCFG3];
+  return (256.0 + m) * (double)(1UL << e) * 26e6 / (double)(1UL << 28);
+}
+
+uint64_t CC1101Sim::byteNs(void) const {
+  return (uint64_t)(8e9 / dataRate());
+}
+
+uint32_t CC1101Sim::syncBytes(void) const {
+  uint8_t mode = regs[R_MDMCFG2] & 0x07;
+  uint32_t sync = (mode == 0 || mode == 4) ? 0 : (mode == 3 || mode == 7) ? 4 : 2;
+  return PREAMBLE_BYTES[(regs[R_MDMCFG1] >> 4) & 0x07] + sync;
+}
+
+// Approximation of the absolute carrier sense threshold: MAGN_TARGET and
+// CARRIER_SENSE_ABS_THR shift it in 1 dB steps around -90 dBm.
+bool CC1101Sim::carrierSense(void) const {
+  if (marc != CC1101_SIM_RX)
+    return false;
+  int thr = regs[R_AGCCTRL1] & 0x0F;
+  if (thr & 0x08)
+    thr -= 16;
+  if (thr == -8)
+    return false;
+  int level = -90 + (MAGN_TARGET_DB[regs[R_AGCCTRL2] & 0x07] - 33) + thr;
+  return rssiDbm >= level;
+}
+
+// ==========================================
+// STIMULUS
+// ==========================================
+void CC1101Sim::setRssi(int dbm) {
+  rssiDbm = dbm;
+  int raw = (dbm + 74) * 2;
+  rssiRaw = (uint8_t)(int8_t)constrain(raw, -128, 127);
+  updatePins();
+}
+
+// Starts a packet on air now. The payload is what ends up in the RX FIFO
+// (without the length byte in variable length mode). Returns false if the
+// module is not in RX with the FIFO packet format.
+bool CC1101Sim::receive(const uint8_t *payload, uint8_t len, bool crcOk,
+                        uint8_t lqi) {
+  if (marc != CC1101_SIM_RX || ((regs[R_PKTCTRL0] >> 4) & 0x03) != 0)
+    return false;
+  air.clear();
+  if ((regs[R_PKTCTRL0] & 0x03) == 1)
+    air.push_back(len);
+  air.insert(air.end(), payload, payload + len);
+  airPos = 0;
+  airCrcOk = crcOk;
+  airLqi = lqi & 0x7F;
+  schedule(RX_SYNC, simNanos() + syncBytes() * byteNs());
+  return true;
+}
+
+void CC1101Sim::setSerialData(uint8_t level) {
+  serial = level ? HIGH : LOW;
+  updatePins();
+}
+
+// ==========================================
+// SPI DECODER
+// ==========================================
+void CC1101Sim::select(bool low) {
+  if (low == selected)
+    return;
+  selected = low;
+  if (low) {
+    count.transactions++;
+    expectHeader = true;
+    // CSn low wakes the chip from SLEEP/WOR
+    if (marc == CC1101_SIM_SLEEP)
+      marc = CC1101_SIM_IDLE;
+  } else {
+    paIndex = 0;
+    if (powerDown) {
+      powerDown = false;
+      enterIdle();
+      marc = CC1101_SIM_SLEEP;
+      // PATABLE loses everything but index 0 in SLEEP
+      memset(pa + 1, 0, 7);
+    }
+  }
+  updatePins();
+}
+
+uint8_t CC1101Sim::status(bool read) const {
+  uint8_t state;
+  switch (marc) {
+  case CC1101_SIM_RX:
+    state = 1;
+    break;
+  case CC1101_SIM_TX:
+    state = 2;
+    break;
+  case CC1101_SIM_FSTXON:
+    state = 3;
+    break;
+  case CC1101_SIM_MANCAL:
+  case CC1101_SIM_STARTCAL:
+    state = 4;
+    break;
+  case CC1101_SIM_RXFIFO_OVERFLOW:
+    state = 6;
+    break;
+  case CC1101_SIM_TXFIFO_UNDERFLOW:
+    state = 7;
+    break;
+  default:
+    state = 0;
+    break;
+  }
+  uint8_t avail = read ? rxCount : CC1101_SIM_FIFO_SIZE - txCount;
+  return (state << 4) | (avail > 15 ? 15 : avail);
+}
+
+uint8_t CC1101Sim::transfer(uint8_t mosi) {
+  count.bytes++;
+  if (!selected)
+    return 0xFF;
+
+  if (expectHeader) {
+    rd = mosi & 0x80;
+    burst = mosi & 0x40;
+    addr = mosi & 0x3F;
+    uint8_t st = status(rd);
+    expectHeader = false;
+    if (addr >= S_SRES && addr <= 0x3D && !burst) {
+      count.strobes++;
+      strobe(addr);
+      expectHeader = true;
+    } else if (addr >= S_SRES && addr <= 0x3D) {
+      count.statusReads++;
+    } else if (addr == A_PATABLE) {
+      count.patableAccesses++;
+    } else if (addr < S_SRES) {
+      if (burst)
+        rd ? count.burstReads++ : count.burstWrites++;
+      else
+        rd ? count.regReads++ : count.regWrites++;
+    }
+    return st;
+  }
+
+  uint8_t out = status(rd);
+  if (addr >= S_SRES && addr <= 0x3D) {
+    // Status registers cannot be burst accessed
+    out = statusRegister(addr);
+    expectHeader = true;
+  } else if (addr == A_PATABLE) {
+    if (rd)
+      out = pa[paIndex];
+    else
+      pa[paIndex] = mosi;
+    paIndex = (paIndex + 1) & 7;
+  } else if (addr == A_FIFO) {
+    if (rd) {
+      count.fifoReads++;
+      if (rxCount > 0) {
+        rxLast = rxFifo[0];
+        memmove(rxFifo, rxFifo + 1, --rxCount);
+        if (rxCount == 0)
+          packetEnd = false;
+      }
+      out = rxLast;
+    } else {
+      count.fifoWrites++;
+      if (txCount < CC1101_SIM_FIFO_SIZE)
+        txFifo[txCount++] = mosi;
+    }
+  } else if (addr < CC1101_SIM_REGS) {
+    if (rd)
+      out = regs[addr];
+    else
+      regs[addr] = mosi;
+    if (burst)
+      addr++;
+  } else {
+    // 0x2F is not a register
+    out = 0;
+  }
+  if (!burst)
+    expectHeader = true;
+  updatePins();
+  return out;
+}
+
+uint8_t CC1101Sim::statusRegister(uint8_t a) {
+  switch (a) {
+  case 0x30: // PARTNUM
+    return 0x00;
+  case 0x31: // VERSION
+    return 0x14;
+  case 0x33: // LQI
+    return (lastCrcOk ? 0x80 : 0) | lastLqi;
+  case 0x34: // RSSI
+    return rssiRaw;
+  case 0x35: // MARCSTATE
+    return marc;
+  case 0x38: { // PKTSTATUS
+    uint8_t s = 0;
+    if (lastCrcOk)
+      s |= 0x80;
+    if (carrierSense())
+      s |= 0x40;
+    if (syncActive)
+      s |= 0x08;
+    if (gdo(regs[R_IOCFG2]))
+      s |= 0x04;
+    if (gdo(regs[R_IOCFG0]))
+      s |= 0x01;
+    return s;
+  }
+  case 0x3A: // TXBYTES
+    return (txUnderflow ? 0x80 : 0) | txCount;
+  case 0x3B: // RXBYTES
+    return (rxOverflow ? 0x80 : 0) | rxCount;
+  default:
+    return 0;
+  }
+}
+
+// ==========================================
+// MAIN RADIO CONTROL STATE MACHINE
+// ==========================================
+void CC1101Sim::strobe(uint8_t cmd) {
+  bool idle = marc == CC1101_SIM_IDLE;
+  switch (cmd) {
+  case S_SRES:
+    resetRegisters();
+    break;
+  case S_SFSTXON:
+    if (idle || marc == CC1101_SIM_RX) {
+      enterIdle();
+      marc = CC1101_SIM_FSTXON;
+    }
+    break;
+  case S_SCAL:
+    if (idle) {
+      marc = CC1101_SIM_MANCAL;
+      calReturn = CC1101_SIM_IDLE;
+      schedule(CAL, simNanos() + CC1101_SIM_CAL_NS);
+    }
+    break;
+  case S_SRX:
+    if (idle || marc == CC1101_SIM_TX || marc == CC1101_SIM_FSTXON)
+      enterRx();
+    break;
+  case S_STX:
+    // With CCA enabled, STX in RX only succeeds on a clear channel
+    if (marc == CC1101_SIM_RX && (regs[R_MCSM1] & 0x30) && carrierSense())
+      break;
+    if (idle || marc == CC1101_SIM_RX || marc == CC1101_SIM_FSTXON)
+      enterTx();
+    break;
+  case S_SIDLE:
+    if (((regs[R_MCSM0] >> 4) & 0x03) == 2 &&
+        (marc == CC1101_SIM_RX || marc == CC1101_SIM_TX)) {
+      calibrate();
+    }
+    enterIdle();
+    break;
+  case S_SWOR:
+    enterIdle();
+    marc = CC1101_SIM_SLEEP;
+    break;
+  case S_SPWD:
+    powerDown = true;
+    break;
+  case S_SFRX:
+    if (idle || marc == CC1101_SIM_RXFIFO_OVERFLOW) {
+      rxCount = 0;
+      rxOverflow = false;
+      packetEnd = false;
+      marc = CC1101_SIM_IDLE;
+    }
+    break;
+  case S_SFTX:
+    if (idle || marc == CC1101_SIM_TXFIFO_UNDERFLOW) {
+      txCount = 0;
+      txUnderflow = false;
+      marc = CC1101_SIM_IDLE;
+    }
+    break;
+  default: // SXOFF, SAFC, SWORRST, SNOP
+    break;
+  }
+}
+
+void CC1101Sim::enterIdle(void) {
+  marc = CC1101_SIM_IDLE;
+  phase = IDLE_PHASE;
+  eventAt = UINT64_MAX;
+  syncActive = false;
+}
+
+void CC1101Sim::enterRx(void) {
+  bool autocal = ((regs[R_MCSM0] >> 4) & 0x03) == 1;
+  if (autocal && marc == CC1101_SIM_IDLE) {
+    marc = CC1101_SIM_STARTCAL;
+    calReturn = CC1101_SIM_RX;
+    schedule(CAL, simNanos() + CC1101_SIM_CAL_NS);
+    return;
+  }
+  phase = IDLE_PHASE;
+  eventAt = UINT64_MAX;
+  syncActive = false;
+  marc = CC1101_SIM_RX;
+}
+
+void CC1101Sim::enterTx(void) {
+  bool autocal = ((regs[R_MCSM0] >> 4) & 0x03) == 1;
+  if (autocal && marc == CC1101_SIM_IDLE) {
+    marc = CC1101_SIM_STARTCAL;
+    calReturn = CC1101_SIM_TX;
+    schedule(CAL, simNanos() + CC1101_SIM_CAL_NS);
+    return;
+  }
+  marc = CC1101_SIM_TX;
+  syncActive = false;
+  txPacket.clear();
+  txSent = 0;
+  // Serial modes: the MCU drives the data on GDO0, nothing to schedule
+  if (((regs[R_PKTCTRL0] >> 4) & 0x03) == 0)
+    schedule(TX_SYNC, simNanos() + syncBytes() * byteNs());
+  else
+    eventAt = UINT64_MAX;
+}
+
+// RXOFF_MODE / TXOFF_MODE: 0 IDLE, 1 FSTXON, 2 TX, 3 RX
+void CC1101Sim::enterOffMode(uint8_t mode) {
+  syncActive = false;
+  phase = IDLE_PHASE;
+  eventAt = UINT64_MAX;
+  if (mode == 1) {
+    marc = CC1101_SIM_FSTXON;
+  } else if (mode == 2) {
+    marc = CC1101_SIM_FSTXON;
+    enterTx();
+  } else if (mode == 3) {
+    marc = CC1101_SIM_FSTXON;
+    enterRx();
+  } else {
+    marc = CC1101_SIM_IDLE;
+  }
+}
+
+void CC1101Sim::schedule(Phase p, uint64_t at) {
+  phase = p;
+  eventAt = at;
+}
+
+// Results are a deterministic function of the frequency word so that
+// cached calibrations can be checked against a fresh SCAL.
+void CC1101Sim::calibrate(void) {
+  uint32_t f = ((uint32_t)regs[R_FREQ2] << 16) |
+               ((uint32_t)regs[R_FREQ1] << 8) | regs[R_FREQ0];
+  regs[R_FSCAL3] = (regs[R_FSCAL3] & 0xF0) | ((f >> 4) & 0x0F);
+  regs[R_FSCAL2] = (regs[R_FSCAL2] & 0x20) | ((f >> 9) & 0x1F);
+  regs[R_FSCAL1] = (f >> 14) & 0x3F;
+  count.calibrations++;
+}
+
+// ==========================================
+// PACKET ENGINE
+// ==========================================
+void CC1101Sim::advance(uint64_t now) {
+  if (now < eventAt)
+    return;
+  switch (phase) {
+  case CAL:
+    calibrate();
+    phase = IDLE_PHASE;
+    eventAt = UINT64_MAX;
+    if (calReturn == CC1101_SIM_RX) {
+      marc = CC1101_SIM_FSTXON;
+      enterRx();
+    } else if (calReturn == CC1101_SIM_TX) {
+      marc = CC1101_SIM_FSTXON;
+      enterTx();
+    } else {
+      marc = CC1101_SIM_IDLE;
+    }
+    break;
+  case TX_SYNC:
+  case TX_DATA:
+  case TX_END:
+    stepTx(now);
+    break;
+  case RX_SYNC:
+  case RX_DATA:
+  case RX_END:
+    stepRx(now);
+    break;
+  default:
+    eventAt = UINT64_MAX;
+    break;
+  }
+  updatePins();
+}
+
+void CC1101Sim::stepTx(uint64_t now) {
+  if (phase == TX_END) {
+    syncActive = false;
+    txLog.push_back(txPacket);
+    count.txPackets++;
+    enterOffMode(regs[R_MCSM1] & 0x03);
+    return;
+  }
+  if (phase == TX_SYNC)
+    syncActive = true;
+
+  if (txCount == 0) {
+    txUnderflow = true;
+    syncActive = false;
+    count.txUnderflows++;
+    marc = CC1101_SIM_TXFIFO_UNDERFLOW;
+    phase = IDLE_PHASE;
+    eventAt = UINT64_MAX;
+    return;
+  }
+  uint8_t b = txFifo[0];
+  memmove(txFifo, txFifo + 1, --txCount);
+  txPacket.push_back(b);
+  txSent++;
+
+  // LENGTH_CONFIG is read live so infinite -> fixed switching works
+  bool done;
+  uint8_t lengthConfig = regs[R_PKTCTRL0] & 0x03;
+  if (lengthConfig == 1)
+    done = txSent == (uint32_t)txPacket[0] + 1;
+  else if (lengthConfig == 0)
+    done = (txSent & 0xFF) == regs[R_PKTLEN];
+  else
+    done = false;
+
+  uint64_t bt = byteNs();
+  if (done) {
+    uint32_t crc = (regs[R_PKTCTRL0] & 0x04) ? 2 : 0;
+    schedule(TX_END, now + (1 + crc) * bt);
+  } else {
+    schedule(TX_DATA, now + bt);
+  }
+}
+
+bool CC1101Sim::pushRx(uint8_t b) {
+  if (rxCount >= CC1101_SIM_FIFO_SIZE) {
+    rxOverflow = true;
+    syncActive = false;
+    count.rxOverflows++;
+    marc = CC1101_SIM_RXFIFO_OVERFLOW;
+    phase = IDLE_PHASE;
+    eventAt = UINT64_MAX;
+    return false;
+  }
+  rxFifo[rxCount++] = b;
+  return true;
+}
+
+void CC1101Sim::stepRx(uint64_t now) {
+  if (marc != CC1101_SIM_RX) {
+    // Left RX while the packet was on air
+    phase = IDLE_PHASE;
+    eventAt = UINT64_MAX;
+    return;
+  }
+  uint64_t bt = byteNs();
+  if (phase == RX_SYNC) {
+    syncActive = true;
+    schedule(RX_DATA, now + bt);
+    return;
+  }
+  if (phase == RX_DATA) {
+    if (!pushRx(air[airPos++]))
+      return;
+    if (airPos < air.size()) {
+      schedule(RX_DATA, now + bt);
+    } else {
+      uint32_t crc = (regs[R_PKTCTRL0] & 0x04) ? 2 : 0;
+      schedule(RX_END, now + crc * bt);
+    }
+    return;
+  }
+
+  // RX_END
+  lastCrcOk = airCrcOk;
+  lastLqi = airLqi;
+  if (regs[R_PKTCTRL1] & 0x04) {
+    if (!pushRx(rssiRaw) || !pushRx((airCrcOk ? 0x80 : 0) | airLqi))
+      return;
+  }
+  if ((regs[R_PKTCTRL1] & 0x08) && !airCrcOk)
+    rxCount = 0; // CRC_AUTOFLUSH
+  packetEnd = rxCount > 0;
+  count.rxPackets++;
+  enterOffMode((regs[R_MCSM1] >> 2) & 0x03);
+}
+
+// ==========================================
+// GDO OUTPUTS
+// ==========================================
+uint8_t CC1101Sim::gdo(uint8_t cfg) const {
+  uint8_t rxThr = 4 * ((regs[R_FIFOTHR] & 0x0F) + 1);
+  uint8_t txThr = CC1101_SIM_FIFO_SIZE + 1 - rxThr;
+  bool level;
+  switch (cfg & 0x3F) {
+  case 0x00:
+  case 0x01:
+    level = rxCount >= rxThr || (packetEnd && rxCount > 0);
+    break;
+  case 0x02:
+    level = txCount >= txThr;
+    break;
+  case 0x03:
+    level = txCount == CC1101_SIM_FIFO_SIZE;
+    break;
+  case 0x04:
+    level = rxOverflow;
+    break;
+  case 0x05:
+    level = txUnderflow;
+    break;
+  case 0x06:
+    level = syncActive;
+    break;
+  case 0x07:
+    level = packetEnd && lastCrcOk;
+    break;
+  case 0x0D:
+    level = marc == CC1101_SIM_RX && serial;
+    break;
+  case 0x0E:
+    level = carrierSense();
+    break;
+  case 0x29: // CHIP_RDYn
+    level = false;
+    break;
+  default: // 0x2E high impedance, 0x2F hardwired to 0, rest not modelled
+    level = false;
+    break;
+  }
+  if (cfg & 0x40)
+    level = !level;
+  return level ? HIGH : LOW;
+}
+
+bool CC1101Sim::drives(uint8_t pin, uint8_t &level) {
+  if (!attached)
+    return false;
+  if (pin == gdo0Pin && (regs[R_IOCFG0] & 0x3F) != 0x2E) {
+    level = gdo(regs[R_IOCFG0]);
+    return true;
+  }
+  if (pin == gdo2Pin && (regs[R_IOCFG2] & 0x3F) != 0x2E) {
+    level = gdo(regs[R_IOCFG2]);
+    return true;
+  }
+  return false;
+}
+
+void CC1101Sim::pinWritten(uint8_t pin, uint8_t level, uint64_t now) {
+  if (pin == gdo0Pin && marc == CC1101_SIM_TX &&
+      ((regs[R_PKTCTRL0] >> 4) & 0x03) != 0 &&
+      (edges.empty() || edges.back().level != level)) {
+    edges.push_back({now, level});
+  }
+}
+
+void CC1101Sim::updatePins(void) {
+  if (!attached)
+    return;
+  simPinChanged(gdo0Pin);
+  simPinChanged(gdo2Pin);
+}
@@ -0,0 +1,170 @@
+#ifndef CC1101_SIM_h
+#define CC1101_SIM_h
+
+#include <vector>
+#include "SimHost.h"
+
+// ==========================================
+// CC1101 REGISTER-LEVEL MODEL
+// ==========================================
+// Decodes the SPI protocol exactly as the chip does (header byte with R/W
+// and burst bits, strobes, status registers, PATABLE, FIFOs) and keeps the
+// register file, the main radio state machine and the GDO outputs. Packet
+// TX and RX run in simulated time at the programmed data rate, so FIFO
+// thresholds, underflow and overflow behave like on the chip.
+//
+// Not modelled: RF itself, AGC, frequency offset, FEC/whitening, WOR
+// timing and settling times other than calibration.
+
+#define CC1101_SIM_FIFO_SIZE 64
+#define CC1101_SIM_REGS 0x2F
+#define CC1101_SIM_CAL_NS 721000 // FS calibration, datasheet table 34
+
+// MARCSTATE values used by the model
+#define CC1101_SIM_SLEEP 0x00
+#define CC1101_SIM_IDLE 0x01
+#define CC1101_SIM_MANCAL 0x05
+#define CC1101_SIM_STARTCAL 0x08
+#define CC1101_SIM_RX 0x0D
+#define CC1101_SIM_RXFIFO_OVERFLOW 0x11
+#define CC1101_SIM_FSTXON 0x12
+#define CC1101_SIM_TX 0x13
+#define CC1101_SIM_TXFIFO_UNDERFLOW 0x16
+
+struct CC1101SimCounters {
+  uint32_t transactions; // CSn low .. high
+  uint32_t bytes;        // every byte clocked, header included
+  uint32_t strobes;
+  uint32_t regReads;     // single config register accesses
+  uint32_t regWrites;
+  uint32_t burstReads;   // burst config accesses
+  uint32_t burstWrites;
+  uint32_t statusReads;
+  uint32_t patableAccesses;
+  uint32_t fifoReads;    // bytes
+  uint32_t fifoWrites;   // bytes
+  uint32_t calibrations;
+  uint32_t txPackets;
+  uint32_t rxPackets;
+  uint32_t txUnderflows;
+  uint32_t rxOverflows;
+};
+
+struct CC1101SimEdge {
+  uint64_t ns;
+  uint8_t level;
+};
+
+class CC1101Sim : public SimDevice {
+public:
+  CC1101Sim(void);
+  ~CC1101Sim(void);
+
+  // Wire the model to MCU pins and put it on the bus
+  void attach(uint8_t cs, uint8_t gdo0, uint8_t gdo2);
+  void detach(void);
+  void powerOn(void);
+
+  // Test access, no SPI involved
+  uint8_t reg(uint8_t addr) const { return regs[addr]; }
+  uint8_t patable(uint8_t i) const { return pa[i & 7]; }
+  uint8_t marcState(void) const { return marc; }
+  uint8_t rxBytes(void) const { return rxCount; }
+  uint8_t txBytes(void) const { return txCount; }
+  double frequency(void) const;  // MHz
+  double dataRate(void) const;   // baud
+  const CC1101SimCounters &counters(void) const { return count; }
+  void clearCounters(void);
+
+  // Stimulus
+  void setRssi(int dbm);
+  bool receive(const uint8_t *payload, uint8_t len, bool crcOk = true,
+               uint8_t lqi = 0x20);
+  void setSerialData(uint8_t level);
+
+  // Packets sent from the TX FIFO and async TX edges on GDO0
+  const std::vector<std::vector<uint8_t>> &sent(void) const { return txLog; }
+  const std::vector<CC1101SimEdge> &txEdges(void) const { return edges; }
+
+  // SimDevice
+  void select(bool low);
+  uint8_t transfer(uint8_t mosi);
+  bool drives(uint8_t pin, uint8_t &level);
+  uint64_t nextEvent(void) { return eventAt; }
+  void advance(uint64_t now);
+  void pinWritten(uint8_t pin, uint8_t level, uint64_t now);
+  uint8_t csPin(void) { return cs; }
+
+private:
+  enum Phase { IDLE_PHASE, CAL, TX_SYNC, TX_DATA, TX_END, RX_SYNC, RX_DATA,
+               RX_END };
+
+  void resetRegisters(void);
+  void strobe(uint8_t cmd);
+  uint8_t status(bool read) const;
+  uint8_t statusRegister(uint8_t addr);
+  void enterIdle(void);
+  void enterRx(void);
+  void enterTx(void);
+  void enterOffMode(uint8_t mode);
+  void schedule(Phase p, uint64_t at);
+  void calibrate(void);
+  void stepTx(uint64_t now);
+  void stepRx(uint64_t now);
+  bool pushRx(uint8_t b);
+  bool carrierSense(void) const;
+  uint8_t gdo(uint8_t cfg) const;
+  uint64_t byteNs(void) const;
+  uint32_t syncBytes(void) const;
+  void updatePins(void);
+
+  uint8_t cs = 0xFF;
+  uint8_t gdo0Pin = 0xFF;
+  uint8_t gdo2Pin = 0xFF;
+  bool attached = false;
+
+  uint8_t regs[CC1101_SIM_REGS];
+  uint8_t pa[8];
+  uint8_t marc = CC1101_SIM_IDLE;
+  uint8_t calReturn = CC1101_SIM_IDLE;
+
+  // SPI transaction decoder
+  bool selected = false;
+  bool expectHeader = true;
+  bool rd = false;
+  bool burst = false;
+  uint8_t addr = 0;
+  uint8_t paIndex = 0;
+  bool powerDown = false;
+
+  uint8_t rxFifo[CC1101_SIM_FIFO_SIZE];
+  uint8_t txFifo[CC1101_SIM_FIFO_SIZE];
+  uint8_t rxCount = 0;
+  uint8_t txCount = 0;
+  uint8_t rxLast = 0;
+  bool rxOverflow = false;
+  bool txUnderflow = false;
+
+  Phase phase = IDLE_PHASE;
+  uint64_t eventAt = UINT64_MAX;
+  bool syncActive = false;
+  bool packetEnd = false;
+  bool lastCrcOk = false;
+  uint8_t lastLqi = 0;
+  uint8_t rssiRaw = 0x80;
+  int rssiDbm = -138;
+  uint8_t serial = LOW;
+
+  std::vector<uint8_t> air;   // packet being received, as on air
+  size_t airPos = 0;
+  bool airCrcOk = true;
+  uint8_t airLqi = 0;
+  std::vector<uint8_t> txPacket;
+  uint32_t txSent = 0;        // bytes of the current packet
+  std::vector<std::vector<uint8_t>> txLog;
+  std::vector<CC1101SimEdge> edges;
+
+  CC1101SimCounters count;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SIM_SPI_h
+#define SIM_SPI_h
+
+#include <Arduino.h>
+
+#define HSPI 2
+#define VSPI 3
+
+#define SPI_MODE0 0x00
+#define MSBFIRST 1
+
+class SPISettings {
+public:
+  SPISettings(void) {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+      : clock(clock) {}
+  uint32_t clock = 1000000;
+};
+
+// Every byte is routed to the simulated devices whose chip select is low
+class SPIClass {
+public:
+  SPIClass(uint8_t bus = HSPI) {}
+  void begin(void) {}
+  void begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss) {}
+  void end(void) {}
+  void beginTransaction(SPISettings settings);
+  void endTransaction(void) {}
+  uint8_t transfer(uint8_t data);
+};
+
+#endif
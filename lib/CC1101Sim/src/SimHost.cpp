@@ -0,0 +1,297 @@
+#include "SimHost.h"
+#include <SPI.h>
+
+#define SIM_ISR_QUEUE 32
+
+static uint64_t now = 0;
+static uint32_t spiByteNs = 8000000000ULL / SIM_SPI_DEFAULT_HZ;
+static uint8_t latch[SIM_MAX_PINS];
+static uint8_t modes[SIM_MAX_PINS];
+static uint8_t seen[SIM_MAX_PINS];
+static void (*isrs[SIM_MAX_PINS])(void);
+static int isrModes[SIM_MAX_PINS];
+static SimDevice *devices[SIM_MAX_DEVICES];
+static int deviceCount = 0;
+
+// Edges raised while an ISR is running are delivered after it returns
+static bool inIsr = false;
+static uint8_t pending[SIM_ISR_QUEUE];
+static int pendingCount = 0;
+
+// Interrupt timing model, see simSetIsrTiming()
+static uint32_t isrEntryNs = 0;
+static uint32_t isrBodyNs = 0;
+static uint64_t maskedUntil = 0;
+static uint64_t cpuFreeAt = 0;
+static uint64_t isrDue = UINT64_MAX;
+static uint8_t raised[SIM_MAX_PINS];
+static SimIsrStats isrStats;
+
+static void takeInterrupts(void);
+
+// ==========================================
+// CLOCK
+// ==========================================
+void simReset(void) {
+  now = 0;
+  spiByteNs = 8000000000ULL / SIM_SPI_DEFAULT_HZ;
+  memset(latch, 0, sizeof(latch));
+  memset(modes, INPUT, sizeof(modes));
+  memset(seen, 0, sizeof(seen));
+  memset(isrs, 0, sizeof(isrs));
+  memset(isrModes, 0, sizeof(isrModes));
+  deviceCount = 0;
+  inIsr = false;
+  pendingCount = 0;
+  isrEntryNs = 0;
+  isrBodyNs = 0;
+  maskedUntil = 0;
+  cpuFreeAt = 0;
+  isrDue = UINT64_MAX;
+  memset(raised, 0, sizeof(raised));
+  memset(&isrStats, 0, sizeof(isrStats));
+}
+
+void simAddDevice(SimDevice *dev) {
+  for (int i = 0; i < deviceCount; i++)
+    if (devices[i] == dev)
+      return;
+  if (deviceCount < SIM_MAX_DEVICES)
+    devices[deviceCount++] = dev;
+}
+
+void simRemoveDevice(SimDevice *dev) {
+  for (int i = 0; i < deviceCount; i++) {
+    if (devices[i] == dev) {
+      devices[i] = devices[--deviceCount];
+      return;
+    }
+  }
+}
+
+uint64_t simNanos(void) { return now; }
+
+// Steps every device through its events in time order. A device event
+// may fire an interrupt whose handler accesses the bus and advances the
+// clock itself, so the next event is looked up again after each one.
+// Delayed interrupts (simSetIsrTiming) are events of their own.
+void simAdvance(uint64_t ns) {
+  uint64_t target = now + ns;
+  for (;;) {
+    SimDevice *next = NULL;
+    uint64_t at = UINT64_MAX;
+    for (int i = 0; i < deviceCount; i++) {
+      uint64_t t = devices[i]->nextEvent();
+      if (t < at) {
+        at = t;
+        next = devices[i];
+      }
+    }
+    if (isrDue <= target && isrDue <= at && !inIsr) {
+      if (isrDue > now)
+        now = isrDue;
+      takeInterrupts();
+      continue;
+    }
+    if (next == NULL || at > target)
+      break;
+    if (at > now)
+      now = at;
+    next->advance(now);
+  }
+  if (target > now)
+    now = target;
+}
+
+void simSetSpiClock(uint32_t hz) {
+  if (hz > 0)
+    spiByteNs = 8000000000ULL / hz;
+}
+
+// ==========================================
+// GPIO
+// ==========================================
+static uint8_t level(uint8_t pin) {
+  if (modes[pin] != OUTPUT) {
+    uint8_t l;
+    for (int i = 0; i < deviceCount; i++)
+      if (devices[i]->drives(pin, l))
+        return l;
+  }
+  return latch[pin];
+}
+
+static bool timed(void) {
+  return isrEntryNs > 0 || isrBodyNs > 0 || maskedUntil > now;
+}
+
+static void schedule(void) {
+  if (isrDue != UINT64_MAX)
+    return;
+  uint64_t at = now;
+  if (maskedUntil > at)
+    at = maskedUntil;
+  if (cpuFreeAt > at)
+    at = cpuFreeAt;
+  isrDue = at + isrEntryNs;
+}
+
+// Runs every handler whose status bit is set. Edges raised meanwhile
+// latch again and are taken once bodyNs have passed.
+static void takeInterrupts(void) {
+  isrDue = UINT64_MAX;
+  cpuFreeAt = now + isrBodyNs;
+  inIsr = true;
+  for (int pin = 0; pin < SIM_MAX_PINS; pin++) {
+    if (!raised[pin])
+      continue;
+    raised[pin] = 0;
+    if (isrs[pin] != NULL) {
+      isrStats.taken++;
+      isrs[pin]();
+    }
+  }
+  inIsr = false;
+}
+
+static void dispatch(uint8_t pin) {
+  isrStats.taken++;
+  inIsr = true;
+  isrs[pin]();
+  while (pendingCount > 0) {
+    uint8_t p = pending[0];
+    memmove(pending, pending + 1, --pendingCount);
+    if (isrs[p] != NULL) {
+      isrStats.taken++;
+      isrs[p]();
+    }
+  }
+  inIsr = false;
+}
+
+void simPinChanged(uint8_t pin) {
+  if (pin >= SIM_MAX_PINS)
+    return;
+  uint8_t l = level(pin);
+  if (l == seen[pin])
+    return;
+  seen[pin] = l;
+  if (isrs[pin] == NULL || modes[pin] == OUTPUT)
+    return;
+  int m = isrModes[pin];
+  if (m != CHANGE && !(m == RISING && l) && !(m == FALLING && !l))
+    return;
+  isrStats.raised++;
+  if (timed()) {
+    if (raised[pin]) {
+      isrStats.coalesced++;
+      return;
+    }
+    raised[pin] = 1;
+    schedule();
+    return;
+  }
+  if (inIsr) {
+    if (pendingCount < SIM_ISR_QUEUE)
+      pending[pendingCount++] = pin;
+    return;
+  }
+  dispatch(pin);
+}
+
+void simDrivePin(uint8_t pin, uint8_t l) {
+  if (pin >= SIM_MAX_PINS)
+    return;
+  latch[pin] = l ? HIGH : LOW;
+  simPinChanged(pin);
+}
+
+uint8_t simPinMode(uint8_t pin) {
+  return pin < SIM_MAX_PINS ? modes[pin] : INPUT;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= SIM_MAX_PINS)
+    return;
+  modes[pin] = mode;
+  seen[pin] = level(pin);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin >= SIM_MAX_PINS)
+    return;
+  simAdvance(SIM_GPIO_NS);
+  latch[pin] = val ? HIGH : LOW;
+  for (int i = 0; i < deviceCount; i++) {
+    if (devices[i]->csPin() == pin)
+      devices[i]->select(latch[pin] == LOW);
+    devices[i]->pinWritten(pin, latch[pin], now);
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= SIM_MAX_PINS)
+    return LOW;
+  simAdvance(SIM_GPIO_NS);
+  return level(pin);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  if (pin >= SIM_MAX_PINS)
+    return;
+  isrs[pin] = isr;
+  isrModes[pin] = mode;
+  seen[pin] = level(pin);
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < SIM_MAX_PINS) {
+    isrs[pin] = NULL;
+    raised[pin] = 0;
+  }
+}
+
+void simSetIsrTiming(uint32_t entryNs, uint32_t bodyNs) {
+  isrEntryNs = entryNs;
+  isrBodyNs = bodyNs;
+}
+
+void simMaskInterrupts(uint64_t ns) {
+  if (now + ns > maskedUntil)
+    maskedUntil = now + ns;
+  if (isrDue != UINT64_MAX && isrDue < maskedUntil + isrEntryNs)
+    isrDue = maskedUntil + isrEntryNs;
+}
+
+const SimIsrStats &simIsrStats(void) { return isrStats; }
+
+// ==========================================
+// TIME
+// ==========================================
+unsigned long millis(void) { return now / 1000000ULL; }
+
+unsigned long micros(void) { return now / 1000ULL; }
+
+void delay(uint32_t ms) { simAdvance((uint64_t)ms * 1000000ULL); }
+
+void delayMicroseconds(uint32_t us) { simAdvance((uint64_t)us * 1000ULL); }
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// ==========================================
+// SPI
+// ==========================================
+void SPIClass::beginTransaction(SPISettings settings) {
+  simSetSpiClock(settings.clock);
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  simAdvance(spiByteNs);
+  uint8_t miso = 0xFF;
+  for (int i = 0; i < deviceCount; i++)
+    if (latch[devices[i]->csPin()] == LOW)
+      miso &= devices[i]->transfer(data);
+  return miso;
+}
@@ -0,0 +1,72 @@
+#ifndef SIM_HOST_h
+#define SIM_HOST_h
+
+#include <Arduino.h>
+
+// ==========================================
+// SIMULATED HOST: CLOCK, GPIO, SPI BUS
+// ==========================================
+// A single simulated clock in nanoseconds. Every GPIO access and every
+// SPI byte costs a fixed amount of time, so busy-wait loops in the driver
+// terminate and "time per operation" is deterministic. Devices on the bus
+// implement SimDevice; they are advanced to the current time before every
+// access and may drive input pins, which fires attached interrupts.
+
+#define SIM_MAX_PINS 64
+#define SIM_MAX_DEVICES 4
+#define SIM_GPIO_NS 100            // one digitalRead/digitalWrite
+#define SIM_SPI_DEFAULT_HZ 1000000 // SPIClass default on the ESP32 core
+
+class SimDevice {
+public:
+  virtual ~SimDevice(void) {}
+  // CSn pin level changed
+  virtual void select(bool low) = 0;
+  // One full-duplex byte while selected
+  virtual uint8_t transfer(uint8_t mosi) = 0;
+  // Level of a pin driven by the device, false if it does not drive it
+  virtual bool drives(uint8_t pin, uint8_t &level) = 0;
+  // Time of the next internal event, UINT64_MAX if none
+  virtual uint64_t nextEvent(void) = 0;
+  // Process everything due at or before now
+  virtual void advance(uint64_t now) = 0;
+  // The MCU changed an output pin (e.g. async TX data on GDO0)
+  virtual void pinWritten(uint8_t pin, uint8_t level, uint64_t now) {}
+  virtual uint8_t csPin(void) = 0;
+};
+
+// Back to power-on: clock zero, pins input/low, no interrupts, no devices
+void simReset(void);
+void simAddDevice(SimDevice *dev);
+void simRemoveDevice(SimDevice *dev);
+
+uint64_t simNanos(void);
+void simAdvance(uint64_t ns);
+void simSetSpiClock(uint32_t hz);
+
+// Called by devices when a pin they drive may have changed level
+void simPinChanged(uint8_t pin);
+// Externally driven input pin (test stimulus), fires attached interrupts
+void simDrivePin(uint8_t pin, uint8_t level);
+uint8_t simPinMode(uint8_t pin);
+
+// ==========================================
+// INTERRUPT TIMING
+// ==========================================
+// Off by default: handlers run at the edge itself. With a timing set, an
+// edge latches the pin's interrupt status bit and the handler runs
+// entryNs later, once interrupts are unmasked and the previous handler's
+// bodyNs have passed. Further edges on a pin whose bit is still set are
+// lost, as with the ESP32 GPIO status register.
+struct SimIsrStats {
+  uint32_t raised;    // edges matching an attached interrupt
+  uint32_t taken;     // handler invocations
+  uint32_t coalesced; // edges absorbed by an already pending bit
+};
+
+void simSetIsrTiming(uint32_t entryNs, uint32_t bodyNs);
+// Interrupts stay masked for ns from now (critical sections, flash writes)
+void simMaskInterrupts(uint64_t ns);
+const SimIsrStats &simIsrStats(void);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SIM_WSTRING_h
+#define SIM_WSTRING_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+// ==========================================
+// HOST String
+// ==========================================
+// The part of the Arduino String the firmware modules under test use,
+// on top of std::string. Numbers format as on the ESP32 core: integers
+// in decimal, floats with two decimals.
+
+class String {
+public:
+  String(const char *s = "") : s(s ? s : "") {}
+  String(const std::string &s) : s(s) {}
+  String(char c) : s(1, c) {}
+  String(unsigned char v) : s(std::to_string(v)) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned int v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(double v, unsigned int decimals = 2) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    s = buf;
+  }
+  String(float v, unsigned int decimals = 2) : String((double)v, decimals) {}
+
+  unsigned int length(void) const { return s.length(); }
+  const char *c_str(void) const { return s.c_str(); }
+  char operator[](unsigned int i) const { return s[i]; }
+
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t i = s.find(c, from);
+    return i == std::string::npos ? -1 : (int)i;
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < to ? String(s.substr(from, to - from)) : String();
+  }
+  String substring(unsigned int from) const { return s.substr(from); }
+  long toInt(void) const { return atol(s.c_str()); }
+  float toFloat(void) const { return atof(s.c_str()); }
+
+  String &operator+=(const String &o) {
+    s += o.s;
+    return *this;
+  }
+  bool operator==(const String &o) const { return s == o.s; }
+  bool operator!=(const String &o) const { return s != o.s; }
+  friend String operator+(const String &a, const String &b) {
+    return a.s + b.s;
+  }
+
+private:
+  std::string s;
+};
+
+#endif
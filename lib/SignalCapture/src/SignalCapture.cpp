@@ -0,0 +1,717 @@
+#include "SignalCapture.h"
+#include <stdio.h>
+#include <string.h>
+
+// ==========================================
+// WRITER
+// ==========================================
+void CaptureWriter::put(const char *text) {
+  size_t n = strlen(text);
+  while (n > 0) {
+    if (len == CAPTURE_WRITE_CHUNK)
+      flush();
+    size_t k = CAPTURE_WRITE_CHUNK - len;
+    if (k > n)
+      k = n;
+    memcpy(buf + len, text, k);
+    len += k;
+    text += k;
+    n -= k;
+  }
+}
+
+void CaptureWriter::put(char c) {
+  if (len == CAPTURE_WRITE_CHUNK)
+    flush();
+  buf[len++] = c;
+}
+
+void CaptureWriter::put(unsigned long v) {
+  char digits[21];
+  int i = sizeof(digits) - 1;
+  digits[i] = 0;
+  do {
+    digits[--i] = '0' + v % 10;
+    v /= 10;
+  } while (v > 0);
+  put(digits + i);
+}
+
+void CaptureWriter::put(float v, int decimals) {
+  char text[24];
+  snprintf(text, sizeof(text), "%.*f", decimals, v);
+  put(text);
+}
+
+void CaptureWriter::flush(void) {
+  if (len == 0)
+    return;
+  sink(ctx, buf, len);
+  written += len;
+  len = 0;
+}
+
+// ==========================================
+// CAPTURE
+// ==========================================
+// Drops the burst in the buffer; its mean pulse width (sample[0] is the
+// silence before it) teaches the adaptive threshold what noise looks like.
+void IRAM_ATTR SignalCapture::discard(int n, capture_time_t end) {
+  if (filter.adaptive && n > 1) {
+    capture_time_t span = end - burstStart;
+    long mean = (span < CAPTURE_WIDTH_MAX ? span : CAPTURE_WIDTH_MAX) / (n - 1);
+    if (noiseTicks == 0)
+      noiseTicks = mean;
+    else
+      noiseTicks += (mean - (long)noiseTicks) / 8;
+    updateThreshold();
+  }
+  pendingCount = 0;
+}
+
+bool IRAM_ATTR SignalCapture::edge(capture_time_t now) {
+  const capture_time_t elapsed = now - lastTime;
+  const unsigned long duration =
+      elapsed < CAPTURE_WIDTH_MAX ? elapsed : CAPTURE_WIDTH_MAX;
+  const capture_time_t previous = lastTime;
+  int n = samplecount;
+  lastTime = now;
+
+  if (elapsed > gapTicks()) {
+    if (n > 0 && n < (int)filter.minBurst) {
+      counters.shortBursts++;
+      discard(n, previous);
+    }
+    n = 0;
+    pendingCount = 0;
+  }
+
+  if (filter.maxEdgesPerMs) {
+    if (now - windowStart >= (capture_time_t)ticksPerUs * 1000) {
+      windowStart = now;
+      windowEdges = 0;
+    }
+    if (++windowEdges > filter.maxEdgesPerMs) {
+      if (n > 0) {
+        counters.noiseBursts++;
+        discard(n, previous);
+      }
+      counters.noisy++;
+      pendingCount = 0;
+      samplecount = 0;
+      return true;
+    }
+  }
+  if (n == 0)
+    burstStart = now;
+
+  if (duration < glitchTicks) {
+    if (filter.merge && n > 0) {
+      pending += duration;
+      pendingCount++;
+      counters.merged++;
+    } else {
+      counters.rejected++;
+    }
+    samplecount = n;
+    return true;
+  }
+
+  unsigned long width = duration;
+  if (pendingCount) {
+    width += pending;
+    // After an odd number of glitches the level is back to that of the
+    // last pulse, which simply continues
+    bool extend = pendingCount & 1;
+    pendingCount = 0;
+    pending = 0;
+    if (extend) {
+      sample[n - 1] += width;
+      counters.merged++;
+      samplecount = n;
+      return true;
+    }
+  }
+
+  if (n < CAPTURE_SAMPLES)
+    sample[n++] = width;
+
+  if (n >= CAPTURE_SAMPLES) {
+    samplecount = CAPTURE_SAMPLES - 1;
+    counters.overruns++;
+    return false;
+  }
+  samplecount = n;
+  counters.accepted++;
+  return true;
+}
+
+bool IRAM_ATTR SignalCapture::open(capture_time_t now) {
+  int n = samplecount;
+  if (closed && n >= (int)filter.minBurst)
+    return false;
+  if (n > 0) {
+    counters.shortBursts++;
+    discard(n, lastTime);
+  }
+  samplecount = 0;
+  pendingCount = 0;
+  lastTime = now;
+  burstStart = now;
+  closed = false;
+  return true;
+}
+
+void SignalCapture::reset(void) {
+  if (samplecount >= (int)filter.minBurst && noiseTicks) {
+    noiseTicks -= noiseTicks / 8;
+    updateThreshold();
+  }
+  samplecount = 0;
+  pendingCount = 0;
+  closed = false;
+  rssicount = 0;
+  rssiStride = 1;
+  rssiSkip = 0;
+}
+
+void SignalCapture::setFilter(const CaptureFilter &f) {
+  filter = f;
+  if (filter.minBurst < 2)
+    filter.minBurst = 2;
+  if (filter.adaptive > 100)
+    filter.adaptive = 100;
+  if (!filter.adaptive)
+    noiseTicks = 0;
+  updateThreshold();
+}
+
+void IRAM_ATTR SignalCapture::updateThreshold(void) {
+  unsigned long t = (unsigned long)filter.minPulse * ticksPerUs;
+  // noise means stay below the gap, so this does not overflow
+  unsigned long adapt = noiseTicks * filter.adaptive / 100;
+  unsigned long cap = (unsigned long)CAPTURE_ADAPT_MAX_US * ticksPerUs;
+  if (adapt > cap)
+    adapt = cap;
+  glitchTicks = adapt > t ? adapt : t;
+}
+
+void SignalCapture::writeRaw(CaptureWriter &out, float frequency) const {
+  out.put("\nFrequency=");
+  out.put(frequency, 2);
+  out.put("\nCount=");
+  out.put((unsigned long)samplecount);
+  out.put('\n');
+  for (int i = 0; i < samplecount; i++) {
+    out.put(toUs(sample[i]));
+    out.put(',');
+  }
+  out.put('\n');
+}
+
+void SignalCapture::writeFrame(CaptureWriter &out,
+                               const CaptureFrame &f) const {
+  out.put("Count=");
+  out.put((unsigned long)f.count);
+  out.put('\n');
+  for (int i = f.first; i < f.first + f.count; i++) {
+    out.put(toUs(sample[i]));
+    out.put(',');
+  }
+  out.put('\n');
+}
+
+void SignalCapture::writeSub(CaptureWriter &out, unsigned long frequencyHz,
+                             const char *preset) const {
+  out.put("Filetype: Flipper SubGhz RAW File\nVersion: 1\nFrequency: ");
+  out.put(frequencyHz);
+  out.put("\nPreset: ");
+  out.put(preset);
+  out.put("\nProtocol: RAW\n");
+  for (int i = 1; i < samplecount; i++) {
+    int column = (i - 1) % CAPTURE_SUB_LINE_VALUES;
+    if (column == 0)
+      out.put("RAW_Data:");
+    out.put(' ');
+    if ((i & 1) == 0)
+      out.put('-');
+    out.put(toUs(sample[i]));
+    if (column == CAPTURE_SUB_LINE_VALUES - 1 || i == samplecount - 1)
+      out.put('\n');
+  }
+}
+
+// ==========================================
+// ANALYSIS
+// ==========================================
+// Finds up to CAPTURE_TIMINGS width clusters below limit, shortest first
+// (each one spans [shortest, shortest + tolerance)), with their mean and
+// size; stride 2 clusters the marks or the spaces alone. Works in any
+// unit: the capture passes ticks, so cycle timestamps cluster at
+// sub-microsecond resolution.
+int captureClusters(const unsigned long *width, int count, long tolerance,
+                    long limit, long *mean, int *size, int stride) {
+  long signaltimings[CAPTURE_TIMINGS * 2];
+  int signaltimingscount[CAPTURE_TIMINGS];
+  int64_t signaltimingssum[CAPTURE_TIMINGS];
+
+  for (int i = 0; i < CAPTURE_TIMINGS; i++) {
+    signaltimings[i * 2] = limit;
+    signaltimings[i * 2 + 1] = 0;
+    signaltimingscount[i] = 0;
+    signaltimingssum[i] = 0;
+  }
+
+  // Widths are compared as long, like the cluster bounds
+  for (int p = 0; p < CAPTURE_TIMINGS; p++) {
+    for (int i = 0; i < count; i++) {
+      long w = (long)width[i * stride];
+      if (p == 0) {
+        if (w < signaltimings[p * 2])
+          signaltimings[p * 2] = w;
+      } else if (w < signaltimings[p * 2] && w > signaltimings[p * 2 - 1]) {
+        signaltimings[p * 2] = w;
+      }
+    }
+
+    for (int i = 0; i < count; i++) {
+      long w = (long)width[i * stride];
+      if (w < signaltimings[p * 2] + tolerance &&
+          w > signaltimings[p * 2 + 1]) {
+        signaltimings[p * 2 + 1] = w;
+      }
+    }
+
+    for (int i = 0; i < count; i++) {
+      long w = (long)width[i * stride];
+      if (w >= signaltimings[p * 2] && w <= signaltimings[p * 2 + 1]) {
+        signaltimingscount[p]++;
+        signaltimingssum[p] += w;
+      }
+    }
+  }
+
+  int n = 0;
+  while (n < CAPTURE_TIMINGS && signaltimingscount[n] > 0) {
+    mean[n] = signaltimingssum[n] / signaltimingscount[n];
+    size[n] = signaltimingscount[n];
+    n++;
+  }
+  return n;
+}
+
+// The most frequent cluster's mean; the shortest wins a tie
+long captureSymbol(const unsigned long *width, int count, long tolerance,
+                   long limit) {
+  long mean[CAPTURE_TIMINGS];
+  int size[CAPTURE_TIMINGS];
+  int n = captureClusters(width, count, tolerance, limit, mean, size);
+  if (n == 0)
+    return 0;
+  int best = 0;
+  for (int i = 1; i < n; i++)
+    if (size[i] > size[best])
+      best = i;
+  return mean[best];
+}
+
+long SignalCapture::symbolTicks(int first, int count) const {
+  if (count <= 0)
+    return 0;
+  return captureSymbol(sample + first, count, (long)tolerance * ticksPerUs,
+                       100000L * ticksPerUs);
+}
+
+// Quantises every pulse to the symbol time and writes the bit string and
+// the corrected widths.
+void SignalCapture::analyse(CaptureWriter &out, int first, int count) {
+  smoothcount = 0;
+  if (count <= 0)
+    return;
+  const int end = first + count;
+  const long symbol = symbolTicks(first, count);
+  if (symbol == 0)
+    return;
+
+  // A clipped first pulse of the capture takes the symbol time
+  if (first == 1) {
+    unsigned long shortest = sample[1];
+    for (int i = 2; i < end; i++)
+      if (sample[i] < shortest)
+        shortest = sample[i];
+    if (shortest == sample[1] && (long)shortest < symbol)
+      sample[1] = symbol;
+  }
+
+  // Bit string and quantised widths in one pass; a width rounds to the
+  // nearest multiple of the symbol time.
+  out.put('\n');
+  bool lastbin = 0;
+  for (int i = first; i < end; i++) {
+    float r = (float)sample[i] / symbol;
+    int calculate = r;
+    r = r - calculate;
+    r *= 10;
+    if (r >= 5)
+      calculate += 1;
+    if (calculate > 0) {
+      lastbin = !lastbin;
+      if (lastbin == 0 && calculate > 8) {
+        out.put(" [Pause: ");
+        out.put(toUs(sample[i]));
+        out.put(" samples]\n");
+      } else {
+        for (int b = 0; b < calculate; b++)
+          out.put(lastbin ? '1' : '0');
+      }
+      smooth[smoothcount++] = toUs((uint64_t)calculate * symbol);
+    }
+  }
+  out.put("\nSamples/Symbol: ");
+  out.put(toUs(symbol));
+  out.put('\n');
+
+  CaptureDecode d = classify(first, count);
+  out.put("Line code: ");
+  out.put(captureLineCodeName(d.code));
+  out.put(", ");
+  out.put((unsigned long)d.confidence);
+  out.put("% fit\nData (");
+  out.put((unsigned long)d.bits);
+  out.put(" bits): ");
+  writeBits(out, first, count, d);
+  out.put("\n\n");
+
+  out.put("Rawdata corrected:\nCount=");
+  out.put((unsigned long)(smoothcount + 1));
+  out.put('\n');
+  for (int i = 0; i < smoothcount; i++) {
+    out.put(smooth[i]);
+    out.put(',');
+  }
+}
+
+// ==========================================
+// LINE CODE
+// ==========================================
+static const char *const lineCodeNames[] = {"NRZ", "PWM", "PPM",
+                                            "Manchester"};
+
+const char *captureLineCodeName(CaptureLineCode code) {
+  return code <= CAPTURE_CODE_MANCHESTER ? lineCodeNames[code] : "?";
+}
+
+static inline long distance(long a, long b) { return a > b ? a - b : b - a; }
+
+// The two largest clusters of the marks (or spaces) with at least a tenth
+// of them each, shorter first; widths[1] is 0 when there is one
+void SignalCapture::levelClusters(int first, int count, bool marks,
+                                  long symbol, long *widths) const {
+  long mean[CAPTURE_TIMINGS];
+  int size[CAPTURE_TIMINGS];
+  int start = ((first & 1) != 0) == marks ? first : first + 1;
+  int n = (first + count - start + 1) / 2;
+  widths[0] = widths[1] = 0;
+  if (n <= 0)
+    return;
+  long tol = (long)tolerance * ticksPerUs;
+  if (tol > symbol / 2)
+    tol = symbol / 2;
+  int found = captureClusters(sample + start, n, tol, 100000L * ticksPerUs,
+                              mean, size, 2);
+  int a = -1, b = -1;
+  for (int i = 0; i < found; i++) {
+    if (size[i] * 10 < n)
+      continue;
+    if (a < 0 || size[i] > size[a]) {
+      b = a;
+      a = i;
+    } else if (b < 0 || size[i] > size[b]) {
+      b = i;
+    }
+  }
+  if (a < 0)
+    return;
+  if (b >= 0 && mean[b] < mean[a]) {
+    widths[0] = mean[b];
+    widths[1] = mean[a];
+  } else {
+    widths[0] = mean[a];
+    widths[1] = b >= 0 ? mean[b] : 0;
+  }
+}
+
+// Walks the pulses as d.code, counting the symbols that fit it, and
+// writes the data bits when out is set. Returns the fit in percent.
+int SignalCapture::decode(int first, int count, CaptureDecode &d,
+                          CaptureWriter *out) const {
+  const int end = first + count;
+  int units = 0, valid = 0;
+  d.bits = 0;
+
+  switch (d.code) {
+  case CAPTURE_CODE_PWM:
+  case CAPTURE_CODE_PPM: {
+    const long tol =
+        (d.mark[0] < d.space[0] ? d.mark[0] : d.space[0]) / 2;
+    const long period = (d.mark[0] + d.mark[1] + d.space[0] + d.space[1]) / 2;
+    for (int i = first | 1; i < end; i += 2) {
+      long m = sample[i];
+      bool spaced = i + 1 < end;
+      long s = spaced ? sample[i + 1] : 0;
+      bool ok;
+      bool bit;
+      if (d.code == CAPTURE_CODE_PWM) {
+        bit = distance(m, d.mark[1]) < distance(m, d.mark[0]);
+        ok = distance(m, d.mark[bit]) <= tol &&
+             (!spaced || distance(m + s, period) <= tol);
+      } else {
+        // The last mark only ends the last space
+        if (!spaced)
+          break;
+        bit = distance(s, d.space[1]) < distance(s, d.space[0]);
+        ok = distance(m, d.mark[0]) <= tol &&
+             distance(s, d.space[bit]) <= tol;
+      }
+      units++;
+      valid += ok;
+      d.bits++;
+      if (out)
+        out->put(bit ? '1' : '0');
+    }
+    break;
+  }
+
+  case CAPTURE_CODE_MANCHESTER: {
+    const long h = d.unit;
+    int half = 0;
+    bool held = false;
+    for (int i = first; i < end; i++) {
+      long k = (sample[i] + h / 2) / h;
+      bool level = i & 1;
+      if ((k != 1 && k != 2) || distance(sample[i], k * h) > h / 2) {
+        // Not a half bit multiple: resynchronise on the next pulse
+        units++;
+        half = 0;
+        continue;
+      }
+      for (long j = 0; j < k; j++, half++) {
+        if (((half + d.align) & 1) == 0) {
+          held = level;
+          continue;
+        }
+        units++;
+        if (held != level) {
+          valid++;
+          d.bits++;
+          if (out)
+            out->put(held ? '1' : '0');
+        }
+      }
+    }
+    break;
+  }
+
+  default: {
+    const long t = d.unit;
+    for (int i = first; i < end; i++) {
+      long k = (sample[i] + t / 2) / t;
+      units++;
+      valid += k > 0 && distance(sample[i], k * t) <= t / 4;
+      if (k > 8) // a pause, as in the bit string above
+        continue;
+      d.bits += k;
+      if (out)
+        for (long b = 0; b < k; b++)
+          out->put((i & 1) ? '1' : '0');
+    }
+    break;
+  }
+  }
+  return units ? valid * 100 / units : 0;
+}
+
+CaptureDecode SignalCapture::classify(int first, int count) const {
+  CaptureDecode best = {};
+  best.code = CAPTURE_CODE_NRZ;
+  best.unit = symbolTicks(first, count);
+  if (best.unit == 0)
+    return best;
+  levelClusters(first, count, true, best.unit, best.mark);
+  levelClusters(first, count, false, best.unit, best.space);
+
+  CaptureDecode nrz = best;
+  best.confidence = 0;
+  if (best.mark[0] && best.space[0]) {
+    CaptureDecode c = best;
+    if (c.mark[1] && c.space[1]) {
+      c.code = CAPTURE_CODE_PWM;
+      c.confidence = decode(first, count, c, NULL);
+      if (c.confidence > best.confidence)
+        best = c;
+    }
+    if (!c.mark[1] && c.space[1]) {
+      c.code = CAPTURE_CODE_PPM;
+      c.confidence = decode(first, count, c, NULL);
+      if (c.confidence > best.confidence)
+        best = c;
+    }
+    c.code = CAPTURE_CODE_MANCHESTER;
+    c.unit = c.mark[0] < c.space[0] ? c.mark[0] : c.space[0];
+    for (uint8_t align = 0; align < 2; align++) {
+      c.align = align;
+      c.confidence = decode(first, count, c, NULL);
+      if (c.confidence > best.confidence)
+        best = c;
+    }
+  }
+  if (best.confidence >= CAPTURE_CODE_CONFIDENT)
+    return best;
+  nrz.confidence = decode(first, count, nrz, NULL);
+  return nrz;
+}
+
+void SignalCapture::writeBits(CaptureWriter &out, int first, int count,
+                              const CaptureDecode &d) const {
+  CaptureDecode c = d;
+  if (c.unit != 0)
+    decode(first, count, c, &out);
+}
+
+// ==========================================
+// SEGMENTATION
+// ==========================================
+void SignalCapture::rssi(capture_time_t now, int dBm) {
+  if (++rssiSkip < rssiStride)
+    return;
+  rssiSkip = 0;
+  if (rssicount == CAPTURE_RSSI_SAMPLES) {
+    for (int i = 0; i < CAPTURE_RSSI_SAMPLES / 2; i++)
+      rssiLog[i] = rssiLog[i * 2];
+    rssicount = CAPTURE_RSSI_SAMPLES / 2;
+    rssiStride *= 2;
+  }
+  rssiLog[rssicount].time = now;
+  rssiLog[rssicount].dBm = dBm;
+  rssicount++;
+}
+
+// Strongest sample within [start, end], else the one closest to start
+int SignalCapture::frameRssi(capture_time_t start, capture_time_t end) const {
+  int best = CAPTURE_RSSI_NONE;
+  capture_time_t nearest = 0;
+  bool inside = false;
+  for (int i = 0; i < rssicount; i++) {
+    const CaptureRssi &r = rssiLog[i];
+    if (r.time < burstStart)
+      continue; // left over from a discarded burst
+    if (r.time >= start && r.time <= end) {
+      if (!inside || r.dBm > best)
+        best = r.dBm;
+      inside = true;
+    } else if (!inside) {
+      capture_time_t d = r.time < start ? start - r.time : r.time - end;
+      if (best == CAPTURE_RSSI_NONE || d < nearest) {
+        best = r.dBm;
+        nearest = d;
+      }
+    }
+  }
+  return best;
+}
+
+int SignalCapture::segment(void) {
+  framecount = 0;
+  uniquecount = 0;
+  const int count = samplecount;
+  const long symbol = symbolTicks(1, count - 1);
+  frameSymbol = symbol;
+  if (symbol == 0)
+    return 0;
+  unsigned long gap = (unsigned long)symbol * CAPTURE_FRAME_GAP_SYMBOLS;
+  const unsigned long gapMin =
+      (unsigned long)CAPTURE_FRAME_GAP_MIN_US * ticksPerUs;
+  if (gap < gapMin)
+    gap = gapMin;
+
+  // sample[i] ends at burstStart + sample[1] + ... + sample[i]
+  capture_time_t t = burstStart;
+  capture_time_t start = t;
+  int first = 1;
+  for (int i = 1; i <= count; i++) {
+    // The last frame takes the rest once the table is full
+    bool split = i == count ||
+                 (sample[i] > gap && framecount < CAPTURE_FRAMES - 1);
+    if (split) {
+      if (i - first >= CAPTURE_FRAME_MIN_PULSES) {
+        CaptureFrame &f = frames[framecount++];
+        f.first = first;
+        f.count = i - first;
+        f.start = start;
+        f.offsetUs = toUs(start - frames[0].start);
+        f.rssi = frameRssi(start, t);
+        f.hash = 0;
+        f.repeats = 1;
+        f.periodUs = 0;
+        f.jitterUs = 0;
+      }
+      first = i + 1;
+    }
+    if (i < count)
+      t += sample[i];
+    if (split)
+      start = t;
+  }
+  return framecount;
+}
+
+// ==========================================
+// REPETITION FOLDING
+// ==========================================
+uint32_t SignalCapture::frameHash(const CaptureFrame &f) const {
+  uint32_t h = 0x811C9DC5UL;
+  for (int i = f.first; i < f.first + f.count; i++) {
+    unsigned long q = (sample[i] + frameSymbol / 2) / frameSymbol;
+    h = (h ^ (q < 0xFF ? q : 0xFF)) * 0x01000193UL;
+  }
+  return h;
+}
+
+// Same number of pulses and either the same quantised widths or every
+// width within tolerance. deviation is the largest difference, ticks.
+bool SignalCapture::sameFrame(const CaptureFrame &a, const CaptureFrame &b,
+                              unsigned long &deviation) const {
+  if (a.count != b.count)
+    return false;
+  deviation = 0;
+  for (int i = 0; i < a.count; i++) {
+    unsigned long x = sample[a.first + i];
+    unsigned long y = sample[b.first + i];
+    unsigned long d = x > y ? x - y : y - x;
+    if (d > deviation)
+      deviation = d;
+  }
+  return a.hash == b.hash ||
+         deviation <= (unsigned long)tolerance * ticksPerUs;
+}
+
+int SignalCapture::fold(void) {
+  uniquecount = 0;
+  CaptureFrame *run = NULL;
+  for (int i = 0; i < framecount; i++) {
+    CaptureFrame &f = frames[i];
+    f.hash = frameHash(f);
+    unsigned long deviation;
+    if (run != NULL && sameFrame(*run, f, deviation)) {
+      run->repeats++;
+      run->periodUs = toUs(f.start - run->start) / (run->repeats - 1);
+      if (toUs(deviation) > run->jitterUs)
+        run->jitterUs = toUs(deviation);
+      f.repeats = 0;
+    } else {
+      run = &f;
+      uniquecount++;
+    }
+  }
+  return uniquecount;
+}
@@ -0,0 +1,293 @@
+#ifndef SIGNAL_CAPTURE_h
+#define SIGNAL_CAPTURE_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+// ==========================================
+// RAW SIGNAL CAPTURE AND ANALYSIS
+// ==========================================
+// The capture path of the firmware without any Arduino dependency, so it
+// builds for the ESP32 and for the host benchmarks alike:
+//   edge()     body of the GDO edge interrupt, records pulse widths
+//   complete() a burst ended (enough pulses, then a long enough silence)
+//   writeRaw() "Frequency= / Count= / widths" block of /logs.txt
+//   writeSub() the capture as a Flipper SubGhz RAW file
+//   analyse()  timing clustering, bit string and corrected widths, and
+//              the data bits of the line code classify() recognises
+// Text goes through a CaptureSink in small chunks instead of one large
+// String, so the caller can stream it straight into a file.
+//
+// Timestamps are in ticks of ticksPerUs per microsecond: 1 with micros().
+// Built with CAPTURE_CYCLE_TIMESTAMPS they are 64-bit, so the firmware can
+// pass an extended CPU cycle count. Widths are kept in ticks and only
+// converted to microseconds on output; thresholds stay in microseconds.
+//
+// edge() filters in front of the buffer (CaptureFilter), each with its own
+// counter, so only plausible bursts reach complete() and the analyser:
+//   glitches   pulses below the threshold are dropped, or with merge set
+//              folded with the pulses around them into one pulse
+//   rate       more than maxEdgesPerMs edges within one millisecond is
+//              noise: the burst so far is discarded
+//   length     bursts that end with fewer than minBurst pulses are dropped
+//   adaptive   the glitch threshold follows the mean pulse width of the
+//              noise dropped above (adaptive percent of it, at most
+//              CAPTURE_ADAPT_MAX_US) and relaxes after each good burst
+// The defaults reproduce the original fixed 100 us / 30 pulse filter.
+//
+// With carrier-sense gating the caller reports the carrier with open()
+// and close(). open() starts a fresh burst and close() ends it at once,
+// so complete() does not have to wait for CAPTURE_GAP_US of silence.
+//
+// A remote repeats its frame 5-20 times with a few ms between them, all
+// of which end up in one capture. segment() splits the capture into
+// frames on gaps longer than CAPTURE_FRAME_GAP_SYMBOLS symbol times (at
+// least CAPTURE_FRAME_GAP_MIN_US) and gives each frame its start time and
+// the strongest RSSI sampled during it (rssi(), fed by the radio task
+// while the burst is on air), so analyse() can run once per frame.
+// fold() then collapses runs of consecutive repeats: a frame folds into
+// the one before it when their widths quantised to the symbol time hash
+// the same, or when every width is within tolerance of it. The first
+// frame of a run keeps the repeat count, period and jitter; sample[] is
+// left alone, so the repeats can still be expanded.
+
+#define CAPTURE_SAMPLES 2000
+#define CAPTURE_MIN_SAMPLES 30
+#define CAPTURE_MIN_PULSE_US 100
+#define CAPTURE_GAP_US 100000
+#define CAPTURE_TOLERANCE_US 200
+#define CAPTURE_TIMINGS 10
+#define CAPTURE_WRITE_CHUNK 256
+#define CAPTURE_WIDTH_MAX 0xFFFFFFFFUL // clip for the silence before a burst
+#define CAPTURE_ADAPT_MAX_US 200
+#define CAPTURE_FRAMES 32
+#define CAPTURE_FRAME_GAP_SYMBOLS 12
+#define CAPTURE_FRAME_GAP_MIN_US 2000
+#define CAPTURE_FRAME_MIN_PULSES 8 // shorter runs are dropped, not frames
+#define CAPTURE_RSSI_SAMPLES 64
+#define CAPTURE_RSSI_NONE -128
+#define CAPTURE_SUB_LINE_VALUES 512 // per RAW_Data line, as the Flipper
+
+#ifdef CAPTURE_CYCLE_TIMESTAMPS
+typedef uint64_t capture_time_t;
+#else
+typedef unsigned long capture_time_t;
+#endif
+
+typedef void (*CaptureSink)(void *ctx, const char *text, size_t len);
+
+// Fixed buffer in front of a sink
+class CaptureWriter {
+public:
+  CaptureWriter(CaptureSink sink, void *ctx) : sink(sink), ctx(ctx) {}
+  ~CaptureWriter(void) { flush(); }
+  void put(const char *text);
+  void put(char c);
+  void put(unsigned long v);
+  void put(float v, int decimals);
+  void flush(void);
+  size_t total(void) const { return written + len; }
+
+private:
+  CaptureSink sink;
+  void *ctx;
+  char buf[CAPTURE_WRITE_CHUNK];
+  size_t len = 0;
+  size_t written = 0;
+};
+
+// Outcome of every edge() call, kept across reset()
+struct CaptureCounters {
+  uint32_t accepted; // pulse stored
+  uint32_t rejected; // below the glitch threshold, dropped
+  uint32_t overruns; // buffer full, the burst was cut short
+  uint32_t merged;   // below the glitch threshold, folded into a pulse
+  uint32_t noisy;    // over the edge rate ceiling
+  uint32_t noiseBursts; // bursts discarded by the rate ceiling
+  uint32_t shortBursts; // bursts that ended below minBurst pulses
+};
+
+struct CaptureFilter {
+  unsigned int minPulse;      // us, shorter pulses are glitches
+  bool merge;                 // fold glitches instead of dropping them
+  unsigned int minBurst;      // pulses for a burst to complete
+  unsigned int maxEdgesPerMs; // 0: no rate ceiling
+  uint8_t adaptive;           // percent of the noise width, 0: off
+};
+
+// Clusters of count widths, every stride-th one, within tolerance of each
+// other, ignoring widths from limit on: up to CAPTURE_TIMINGS means and
+// sizes, shortest first. Returns the number of clusters.
+int captureClusters(const unsigned long *width, int count, long tolerance,
+                    long limit, long *mean, int *size, int stride = 1);
+// Symbol time: the mean of the most frequent cluster
+long captureSymbol(const unsigned long *width, int count, long tolerance,
+                   long limit);
+
+// Line codes told apart by their mark and space clusters:
+//   PWM         two mark and two space widths, mark + space constant;
+//               a long mark is a 1
+//   PPM         one mark width, two space widths; a long space is a 1
+//   Manchester  marks and spaces of one or two half bits; high-low is a 1
+//               (G.E. Thomas), the half bit alignment that fits best wins
+//   NRZ         anything else: every symbol time is a bit of its level
+enum CaptureLineCode : uint8_t {
+  CAPTURE_CODE_NRZ,
+  CAPTURE_CODE_PWM,
+  CAPTURE_CODE_PPM,
+  CAPTURE_CODE_MANCHESTER
+};
+
+#define CAPTURE_CODE_CONFIDENT 80 // percent, below that NRZ is reported
+
+struct CaptureDecode {
+  CaptureLineCode code;
+  uint8_t confidence; // percent of the symbols that fit the code
+  int bits;
+  long mark[2];  // short and long mark, ticks, 0 if there is none
+  long space[2]; // same for the spaces
+  long unit;     // symbol (NRZ) or half bit (Manchester), ticks
+  uint8_t align; // Manchester: half bit that starts a bit
+};
+
+const char *captureLineCodeName(CaptureLineCode code);
+
+// One frame of a segmented capture
+struct CaptureFrame {
+  int first;              // index of its first pulse in sample[]
+  int count;              // pulses
+  capture_time_t start;   // timestamp of its first edge, ticks
+  unsigned long offsetUs; // from the start of the first frame
+  int rssi;               // dBm, CAPTURE_RSSI_NONE without a sample
+  uint32_t hash;          // FNV-1a of the quantised widths, from fold()
+  uint16_t repeats;       // frames in its run, 0 when folded into another
+  unsigned long periodUs; // mean start to start time within the run
+  unsigned long jitterUs; // largest width difference within the run
+};
+
+struct CaptureRssi {
+  capture_time_t time;
+  int dBm;
+};
+
+class SignalCapture {
+public:
+  // Relaxes the adaptive threshold when a burst was delivered
+  void reset(void);
+  // Returns false once the buffer is full; stop listening until the
+  // capture has been processed.
+  bool IRAM_ATTR edge(capture_time_t now);
+  bool complete(capture_time_t now) const {
+    return samplecount >= (int)filter.minBurst &&
+           (closed || now - last() > gapTicks());
+  }
+  bool busy(capture_time_t now) const {
+    return samplecount > 0 && !closed && now - last() < gapTicks();
+  }
+  // Carrier came up. Returns false while a finished burst waits to be
+  // processed, edges must stay off then.
+  bool IRAM_ATTR open(capture_time_t now);
+  // Carrier went away
+  void IRAM_ATTR close(void) { closed = true; }
+  // Set before arming; thresholds are converted with it on every edge
+  void setTickRate(unsigned int perUs) {
+    ticksPerUs = perUs ? perUs : 1;
+    updateThreshold();
+  }
+  void setFilter(const CaptureFilter &f);
+  const CaptureFilter &getFilter(void) const { return filter; }
+  // Current glitch threshold, with the adaptive part
+  unsigned long glitchUs(void) const { return toUs(glitchTicks); }
+  // RSSI while the burst is on air, from task context. Once the log is
+  // full every other entry is dropped and the rate halves, so it always
+  // spans the whole burst.
+  void rssi(capture_time_t now, int dBm);
+  void writeRaw(CaptureWriter &out, float frequency) const;
+  // "Count= / widths" of one frame
+  void writeFrame(CaptureWriter &out, const CaptureFrame &f) const;
+  // Header and signed RAW_Data lines: sample[1] is the first mark after
+  // the silence, so odd samples are positive and even ones negative
+  void writeSub(CaptureWriter &out, unsigned long frequencyHz,
+                const char *preset) const;
+  // Fills frames[]; call once complete(), before analyse(). Returns
+  // framecount, 0 when no run of pulses qualifies.
+  int segment(void);
+  // Sets hash and the run fields of frames[], returns the number of runs
+  int fold(void);
+  // Rewrites sample[1] when the first pulse is clipped, like the original
+  // analyser, and fills smooth[].
+  void analyse(CaptureWriter &out) { analyse(out, 1, samplecount - 1); }
+  // Same over count pulses from sample[first], e.g. one of frames[]
+  void analyse(CaptureWriter &out, int first, int count);
+  // Line code of count pulses from sample[first]; odd samples are marks
+  CaptureDecode classify(int first, int count) const;
+  // Its data bits as '0' and '1'
+  void writeBits(CaptureWriter &out, int first, int count,
+                 const CaptureDecode &d) const;
+
+  volatile int samplecount = 0;
+  volatile capture_time_t lastTime = 0;
+  volatile bool closed = false; // burst ended by close()
+  unsigned long sample[CAPTURE_SAMPLES]; // ticks
+  unsigned long smooth[CAPTURE_SAMPLES]; // us
+  int smoothcount = 0;
+  CaptureFrame frames[CAPTURE_FRAMES];
+  int framecount = 0;
+  int uniquecount = 0; // runs after fold()
+  int tolerance = CAPTURE_TOLERANCE_US;
+  CaptureCounters counters = {};
+  unsigned int ticksPerUs = 1;
+
+private:
+  void IRAM_ATTR discard(int n, capture_time_t end);
+  void IRAM_ATTR updateThreshold(void);
+  long symbolTicks(int first, int count) const;
+  void levelClusters(int first, int count, bool marks, long symbol,
+                     long *widths) const;
+  int decode(int first, int count, CaptureDecode &d,
+             CaptureWriter *out) const;
+  int frameRssi(capture_time_t start, capture_time_t end) const;
+  uint32_t frameHash(const CaptureFrame &f) const;
+  bool sameFrame(const CaptureFrame &a, const CaptureFrame &b,
+                 unsigned long &deviation) const;
+
+  capture_time_t gapTicks(void) const {
+    return (capture_time_t)CAPTURE_GAP_US * ticksPerUs;
+  }
+  // lastTime from task context: a 64-bit value can be torn by the edge
+  // interrupt, so read until two reads agree
+  capture_time_t last(void) const {
+    capture_time_t t;
+    do
+      t = lastTime;
+    while (t != lastTime);
+    return t;
+  }
+  unsigned long toUs(uint64_t ticks) const {
+    return (ticks + ticksPerUs / 2) / ticksPerUs;
+  }
+
+  CaptureFilter filter = {CAPTURE_MIN_PULSE_US, false, CAPTURE_MIN_SAMPLES, 0,
+                          0};
+  unsigned long glitchTicks = CAPTURE_MIN_PULSE_US;
+  unsigned long noiseTicks = 0; // mean width of discarded noise
+  capture_time_t burstStart = 0;
+  long frameSymbol = 0; // ticks, from segment()
+  capture_time_t windowStart = 0;
+  unsigned int windowEdges = 0;
+  unsigned long pending = 0; // glitch time waiting to be merged
+  uint8_t pendingCount = 0;  // glitches in pending
+  CaptureRssi rssiLog[CAPTURE_RSSI_SAMPLES];
+  int rssicount = 0;
+  unsigned int rssiStride = 1; // keep one call in rssiStride
+  unsigned int rssiSkip = 0;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "SubFingerprint.h"
+#include <string.h>
+
+// ==========================================
+// SIGNATURE
+// ==========================================
+// murmur3 finaliser, seeded per hash function
+static inline uint32_t mix(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x85EBCA6BUL;
+  x ^= x >> 13;
+  x *= 0xC2B2AE35UL;
+  x ^= x >> 16;
+  return x;
+}
+
+static bool isMark(const uint32_t *marks, int i) {
+  return marks ? (marks[i >> 5] >> (i & 31)) & 1 : (i & 1) == 0;
+}
+
+// The shortest cluster with at least a quarter of the largest one's
+// widths. The analyser's most frequent cluster flips between the short
+// and long widths of PWM codes, whose counts are about even.
+static long baseSymbol(const unsigned long *width, int count, long tolerance) {
+  long mean[CAPTURE_TIMINGS];
+  int size[CAPTURE_TIMINGS];
+  int n = captureClusters(width, count, tolerance, 0x7FFFFFFFL, mean, size);
+  int largest = 0;
+  for (int i = 0; i < n; i++)
+    if (size[i] > largest)
+      largest = size[i];
+  for (int i = 0; i < n; i++)
+    if (size[i] * 4 >= largest)
+      return mean[i];
+  return 0;
+}
+
+bool fingerprint(const unsigned long *width, const uint32_t *marks, int count,
+                 long tolerance, Fingerprint &out) {
+  long symbol = baseSymbol(width, count, tolerance);
+  if (symbol == 0)
+    return false;
+
+  uint32_t mins[FP_HASHES];
+  for (int h = 0; h < FP_HASHES; h++)
+    mins[h] = 0xFFFFFFFFUL;
+  bool any = false;
+  uint32_t token = 0;
+  int run = 0;
+  for (int i = 0; i < count; i++) {
+    unsigned long q = (width[i] + symbol / 2) / symbol;
+    if (q > FP_MAX_SYMBOLS) {
+      run = 0;
+      continue;
+    }
+    if (q == 0)
+      q = 1;
+    // 5 bits per width: mark flag and multiple
+    token = (token << 5) | (isMark(marks, i) ? 0x10 : 0) | q;
+    if (++run < FP_SHINGLE)
+      continue;
+    token &= (1UL << (5 * FP_SHINGLE)) - 1;
+    any = true;
+    for (int h = 0; h < FP_HASHES; h++) {
+      uint32_t v = mix(token ^ (0x9E3779B9UL * (h + 1)));
+      if (v < mins[h])
+        mins[h] = v;
+    }
+  }
+  if (!any)
+    return false;
+  for (int h = 0; h < FP_HASHES; h++)
+    out.sig[h] = mins[h] >> 16;
+  return true;
+}
+
+bool fingerprint(const SignalCapture &capture, Fingerprint &out) {
+  if (capture.samplecount < 2)
+    return false;
+  return fingerprint(capture.sample + 1, NULL, capture.samplecount - 1,
+                     (long)capture.tolerance * capture.ticksPerUs, out);
+}
+
+uint8_t fingerprintScore(const Fingerprint &a, const Fingerprint &b) {
+  int same = 0;
+  for (int h = 0; h < FP_HASHES; h++)
+    same += a.sig[h] == b.sig[h];
+  return same * 100 / FP_HASHES;
+}
+
+// ==========================================
+// .SUB PARSER
+// ==========================================
+void SubParser::begin(void) {
+  n = 0;
+  keyLen = 0;
+  raw = false;
+  negative = false;
+  digits = false;
+  value = 0;
+  memset(marks, 0, sizeof(marks));
+}
+
+void SubParser::number(void) {
+  if (digits && value > 0 && n < FP_PULSES) {
+    width[n] = value;
+    if (!negative)
+      marks[n >> 5] |= 1UL << (n & 31);
+    n++;
+  }
+  negative = false;
+  digits = false;
+  value = 0;
+}
+
+void SubParser::feed(const char *text, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    char c = text[i];
+    if (c == '\n' || c == '\r') {
+      number();
+      keyLen = 0;
+      raw = false;
+    } else if (!raw) {
+      // "RAW_Data:" starting the line switches to values
+      if (keyLen < sizeof(key))
+        key[keyLen] = c;
+      keyLen = keyLen < 255 ? keyLen + 1 : 255;
+      if (c == ':')
+        raw = keyLen == sizeof(key) && memcmp(key, "RAW_Data:", 9) == 0;
+    } else if (c >= '0' && c <= '9') {
+      value = value * 10 + (c - '0');
+      digits = true;
+    } else {
+      number();
+      negative = c == '-';
+    }
+  }
+}
+
+bool SubParser::finish(Fingerprint &out) {
+  number();
+  return fingerprint(width, marks, n, FP_TOLERANCE_US, out);
+}
@@ -0,0 +1,68 @@
+#ifndef SUB_FINGERPRINT_h
+#define SUB_FINGERPRINT_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "SignalCapture.h"
+
+// ==========================================
+// SIGNAL FINGERPRINTS
+// ==========================================
+// A MinHash signature of a pulse train, so captures can be matched
+// against the .sub library by comparing a few dozen bytes:
+//   1. the symbol time is found with the analyser's clustering
+//   2. every width becomes a signed multiple of it (marks positive), so
+//      timing jitter below half a symbol disappears; runs longer than
+//      FP_MAX_SYMBOLS split the train like inter-frame gaps do
+//   3. each FP_SHINGLE consecutive multiples within a run form a token
+//   4. for each of FP_HASHES hash functions the smallest token hash is
+//      kept (16 bits of it)
+// Two signatures agree in a fraction of positions that estimates the
+// Jaccard similarity of their token sets. Sets ignore how often a frame
+// repeats and where the capture started, which is what makes a five
+// frame capture match a twenty frame recording of the same remote.
+
+#define FP_HASHES 32
+#define FP_SHINGLE 6
+#define FP_MAX_SYMBOLS 15
+#define FP_PULSES 2048      // widths a SubParser keeps, the rest is ignored
+#define FP_TOLERANCE_US 200 // clustering tolerance, as the analyser's
+
+struct Fingerprint {
+  uint16_t sig[FP_HASHES];
+};
+
+// count widths in any unit; marks bit i set when width[i] is a mark,
+// NULL when they alternate starting with a mark. Returns false when no
+// run is FP_SHINGLE widths long.
+bool fingerprint(const unsigned long *width, const uint32_t *marks, int count,
+                 long tolerance, Fingerprint &out);
+// Of the capture's current burst, sample[1] on
+bool fingerprint(const SignalCapture &capture, Fingerprint &out);
+// Matching positions, 0..100
+uint8_t fingerprintScore(const Fingerprint &a, const Fingerprint &b);
+
+// Collects the RAW_Data values of a Flipper .sub file fed in chunks of
+// any size. Key files without RAW_Data yield no widths.
+class SubParser {
+public:
+  void begin(void);
+  void feed(const char *text, size_t len);
+  int count(void) const { return n; }
+  bool finish(Fingerprint &out);
+
+private:
+  void number(void);
+
+  unsigned long width[FP_PULSES]; // us
+  uint32_t marks[FP_PULSES / 32];
+  int n = 0;
+  char key[9];
+  uint8_t keyLen = 0;
+  bool raw = false;
+  bool negative = false;
+  bool digits = false;
+  unsigned long value = 0;
+};
+
+#endif
@@ -0,0 +1,116 @@
+"""
+Embed the web UI (SD/HTML) into the firmware, gzipped.
+
+Runs before every esp32dev build as a PlatformIO extra script and writes
+web_assets_data.h into the build directory. It can also be run by hand:
+
+    python scripts/embed_web.py <output dir>
+
+Every file becomes one route ("/" for index.html, "/<name>" for the other
+pages, "/<file>" for everything else). Pages get their stylesheet and
+script references rewritten to "<file>?v=<hash>", so those two can be
+cached for a year and still change with the firmware.
+"""
+
+import gzip
+import os
+import re
+import sys
+
+TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "text/javascript",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+}
+
+HEADER = "web_assets_data.h"
+
+
+def fnv1a(data):
+    h = 0x811C9DC5
+    for b in data:
+        h = ((h ^ b) * 0x01000193) & 0xFFFFFFFF
+    return h
+
+
+def route(name):
+    stem, ext = os.path.splitext(name)
+    if name == "index.html":
+        return "/"
+    if ext == ".html":
+        return "/" + stem
+    return "/" + name
+
+
+def c_array(name, data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    return "static const uint8_t %s[%d] = {\n%s\n};\n" % (
+        name, len(data), "\n".join(lines))
+
+
+def generate(html_dir):
+    files = sorted(f for f in os.listdir(html_dir)
+                   if os.path.splitext(f)[1] in TYPES)
+    raw = {}
+    for f in files:
+        with open(os.path.join(html_dir, f), "rb") as fp:
+            raw[f] = fp.read()
+
+    versioned = [f for f in files if not f.endswith(".html")]
+    arrays = []
+    table = []
+    for f in files:
+        source = raw[f]
+        served = source
+        if f.endswith(".html"):
+            for v in versioned:
+                served = re.sub(
+                    rb'((?:href|src)="/?)' + re.escape(v.encode()) + rb'"',
+                    rb'\g<1>' + v.encode() + b"?v=%08x" % fnv1a(raw[v]) + b'"',
+                    served)
+        packed = gzip.compress(served, compresslevel=9, mtime=0)
+        ident = "web_" + re.sub(r"[^A-Za-z0-9]", "_", f)
+        arrays.append(c_array(ident, packed))
+        table.append('    {"%s", "/HTML/%s", "%s", 0x%08xUL, 0x%08xUL, %s, %s, sizeof(%s)},'
+                     % (route(f), f, TYPES[os.path.splitext(f)[1]],
+                        fnv1a(source), fnv1a(served),
+                        "true" if f in versioned else "false", ident, ident))
+
+    out = []
+    out.append("// Generated by scripts/embed_web.py from SD/HTML, do not edit\n")
+    out.append("#define WEB_ASSET_COUNT %d\n\n" % len(files))
+    out.extend(arrays)
+    out.append("\nstatic const WebAsset webAssets[WEB_ASSET_COUNT] = {\n")
+    out.append("\n".join(table))
+    out.append("\n};\n")
+    return "".join(out)
+
+
+def write(project_dir, out_dir):
+    text = generate(os.path.join(project_dir, "SD", "HTML"))
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+    path = os.path.join(out_dir, HEADER)
+    # Leave the file alone when nothing changed, so nothing rebuilds
+    if os.path.exists(path):
+        with open(path) as fp:
+            if fp.read() == text:
+                return path
+    with open(path, "w") as fp:
+        fp.write(text)
+    return path
+
+
+if __name__ == "__main__":
+    here = os.path.dirname(os.path.abspath(__file__))
+    print(write(os.path.dirname(here), sys.argv[1] if len(sys.argv) > 1 else "."))
+else:
+    Import("env")  # noqa: F821 (SCons)
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "generated")  # noqa: F821
+    write(env.subst("$PROJECT_DIR"), out_dir)  # noqa: F821
+    env.Append(CPPPATH=[out_dir])  # noqa: F821
@@ -16,69 +16,41 @@ cc1101 Driver for RC Switch. Mod by Little Satan. With permission to modify and
 #include <SPI.h>
 #include "ELECHOUSE_CC1101_SRC_DRV.h"
 #include <Arduino.h>
+#ifdef CC1101_FAST_GPIO
+#include <soc/gpio_struct.h>
+#endif
 
 /****************************************************************/
 #define   WRITE_BURST       0x40            //write burst
 #define   READ_SINGLE       0x80            //read single
 #define   READ_BURST        0xC0            //read burst
 #define   BYTES_IN_RXFIFO   0x7F            //byte number in RXfifo
-#define   max_modul 6
 
-SPIClass CCSPI(HSPI);
-
-byte modulation = 2;
-byte frend0;
-byte chan = 0;
-int pa = 12;
-byte last_pa;
-byte SCK_PIN;
-byte MISO_PIN;
-byte MOSI_PIN;
-byte SS_PIN;
-byte GDO0;
-byte GDO2;
-byte SCK_PIN_M[max_modul];
-byte MISO_PIN_M[max_modul];
-byte MOSI_PIN_M[max_modul];
-byte SS_PIN_M[max_modul];
-byte GDO0_M[max_modul];
-byte GDO2_M[max_modul];
-byte gdo_set=0;
-bool spi = 0;
-bool ccmode = 0;
-float MHz = 433.92;
-byte m4RxBw = 0;
-byte m4DaRa;
-byte m2DCOFF;
-byte m2MODFM;
-byte m2MANCH;
-byte m2SYNCM;
-byte m1FEC;
-byte m1PRE;
-byte m1CHSP;
-byte pc1PQT;
-byte pc1CRC_AF;
-byte pc1APP_ST;
-byte pc1ADRCHK;
-byte pc0WDATA;
-byte pc0PktForm;
-byte pc0CRC_EN;
-byte pc0LenConf;
-byte trxstate = 0;
-byte clb1[2]= {24,28};
-byte clb2[2]= {31,38};
-byte clb3[2]= {65,76};
-byte clb4[2]= {77,79};
+SPIClass CCSPI(HSPI);   // shared by every module on the bus
 
 /****************************************************************/
-uint8_t PA_TABLE[8]     {0x00,0xC0,0x00,0x00,0x00,0x00,0x00,0x00};
 //                       -30  -20  -15  -10   0    5    7    10
-uint8_t PA_TABLE_315[8] {0x12,0x0D,0x1C,0x34,0x51,0x85,0xCB,0xC2,};             //300 - 348
-uint8_t PA_TABLE_433[8] {0x12,0x0E,0x1D,0x34,0x60,0x84,0xC8,0xC0,};             //387 - 464
+static const uint8_t PA_TABLE_315[8] {0x12,0x0D,0x1C,0x34,0x51,0x85,0xCB,0xC2,};             //300 - 348
+static const uint8_t PA_TABLE_433[8] {0x12,0x0E,0x1D,0x34,0x60,0x84,0xC8,0xC0,};             //387 - 464
 //                        -30  -20  -15  -10  -6    0    5    7    10   12
-uint8_t PA_TABLE_868[10] {0x03,0x17,0x1D,0x26,0x37,0x50,0x86,0xCD,0xC5,0xC0,};  //779 - 899.99
+static const uint8_t PA_TABLE_868[10] {0x03,0x17,0x1D,0x26,0x37,0x50,0x86,0xCD,0xC5,0xC0,};  //779 - 899.99
 //                        -30  -20  -15  -10  -6    0    5    7    10   11
-uint8_t PA_TABLE_915[10] {0x03,0x0E,0x1E,0x27,0x38,0x8E,0x84,0xCC,0xC3,0xC0,};  //900 - 928
+static const uint8_t PA_TABLE_915[10] {0x03,0x0E,0x1E,0x27,0x38,0x8E,0x84,0xCC,0xC3,0xC0,};  //900 - 928
+// Configuration register values after SRES (CC1101 datasheet, table 43)
+static const uint8_t REG_RESET[CC1101_CONFIG_SIZE] {
+  0x29,0x2E,0x3F,0x07,0xD3,0x91,0xFF,0x04,0x45,0x00,0x00,0x0F,0x00,0x1E,0xC4,0xEC,
+  0x8C,0x22,0x02,0x22,0xF8,0x47,0x07,0x30,0x04,0x36,0x6C,0x03,0x40,0x91,0x87,0x6B,
+  0xF8,0x56,0x10,0xA9,0x0A,0x20,0x0D,0x41,0x00,0x59,0x7F,0x3F,0x88,0x31,0x0B,};
+/****************************************************************
+*FUNCTION NAME:ELECHOUSE_CC1101
+*FUNCTION     :construct a module with reset register shadow
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+ELECHOUSE_CC1101::ELECHOUSE_CC1101(void)
+{
+  memcpy(regs, REG_RESET, CC1101_CONFIG_SIZE);
+}
 /****************************************************************
 *FUNCTION NAME:SpiStart
 *FUNCTION     :spi communication start
@@ -113,6 +85,50 @@ void ELECHOUSE_CC1101::SpiEnd(void)
   CCSPI.end();
 }
 /****************************************************************
+*FUNCTION NAME:SpiMasks
+*FUNCTION     :resolve CS and MISO to GPIO registers. With
+*              CC1101_FAST_GPIO a CS toggle is one store to W1TS/W1TC
+*              and the MISO ready poll one load, instead of a
+*              digitalWrite()/digitalRead() call per access.
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::SpiMasks(void)
+{
+#ifdef CC1101_FAST_GPIO
+  ssMask = 1UL << (SS_PIN & 31);
+  ssSet = SS_PIN < 32 ? &GPIO.out_w1ts : &GPIO.out1_w1ts.val;
+  ssClear = SS_PIN < 32 ? &GPIO.out_w1tc : &GPIO.out1_w1tc.val;
+  misoMask = 1UL << (MISO_PIN & 31);
+  misoIn = MISO_PIN < 32 ? &GPIO.in : &GPIO.in1.val;
+#endif
+}
+inline void ELECHOUSE_CC1101::csLow(void)
+{
+#ifdef CC1101_FAST_GPIO
+  *ssClear = ssMask;
+#else
+  digitalWrite(SS_PIN, LOW);
+#endif
+}
+inline void ELECHOUSE_CC1101::csHigh(void)
+{
+#ifdef CC1101_FAST_GPIO
+  *ssSet = ssMask;
+#else
+  digitalWrite(SS_PIN, HIGH);
+#endif
+}
+// The chip holds SO high until its crystal is running
+inline bool ELECHOUSE_CC1101::misoHigh(void)
+{
+#ifdef CC1101_FAST_GPIO
+  return (*misoIn & misoMask) != 0;
+#else
+  return digitalRead(MISO_PIN);
+#endif
+}
+/****************************************************************
 *FUNCTION NAME: GDO_Set()
 *FUNCTION     : set GDO0,GDO2 pin for serial pinmode.
 *INPUT        : none
@@ -141,15 +157,16 @@ void ELECHOUSE_CC1101::GDO0_Set (void)
 ****************************************************************/
 void ELECHOUSE_CC1101::Reset (void)
 {
-	digitalWrite(SS_PIN, LOW);
+	csLow();
 	delay(1);
-	digitalWrite(SS_PIN, HIGH);
+	csHigh();
 	delay(1);
-	digitalWrite(SS_PIN, LOW);
-	while(digitalRead(MISO_PIN));
+	csLow();
+	while(misoHigh());
   CCSPI.transfer(CC1101_SRES);
-  while(digitalRead(MISO_PIN));
-	digitalWrite(SS_PIN, HIGH);
+  while(misoHigh());
+	csHigh();
+  memcpy(regs, REG_RESET, CC1101_CONFIG_SIZE);
 }
 /****************************************************************
 *FUNCTION NAME:Init
@@ -161,7 +178,7 @@ void ELECHOUSE_CC1101::Init(void)
 {
   setSpi();
   SpiStart();                   //spi initialization
-  digitalWrite(SS_PIN, HIGH);
+  csHigh();
   digitalWrite(SCK_PIN, HIGH);
   digitalWrite(MOSI_PIN, LOW);
   Reset();                    //CC1101 reset
@@ -177,12 +194,13 @@ void ELECHOUSE_CC1101::Init(void)
 void ELECHOUSE_CC1101::SpiWriteReg(byte addr, byte value)
 {
   SpiStart();
-  digitalWrite(SS_PIN, LOW);
-  while(digitalRead(MISO_PIN));
+  csLow();
+  while(misoHigh());
   CCSPI.transfer(addr);
   CCSPI.transfer(value); 
-  digitalWrite(SS_PIN, HIGH);
+  csHigh();
   SpiEnd();
+  if (addr < CC1101_CONFIG_SIZE){regs[addr] = value;}
 }
 /****************************************************************
 *FUNCTION NAME:SpiWriteBurstReg
@@ -195,14 +213,15 @@ void ELECHOUSE_CC1101::SpiWriteBurstReg(byte addr, byte *buffer, byte num)
   byte i, temp;
   SpiStart();
   temp = addr | WRITE_BURST;
-  digitalWrite(SS_PIN, LOW);
-  while(digitalRead(MISO_PIN));
+  csLow();
+  while(misoHigh());
   CCSPI.transfer(temp);
   for (i = 0; i < num; i++)
   {
   CCSPI.transfer(buffer[i]);
+  if (addr + i < CC1101_CONFIG_SIZE){regs[addr + i] = buffer[i];}
   }
-  digitalWrite(SS_PIN, HIGH);
+  csHigh();
   SpiEnd();
 }
 /****************************************************************
@@ -214,10 +233,10 @@ void ELECHOUSE_CC1101::SpiWriteBurstReg(byte addr, byte *buffer, byte num)
 void ELECHOUSE_CC1101::SpiStrobe(byte strobe)
 {
   SpiStart();
-  digitalWrite(SS_PIN, LOW);
-  while(digitalRead(MISO_PIN));
+  csLow();
+  while(misoHigh());
   CCSPI.transfer(strobe);
-  digitalWrite(SS_PIN, HIGH);
+  csHigh();
   SpiEnd();
 }
 /****************************************************************
@@ -231,11 +250,11 @@ byte ELECHOUSE_CC1101::SpiReadReg(byte addr)
   byte temp, value;
   SpiStart();
   temp = addr| READ_SINGLE;
-  digitalWrite(SS_PIN, LOW);
-  while(digitalRead(MISO_PIN));
+  csLow();
+  while(misoHigh());
   CCSPI.transfer(temp);
   value=CCSPI.transfer(0);
-  digitalWrite(SS_PIN, HIGH);
+  csHigh();
   SpiEnd();
   return value;
 }
@@ -251,14 +270,14 @@ void ELECHOUSE_CC1101::SpiReadBurstReg(byte addr, byte *buffer, byte num)
   byte i,temp;
   SpiStart();
   temp = addr | READ_BURST;
-  digitalWrite(SS_PIN, LOW);
-  while(digitalRead(MISO_PIN));
+  csLow();
+  while(misoHigh());
   CCSPI.transfer(temp);
   for(i=0;i<num;i++)
   {
   buffer[i]=CCSPI.transfer(0);
   }
-  digitalWrite(SS_PIN, HIGH);
+  csHigh();
   SpiEnd();
 }
 
@@ -273,11 +292,11 @@ byte ELECHOUSE_CC1101::SpiReadStatus(byte addr)
   byte value,temp;
   SpiStart();
   temp = addr | READ_BURST;
-  digitalWrite(SS_PIN, LOW);
-  while(digitalRead(MISO_PIN));
+  csLow();
+  while(misoHigh());
   CCSPI.transfer(temp);
   value=CCSPI.transfer(0);
-  digitalWrite(SS_PIN, HIGH);
+  csHigh();
   SpiEnd();
   return value;
 }
@@ -301,6 +320,7 @@ void ELECHOUSE_CC1101::setSpi(void){
   SCK_PIN = 13; MISO_PIN = 12; MOSI_PIN = 11; SS_PIN = 10;
   #endif
 }
+SpiMasks();
 }
 /****************************************************************
 *FUNCTION NAME:COSTUM SPI
@@ -314,19 +334,7 @@ void ELECHOUSE_CC1101::setSpiPin(byte sck, byte miso, byte mosi, byte ss){
   MISO_PIN = miso;
   MOSI_PIN = mosi;
   SS_PIN = ss;
-}
-/****************************************************************
-*FUNCTION NAME:COSTUM SPI
-*FUNCTION     :set costum spi pins.
-*INPUT        :none
-*OUTPUT       :none
-****************************************************************/
-void ELECHOUSE_CC1101::addSpiPin(byte sck, byte miso, byte mosi, byte ss, byte modul){
-  spi = 1;
-  SCK_PIN_M[modul] = sck;
-  MISO_PIN_M[modul] = miso;
-  MOSI_PIN_M[modul] = mosi;
-  SS_PIN_M[modul] = ss;
+  SpiMasks();
 }
 /****************************************************************
 *FUNCTION NAME:GDO Pin settings
@@ -350,48 +358,6 @@ GDO0 = gdo0;
 GDO0_Set();
 }
 /****************************************************************
-*FUNCTION NAME:GDO Pin settings
-*FUNCTION     :add GDO Pins
-*INPUT        :none
-*OUTPUT       :none
-****************************************************************/
-void ELECHOUSE_CC1101::addGDO(byte gdo0, byte gdo2, byte modul){
-GDO0_M[modul] = gdo0;
-GDO2_M[modul] = gdo2;  
-gdo_set=2;
-GDO_Set();
-}
-/****************************************************************
-*FUNCTION NAME:add GDO0 Pin
-*FUNCTION     :add GDO0 Pin
-*INPUT        :none
-*OUTPUT       :none
-****************************************************************/
-void ELECHOUSE_CC1101::addGDO0(byte gdo0, byte modul){
-GDO0_M[modul] = gdo0;
-gdo_set=1;
-GDO0_Set();
-}
-/****************************************************************
-*FUNCTION NAME:set Modul
-*FUNCTION     :change modul
-*INPUT        :none
-*OUTPUT       :none
-****************************************************************/
-void ELECHOUSE_CC1101::setModul(byte modul){
-  SCK_PIN = SCK_PIN_M[modul];
-  MISO_PIN = MISO_PIN_M[modul];
-  MOSI_PIN = MOSI_PIN_M[modul];
-  SS_PIN = SS_PIN_M[modul];
-  if (gdo_set==1){
-  GDO0 = GDO0_M[modul];
-  }
-  else if (gdo_set==2){
-  GDO0 = GDO0_M[modul];
-  GDO2 = GDO2_M[modul];
-  }
-}
-/****************************************************************
 *FUNCTION NAME:CCMode
 *FUNCTION     :Format of RX and TX data
 *INPUT        :none
@@ -415,6 +381,25 @@ SpiWriteReg(CC1101_MDMCFG4, 7+m4RxBw);
 setModulation(modulation);
 }
 /****************************************************************
+*FUNCTION NAME:Carrier sense on GDO0
+*FUNCTION     :GDO0 outputs carrier sense (IOCFG0 0x0E) instead of
+*              the serial data setting of setCCMode()
+*INPUT        :enable; threshold: absolute carrier sense threshold in
+*              dB relative to MAGN_TARGET, -7..7 (AGCCTRL1[3:0])
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setCarrierSense(bool enable, int8_t threshold){
+byte agc = regs[CC1101_AGCCTRL1] & 0xF0;
+if (enable){
+threshold = constrain(threshold, -7, 7);
+SpiWriteReg(CC1101_AGCCTRL1, agc | (threshold & 0x0F));
+SpiWriteReg(CC1101_IOCFG0, 0x0E);
+}else{
+SpiWriteReg(CC1101_AGCCTRL1, agc);
+SpiWriteReg(CC1101_IOCFG0, ccmode ? 0x06 : 0x0D);
+}
+}
+/****************************************************************
 *FUNCTION NAME:Modulation
 *FUNCTION     :set CC1101 Modulation 
 *INPUT        :none
@@ -553,7 +538,7 @@ SpiWriteReg(CC1101_FSCTRL0, map(MHz, 300, 348, clb1[0], clb1[1]));
 if (MHz < 322.88){SpiWriteReg(CC1101_TEST0,0x0B);}
 else{
 SpiWriteReg(CC1101_TEST0,0x09);
-int s = ELECHOUSE_cc1101.SpiReadStatus(CC1101_FSCAL2);
+int s = SpiReadStatus(CC1101_FSCAL2);
 if (s<32){SpiWriteReg(CC1101_FSCAL2, s+32);}
 if (last_pa != 1){setPA(pa);}
 }
@@ -563,7 +548,7 @@ SpiWriteReg(CC1101_FSCTRL0, map(MHz, 378, 464, clb2[0], clb2[1]));
 if (MHz < 430.5){SpiWriteReg(CC1101_TEST0,0x0B);}
 else{
 SpiWriteReg(CC1101_TEST0,0x09);
-int s = ELECHOUSE_cc1101.SpiReadStatus(CC1101_FSCAL2);
+int s = SpiReadStatus(CC1101_FSCAL2);
 if (s<32){SpiWriteReg(CC1101_FSCAL2, s+32);}
 if (last_pa != 2){setPA(pa);}
 }
@@ -573,7 +558,7 @@ SpiWriteReg(CC1101_FSCTRL0, map(MHz, 779, 899, clb3[0], clb3[1]));
 if (MHz < 861){SpiWriteReg(CC1101_TEST0,0x0B);}
 else{
 SpiWriteReg(CC1101_TEST0,0x09);
-int s = ELECHOUSE_cc1101.SpiReadStatus(CC1101_FSCAL2);
+int s = SpiReadStatus(CC1101_FSCAL2);
 if (s<32){SpiWriteReg(CC1101_FSCAL2, s+32);}
 if (last_pa != 3){setPA(pa);}
 }
@@ -581,7 +566,7 @@ if (last_pa != 3){setPA(pa);}
 else if (MHz >= 900 && MHz <= 928){
 SpiWriteReg(CC1101_FSCTRL0, map(MHz, 900, 928, clb4[0], clb4[1]));
 SpiWriteReg(CC1101_TEST0,0x09);
-int s = ELECHOUSE_cc1101.SpiReadStatus(CC1101_FSCAL2);
+int s = SpiReadStatus(CC1101_FSCAL2);
 if (s<32){SpiWriteReg(CC1101_FSCAL2, s+32);}
 if (last_pa != 4){setPA(pa);}
 }
@@ -634,6 +619,35 @@ byte ELECHOUSE_CC1101::getMode(void){
 return trxstate;
 }
 /****************************************************************
+*FUNCTION NAME:getMHZ
+*FUNCTION     :Return the frequency last set on this module.
+*INPUT        :none
+*OUTPUT       :frequency in MHz
+****************************************************************/
+float ELECHOUSE_CC1101::getMHZ(void){
+return MHz;
+}
+/****************************************************************
+*FUNCTION NAME:getPA
+*FUNCTION     :Return the output power last set on this module.
+*INPUT        :none
+*OUTPUT       :power in dBm
+****************************************************************/
+int ELECHOUSE_CC1101::getPA(void){
+return pa;
+}
+/****************************************************************
+*FUNCTION NAME:getShadowReg
+*FUNCTION     :Return a configuration register from the shadow copy
+*              without an SPI transaction.
+*INPUT        :addr: register address
+*OUTPUT       :register value
+****************************************************************/
+byte ELECHOUSE_CC1101::getShadowReg(byte addr){
+if (addr >= CC1101_CONFIG_SIZE){return 0;}
+return regs[addr];
+}
+/****************************************************************
 *FUNCTION NAME:Set Sync_Word
 *FUNCTION     :Sync Word
 *INPUT        :none
@@ -940,7 +954,7 @@ SpiWriteReg(21,c);
 *OUTPUT       :none
 ****************************************************************/
 void ELECHOUSE_CC1101::Split_PKTCTRL1(void){
-int calc = SpiReadStatus(7);
+int calc = regs[CC1101_PKTCTRL1];
 pc1PQT = 0;
 pc1CRC_AF = 0;
 pc1APP_ST = 0;
@@ -959,7 +973,7 @@ else {pc1ADRCHK = calc; i=1;}
 *OUTPUT       :none
 ****************************************************************/
 void ELECHOUSE_CC1101::Split_PKTCTRL0(void){
-int calc = SpiReadStatus(8);
+int calc = regs[CC1101_PKTCTRL0];
 pc0WDATA = 0;
 pc0PktForm = 0;
 pc0CRC_EN = 0;
@@ -978,7 +992,7 @@ else {pc0LenConf = calc; i=1;}
 *OUTPUT       :none
 ****************************************************************/
 void ELECHOUSE_CC1101::Split_MDMCFG1(void){
-int calc = SpiReadStatus(19);
+int calc = regs[CC1101_MDMCFG1];
 m1FEC = 0;
 m1PRE = 0;
 m1CHSP = 0;
@@ -996,7 +1010,7 @@ else {m1CHSP = calc; i=1;}
 *OUTPUT       :none
 ****************************************************************/
 void ELECHOUSE_CC1101::Split_MDMCFG2(void){
-int calc = SpiReadStatus(18);
+int calc = regs[CC1101_MDMCFG2];
 m2DCOFF = 0;
 m2MODFM = 0;
 m2MANCH = 0;
@@ -1015,7 +1029,7 @@ else{m2SYNCM = calc; i=1;}
 *OUTPUT       :none
 ****************************************************************/
 void ELECHOUSE_CC1101::Split_MDMCFG4(void){
-int calc = SpiReadStatus(16);
+int calc = regs[CC1101_MDMCFG4];
 m4RxBw = 0;
 m4DaRa = 0;
 for (bool i = 0; i==0;){
@@ -1170,6 +1184,45 @@ void ELECHOUSE_CC1101::goSleep(void){
   SpiStrobe(0x39);//Enter power down mode when CSn goes high.
 }
 /****************************************************************
+*FUNCTION NAME:setWorTimer
+*FUNCTION     :Wake-on-Radio timing. The RC oscillator is powered and
+*              calibrated; EVENT0 = 750 / f_xosc * event0 * 2^(5 * res),
+*              EVENT1 (XOSC start-up before RX) = 4..48 RC periods
+*INPUT        :event0: WOREVT1:WOREVT0; event1: 0..7; res: WOR_RES 0..3
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setWorTimer(uint16_t event0, byte event1, byte res){
+SpiWriteReg(CC1101_WOREVT1, event0 >> 8);
+SpiWriteReg(CC1101_WOREVT0, event0 & 0xFF);
+SpiWriteReg(CC1101_WORCTRL, ((event1 & 0x07) << 4) | 0x08 | (res & 0x03));
+}
+/****************************************************************
+*FUNCTION NAME:setRxTimeout
+*FUNCTION     :RX timeout and early termination (MCSM2)
+*INPUT        :rxTime: RX_TIME 0..7, 7 = no timeout; rssi: leave RX
+*              when there is no carrier sense; qual: at the timeout,
+*              stay in RX on sync word or PQI too, not sync word only
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setRxTimeout(byte rxTime, bool rssi, bool qual){
+SpiWriteReg(CC1101_MCSM2, (rssi << 4) | (qual << 3) | (rxTime & 0x07));
+}
+/****************************************************************
+*FUNCTION NAME:SetWor
+*FUNCTION     :start the Wake-on-Radio polling sequence: SLEEP, RX
+*              every EVENT0, back to SLEEP on RX timeout or
+*              termination. Any later strobe wakes the chip up again
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::SetWor(void)
+{
+  SpiStrobe(CC1101_SIDLE);
+  SpiStrobe(CC1101_SWORRST);    //restart the event timer
+  SpiStrobe(CC1101_SWOR);
+  trxstate=2;
+}
+/****************************************************************
 *FUNCTION NAME:Char direct SendData
 *FUNCTION     :use CC1101 send data
 *INPUT        :txBuffer: data array to send; size: number of data to send, no more than 61
@@ -1306,4 +1359,328 @@ byte ELECHOUSE_CC1101::ReceiveData(byte *rxBuffer)
  		return 0;
 	}
 }
-ELECHOUSE_CC1101 ELECHOUSE_cc1101;
\ No newline at end of file
+/****************************************************************
+*FUNCTION NAME:Set FIFO_THR
+*FUNCTION     :RX FIFO threshold 4*(v+1) bytes, TX FIFO 65-4*(v+1)
+*INPUT        :v: 0..15
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setFifoThreshold(byte v){
+if (v>15){v=15;}
+SpiWriteReg(CC1101_FIFOTHR, (regs[CC1101_FIFOTHR] & 0xF0) | v);
+}
+/****************************************************************
+*FUNCTION NAME:getRxBytes
+*FUNCTION     :RXBYTES, read until two reads agree (errata: the
+*              status registers can be wrong while they change)
+*INPUT        :none
+*OUTPUT       :bytes in the RX FIFO, bit 7 set on overflow
+****************************************************************/
+byte ELECHOUSE_CC1101::getRxBytes(void)
+{
+  byte last, rx = SpiReadStatus(CC1101_RXBYTES);
+  do{
+    last = rx;
+    rx = SpiReadStatus(CC1101_RXBYTES);
+  }while(rx != last);
+  return rx;
+}
+/****************************************************************
+*FUNCTION NAME:BeginPacketRx
+*FUNCTION     :receive packets into buffer in chunks, see
+*              ServicePacketRx(). The module stays in RX between
+*              packets and appends RSSI/LQI to each one.
+*INPUT        :buffer, size: payload buffer; length: fixed packet
+*              length (above 255 uses infinite mode), 0 for a length
+*              byte at the start of the packet
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::BeginPacketRx(byte *buffer, uint16_t size, uint16_t length)
+{
+  if (length > size){length = size;}
+  pktBuf = buffer;
+  pktSize = size;
+  pktFixed = length;
+  setPktFormat(0);
+  setAppendStatus(1);
+  // RXOFF_MODE = RX: the next packet is heard while this one is read
+  SpiWriteReg(CC1101_MCSM1, (regs[CC1101_MCSM1] & 0xF3) | 0x0C);
+  if (length == 0){
+    setPacketLength(size > 255 ? 255 : size);
+  }else{
+    setPacketLength(length & 0xFF);
+  }
+  RestartPacketRx();
+}
+/****************************************************************
+*FUNCTION NAME:RestartPacketRx
+*FUNCTION     :flush the RX FIFO and wait for the next sync word
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::RestartPacketRx(void)
+{
+  SpiStrobe(CC1101_SIDLE);
+  SpiStrobe(CC1101_SFRX);
+  setLengthConfig(pktFixed == 0 ? 1 : pktFixed > 255 ? 2 : 0);
+  pktInfinite = pktFixed > 255;
+  pktHaveLen = pktFixed != 0;
+  pktLen = pktFixed;
+  pktGot = 0;
+  SpiStrobe(CC1101_SRX);
+  trxstate=2;
+}
+/****************************************************************
+*FUNCTION NAME:ServicePacketRx
+*FUNCTION     :burst read what the RX FIFO holds into the packet
+*              buffer. Call on the FIFO threshold and end of packet
+*              GDO signals, and again until it returns
+*              CC1101_RX_PENDING. While a packet is still arriving
+*              the last byte stays in the FIFO (errata: emptying the
+*              FIFO during reception can duplicate a byte).
+*INPUT        :status: filled in when a packet is complete
+*OUTPUT       :payload length of a complete packet, CC1101_RX_PENDING
+*              or an error (the module is restarted)
+****************************************************************/
+int ELECHOUSE_CC1101::ServicePacketRx(CC1101PacketStatus &status)
+{
+  byte rx = getRxBytes();
+  if (rx & 0x80){
+    RestartPacketRx();
+    return CC1101_RX_OVERFLOW;
+  }
+  byte avail = rx & BYTES_IN_RXFIFO;
+
+  if (!pktHaveLen){
+    if (avail < 2){return CC1101_RX_PENDING;}
+    pktLen = SpiReadReg(CC1101_RXFIFO);
+    avail--;
+    if (pktLen > pktSize){
+      RestartPacketRx();
+      return CC1101_RX_TOO_LONG;
+    }
+    pktHaveLen = true;
+  }
+
+  // Payload and the two status bytes still to come
+  uint16_t remaining = pktLen - pktGot + 2;
+  byte n = avail;
+  if (n < remaining){
+    if (n > 0){n--;}
+  }else{
+    n = remaining;  // the rest belongs to the next packet
+  }
+  byte payload = pktLen - pktGot < n ? pktLen - pktGot : n;
+  if (payload > 0){
+    SpiReadBurstReg(CC1101_RXFIFO, pktBuf + pktGot, payload);
+    pktGot += payload;
+    avail -= payload;
+    n -= payload;
+  }
+
+  // Infinite mode until fewer than 256 bytes are left on air, then
+  // fixed mode ends the packet at PKTLEN = length mod 256
+  if (pktInfinite && pktLen - (pktGot + avail) < 256){
+    setLengthConfig(0);
+    pktInfinite = false;
+  }
+
+  if (n < 2){return CC1101_RX_PENDING;}
+  byte st[2];
+  SpiReadBurstReg(CC1101_RXFIFO, st, 2);
+  status.rssi = st[0] >= 128 ? (st[0] - 256) / 2 - 74 : st[0] / 2 - 74;
+  status.lqi = st[1] & 0x7F;
+  status.crcOk = bitRead(st[1], 7);
+  int length = pktLen;
+
+  // Ready for the next packet, the module is already back in RX
+  if (pktFixed > 255){setLengthConfig(2);}
+  pktInfinite = pktFixed > 255;
+  pktHaveLen = pktFixed != 0;
+  pktLen = pktFixed;
+  pktGot = 0;
+  return length;
+}
+/****************************************************************
+*FUNCTION NAME:EndPacketRx
+*FUNCTION     :leave chunked packet reception, module idle
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::EndPacketRx(void)
+{
+  SpiStrobe(CC1101_SIDLE);
+  SpiStrobe(CC1101_SFRX);
+  SpiWriteReg(CC1101_MCSM1, regs[CC1101_MCSM1] & 0xF3);
+  pktBuf = NULL;
+  trxstate=0;
+}
+/****************************************************************
+*FUNCTION NAME:getTxBytes
+*FUNCTION     :TXBYTES, read until two reads agree
+*INPUT        :none
+*OUTPUT       :bytes in the TX FIFO, bit 7 set on underflow
+****************************************************************/
+byte ELECHOUSE_CC1101::getTxBytes(void)
+{
+  byte last, tx = SpiReadStatus(CC1101_TXBYTES);
+  do{
+    last = tx;
+    tx = SpiReadStatus(CC1101_TXBYTES);
+  }while(tx != last);
+  return tx;
+}
+/****************************************************************
+*FUNCTION NAME:BeginPacketTx
+*FUNCTION     :send data as one packet of any length: the TX FIFO
+*              is filled and the transmission started, then
+*              ServicePacketTx() refills it. data must stay valid
+*              until the packet is done.
+*INPUT        :data, size: payload; lengthByte: variable length
+*              packet (size up to 255), else fixed length, in
+*              infinite mode above 255 bytes
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::BeginPacketTx(byte *data, uint16_t size, bool lengthByte)
+{
+  if (size > 255){lengthByte = 0;}
+  txBuf = data;
+  txSize = size;
+  txPos = 0;
+  txInfinite = size > 255;
+  SpiStrobe(CC1101_SIDLE);
+  SpiStrobe(CC1101_SFTX);
+  setPktFormat(0);
+  setLengthConfig(lengthByte ? 1 : txInfinite ? 2 : 0);
+  setPacketLength(lengthByte ? 255 : size & 0xFF);
+  if (lengthByte){SpiWriteReg(CC1101_TXFIFO, size);}
+  byte n = lengthByte ? CC1101_FIFO_SIZE - 1 : CC1101_FIFO_SIZE;
+  if (n > size){n = size;}
+  SpiWriteBurstReg(CC1101_TXFIFO, txBuf, n);
+  txPos = n;
+  SpiStrobe(CC1101_STX);
+  trxstate=1;
+}
+/****************************************************************
+*FUNCTION NAME:ServicePacketTx
+*FUNCTION     :top up the TX FIFO. Call when the FIFO drains
+*              below its threshold and at the end of the packet.
+*INPUT        :none
+*OUTPUT       :CC1101_TX_PENDING, CC1101_TX_DONE or
+*              CC1101_TX_UNDERFLOW (FIFO flushed, module idle)
+****************************************************************/
+int ELECHOUSE_CC1101::ServicePacketTx(void)
+{
+  if (txBuf == NULL){return CC1101_TX_DONE;}
+  byte tx = getTxBytes();
+  if (tx & 0x80){
+    SpiStrobe(CC1101_SIDLE);
+    SpiStrobe(CC1101_SFTX);
+    txBuf = NULL;
+    trxstate=0;
+    return CC1101_TX_UNDERFLOW;
+  }
+  byte queued = tx & 0x7F;
+
+  // Same as RX: fixed mode once fewer than 256 bytes are left on air
+  if (txInfinite && txSize - (txPos - queued) < 256){
+    setLengthConfig(0);
+    txInfinite = false;
+  }
+
+  uint16_t left = txSize - txPos;
+  if (left > 0){
+    byte n = CC1101_FIFO_SIZE - queued;
+    if (n > left){n = left;}
+    if (n > 0){
+      SpiWriteBurstReg(CC1101_TXFIFO, txBuf + txPos, n);
+      txPos += n;
+    }
+    return CC1101_TX_PENDING;
+  }
+  if (queued > 0){return CC1101_TX_PENDING;}
+  // TX_END until the CRC is out, then TXOFF_MODE
+  byte marc = SpiReadStatus(CC1101_MARCSTATE) & 0x1F;
+  if (marc == 0x13 || marc == 0x14){return CC1101_TX_PENDING;}
+  txBuf = NULL;
+  return CC1101_TX_DONE;
+}
+/****************************************************************
+*FUNCTION NAME:EndPacketTx
+*FUNCTION     :abort or finish a streamed packet, module idle
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::EndPacketTx(void)
+{
+  SpiStrobe(CC1101_SIDLE);
+  SpiStrobe(CC1101_SFTX);
+  txBuf = NULL;
+  trxstate=0;
+}
+/****************************************************************
+*FUNCTION NAME:getPreset
+*FUNCTION     :burst read the whole configuration register file
+*INPUT        :preset: buffer of CC1101_CONFIG_SIZE bytes
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::getPreset(byte *preset)
+{
+  SpiReadBurstReg(CC1101_IOCFG2, preset, CC1101_CONFIG_SIZE);
+  memcpy(regs, preset, CC1101_CONFIG_SIZE);
+}
+/****************************************************************
+*FUNCTION NAME:setPreset
+*FUNCTION     :burst write a configuration saved with getPreset
+*INPUT        :preset: buffer of CC1101_CONFIG_SIZE bytes
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setPreset(byte *preset)
+{
+  SpiStrobe(CC1101_SIDLE);
+  SpiWriteBurstReg(CC1101_IOCFG2, preset, CC1101_CONFIG_SIZE);
+  unsigned long f = ((unsigned long)regs[CC1101_FREQ2] << 16) |
+                    ((unsigned long)regs[CC1101_FREQ1] << 8) | regs[CC1101_FREQ0];
+  MHz = f * (26.0 / 65536.0);
+  switch ((regs[CC1101_MDMCFG2] >> 4) & 0x07)
+  {
+  case 1: modulation = 1; break; // GFSK
+  case 3: modulation = 2; break; // ASK
+  case 4: modulation = 3; break; // 4-FSK
+  case 7: modulation = 4; break; // MSK
+  default: modulation = 0; break; // 2-FSK
+  }
+  m4RxBw = regs[CC1101_MDMCFG4] & 0xF0;
+  trxstate = 0;
+}
+/****************************************************************
+*FUNCTION NAME:calibrateFreq
+*FUNCTION     :tune to a frequency word, run a manual calibration and
+*              return the FSCAL3..FSCAL1 result for setFreqCal
+*INPUT        :freq: FREQ2..FREQ0; fscal: 3 byte result buffer
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::calibrateFreq(byte *freq, byte *fscal)
+{
+  SpiStrobe(CC1101_SIDLE);
+  SpiWriteBurstReg(CC1101_FREQ2, freq, 3);
+  SpiStrobe(CC1101_SCAL);
+  unsigned long start = micros();
+  while ((SpiReadStatus(CC1101_MARCSTATE) & 0x1F) != 0x01) {
+    if (micros() - start > 2000) break;
+  }
+  SpiReadBurstReg(CC1101_FSCAL3, fscal, 3);
+}
+/****************************************************************
+*FUNCTION NAME:setFreqCal
+*FUNCTION     :fast retune from a cached calibration, no SCAL needed.
+*              Requires MCSM0.FS_AUTOCAL = 0 to skip the calibration
+*              on the next IDLE -> RX/TX transition.
+*INPUT        :freq: FREQ2..FREQ0; fscal: FSCAL3..FSCAL1
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101::setFreqCal(byte *freq, byte *fscal)
+{
+  SpiWriteBurstReg(CC1101_FREQ2, freq, 3);
+  SpiWriteBurstReg(CC1101_FSCAL3, fscal, 3);
+}
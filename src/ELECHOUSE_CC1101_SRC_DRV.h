@@ -110,12 +110,39 @@ cc1101 Driver for RC Switch. Mod by Little Satan. With permission to modify and
 #define CC1101_TXFIFO       0x3F
 #define CC1101_RXFIFO       0x3F
 
+//CC1101 configuration register file size (IOCFG2 .. TEST0)
+#define CC1101_CONFIG_SIZE  0x2F
+
+//Chunked packet reception (BeginPacketRx / ServicePacketRx)
+#define CC1101_FIFO_SIZE      64
+#define CC1101_RX_PENDING     0         // packet not complete yet
+#define CC1101_RX_OVERFLOW    -1        // RX FIFO overflowed, restarted
+#define CC1101_RX_TOO_LONG    -2        // length byte above the buffer size
+
+//Streaming packet transmission (BeginPacketTx / ServicePacketTx)
+#define CC1101_TX_PENDING     0         // bytes left to send
+#define CC1101_TX_DONE        1         // packet on air completely
+#define CC1101_TX_UNDERFLOW   -1        // TX FIFO ran empty, module idle
+
+struct CC1101PacketStatus {
+  int rssi;                             // dBm, from the appended status
+  byte lqi;
+  bool crcOk;
+};
+
 //************************************* class **************************************************//
+// One object per CC1101 module. Every object keeps its own pins, radio
+// state and a shadow of the configuration registers, so several modules
+// on the shared SPI bus can be driven without re-initialising each other.
 class ELECHOUSE_CC1101
 {
 private:
   void SpiStart(void);
   void SpiEnd(void);
+  void SpiMasks(void);
+  inline void csLow(void);
+  inline void csHigh(void);
+  inline bool misoHigh(void);
   void GDO_Set (void);
   void GDO0_Set (void);
   void Reset (void);
@@ -127,17 +154,74 @@ private:
   void Split_MDMCFG1(void);
   void Split_MDMCFG2(void);
   void Split_MDMCFG4(void);
+
+  byte SCK_PIN = 0;
+  byte MISO_PIN = 0;
+  byte MOSI_PIN = 0;
+  byte SS_PIN = 0;
+  byte GDO0 = 0;
+  byte GDO2 = 0;
+#ifdef CC1101_FAST_GPIO
+  // CS and MISO as GPIO register addresses and bit masks, see SpiMasks()
+  volatile uint32_t *ssSet = NULL;
+  volatile uint32_t *ssClear = NULL;
+  volatile uint32_t *misoIn = NULL;
+  uint32_t ssMask = 0;
+  uint32_t misoMask = 0;
+#endif
+  bool spi = 0;
+  bool ccmode = 0;
+  byte modulation = 2;
+  byte frend0 = 0;
+  byte chan = 0;
+  int pa = 12;
+  byte last_pa = 0;
+  float MHz = 433.92;
+  byte m4RxBw = 0;
+  byte m4DaRa = 0;
+  byte m2DCOFF = 0;
+  byte m2MODFM = 0;
+  byte m2MANCH = 0;
+  byte m2SYNCM = 0;
+  byte m1FEC = 0;
+  byte m1PRE = 0;
+  byte m1CHSP = 0;
+  byte pc1PQT = 0;
+  byte pc1CRC_AF = 0;
+  byte pc1APP_ST = 0;
+  byte pc1ADRCHK = 0;
+  byte pc0WDATA = 0;
+  byte pc0PktForm = 0;
+  byte pc0CRC_EN = 0;
+  byte pc0LenConf = 0;
+  byte trxstate = 0;
+  byte clb1[2] = {24,28};
+  byte clb2[2] = {31,38};
+  byte clb3[2] = {65,76};
+  byte clb4[2] = {77,79};
+  byte PA_TABLE[8] = {0x00,0xC0,0x00,0x00,0x00,0x00,0x00,0x00};
+  byte regs[CC1101_CONFIG_SIZE];  // shadow of the configuration registers
+  void RestartPacketRx(void);
+  byte *pktBuf = NULL;            // packet being received
+  uint16_t pktSize = 0;
+  uint16_t pktFixed = 0;          // configured length, 0: length byte
+  uint16_t pktLen = 0;
+  uint16_t pktGot = 0;
+  bool pktHaveLen = false;
+  bool pktInfinite = false;       // longer than 255, still in infinite mode
+  byte *txBuf = NULL;             // packet being sent
+  uint16_t txSize = 0;
+  uint16_t txPos = 0;
+  bool txInfinite = false;
 public:
+  ELECHOUSE_CC1101(void);
   void Init(void);
   byte SpiReadStatus(byte addr);
   void setSpiPin(byte sck, byte miso, byte mosi, byte ss);
-  void addSpiPin(byte sck, byte miso, byte mosi, byte ss, byte modul);
   void setGDO(byte gdo0, byte gdo2);
   void setGDO0(byte gdo0);
-  void addGDO(byte gdo0, byte gdo2, byte modul);
-  void addGDO0(byte gdo0, byte modul);
-  void setModul(byte modul);
   void setCCMode(bool s);
+  void setCarrierSense(bool enable, int8_t threshold);
   void setModulation(byte m);
   void setPA(int p);
   void setMHZ(float mhz);
@@ -155,6 +239,9 @@ public:
   void setSres(void);
   void setSidle(void);
   void goSleep(void);
+  void setWorTimer(uint16_t event0, byte event1, byte res);
+  void setRxTimeout(byte rxTime, bool rssi, bool qual);
+  void SetWor(void);
   void SendData(byte *txBuffer, byte size);
   void SendData(char *txchar);
   void SendData(byte *txBuffer, byte size, int t);
@@ -170,6 +257,9 @@ public:
   void setClb(byte b, byte s, byte e);
   bool getCC1101(void);
   byte getMode(void);
+  float getMHZ(void);
+  int getPA(void);
+  byte getShadowReg(byte addr);
   void setSyncWord(byte sh, byte sl);
   void setAddr(byte v);
   void setWhiteData(bool v);
@@ -187,8 +277,19 @@ public:
   void setAppendStatus(bool v);
   void setAdrChk(byte v);
   bool CheckRxFifo(int t);
+  void setFifoThreshold(byte v);
+  byte getRxBytes(void);
+  void BeginPacketRx(byte *buffer, uint16_t size, uint16_t length);
+  int ServicePacketRx(CC1101PacketStatus &status);
+  void EndPacketRx(void);
+  byte getTxBytes(void);
+  void BeginPacketTx(byte *data, uint16_t size, bool lengthByte);
+  int ServicePacketTx(void);
+  void EndPacketTx(void);
+  void getPreset(byte *preset);
+  void setPreset(byte *preset);
+  void calibrateFreq(byte *freq, byte *fscal);
+  void setFreqCal(byte *freq, byte *fscal);
 };
 
-extern ELECHOUSE_CC1101 ELECHOUSE_cc1101;
-
 #endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+#ifndef BOARD_h
+#define BOARD_h
+
+#include <Arduino.h>
+#include <esp_attr.h>
+#include <soc/gpio_struct.h>
+
+// ==========================================
+// BOARD PROFILE
+// ==========================================
+// The pinout as compile-time constants instead of mutable globals, so the
+// hot paths can take a pin as a template argument and FastPin<> turns a
+// CS toggle, a TX edge or a GDO read into one GPIO register access.
+//
+// Another pinout is a struct with the same members, selected with
+// -D BOARD_PROFILE=<name> in platformio.ini. Module 0 is the first CC1101
+// ("module 1" in the web UI).
+
+struct EvilCrowRfV2 {
+  // CC1101 modules on HSPI
+  static constexpr byte SCK = 14;
+  static constexpr byte MISO = 12;
+  static constexpr byte MOSI = 13;
+  static constexpr byte cs(byte m) { return m ? 27 : 5; }
+  // TX data input, carrier sense
+  static constexpr byte gdo0(byte m) { return m ? 25 : 2; }
+  // RX data output
+  static constexpr byte gdo2(byte m) { return m ? 26 : 4; }
+
+  // MicroSD slot on VSPI
+  static constexpr byte SD_SCLK = 18;
+  static constexpr byte SD_MISO = 19;
+  static constexpr byte SD_MOSI = 23;
+  static constexpr byte SD_SS = 22;
+};
+
+#ifndef BOARD_PROFILE
+#define BOARD_PROFILE EvilCrowRfV2
+#endif
+typedef BOARD_PROFILE Board;
+
+// GPIO34..39 are inputs only
+static_assert(Board::cs(0) < 34 && Board::cs(1) < 34, "CS must be an output");
+static_assert(Board::gdo0(0) < 34 && Board::gdo0(1) < 34,
+              "GDO0 must be an output");
+static_assert(Board::gdo2(0) < 40 && Board::gdo2(1) < 40 &&
+                  Board::MISO < 40,
+              "no such GPIO");
+
+// ==========================================
+// DIRECT GPIO ACCESS
+// ==========================================
+// One pin, known at compile time: high() and low() are a single store to
+// the W1TS/W1TC register of its bank, read() a single load. The pin must
+// already be configured with pinMode().
+template <byte P> struct FastPin {
+  static_assert(P < 40, "no such GPIO");
+  static constexpr uint32_t mask = 1UL << (P & 31);
+
+  FORCE_INLINE_ATTR void high(void) {
+    if (P < 32)
+      GPIO.out_w1ts = mask;
+    else
+      GPIO.out1_w1ts.val = mask;
+  }
+  FORCE_INLINE_ATTR void low(void) {
+    if (P < 32)
+      GPIO.out_w1tc = mask;
+    else
+      GPIO.out1_w1tc.val = mask;
+  }
+  FORCE_INLINE_ATTR bool read(void) {
+    return ((P < 32 ? GPIO.in : GPIO.in1.val) & mask) != 0;
+  }
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "config_store.h"
+#include "metrics.h"
+#include <LittleFS.h>
+
+ConfigData settings;
+
+static SemaphoreHandle_t lock = NULL;
+
+// Bitwise CRC-32 (IEEE 802.3); the record is written a few times per session
+static uint32_t crc32(const uint8_t *data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+void configBegin(void) {
+  if (lock == NULL)
+    lock = xSemaphoreCreateMutex();
+}
+
+void configDefaults(ConfigData &data) {
+  memset(&data, 0, sizeof(data));
+  strlcpy(data.ssid, CONFIG_DEFAULT_SSID, sizeof(data.ssid));
+  strlcpy(data.pass, CONFIG_DEFAULT_PASS, sizeof(data.pass));
+  data.wifiMode = CONFIG_WIFI_AP;
+  data.logFlags = CONFIG_LOG_RAW | CONFIG_LOG_ANALYSIS;
+}
+
+bool configLoad(ConfigData &data) {
+  struct {
+    ConfigHeader header;
+    ConfigData data;
+  } record;
+  size_t got = 0;
+
+  // Defaults first: an older record only covers the start of ConfigData
+  configDefaults(record.data);
+  File file = LittleFS.open(CONFIG_PATH, FILE_READ);
+  if (file) {
+    got = file.read((uint8_t *)&record, sizeof(record));
+    file.close();
+  }
+
+  ConfigHeader &h = record.header;
+  if (got < sizeof(h) || h.magic != CONFIG_MAGIC || h.version == 0 ||
+      h.version > CONFIG_VERSION || h.size > sizeof(ConfigData) ||
+      got - sizeof(h) != h.size ||
+      h.crc != crc32((const uint8_t *)&record.data, h.size)) {
+    configDefaults(data);
+    return false;
+  }
+
+  data = record.data;
+  // Never trust the terminators of a record from flash
+  data.ssid[sizeof(data.ssid) - 1] = 0;
+  data.pass[sizeof(data.pass) - 1] = 0;
+  data.rxModule &= 1;
+  for (uint8_t i = 0; i < 2; i++)
+    worNormalize(data.wor[i]);
+  return true;
+}
+
+bool configSave(const ConfigData &data) {
+  ConfigHeader header = {CONFIG_MAGIC, CONFIG_VERSION, sizeof(ConfigData),
+                         crc32((const uint8_t *)&data, sizeof(ConfigData))};
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  bool ok = false;
+  File file = LittleFS.open(CONFIG_TMP_PATH, FILE_WRITE);
+  if (file) {
+    ok = file.write((const uint8_t *)&header, sizeof(header)) ==
+             sizeof(header) &&
+         file.write((const uint8_t *)&data, sizeof(data)) == sizeof(data);
+    file.close();
+    ok = ok && LittleFS.rename(CONFIG_TMP_PATH, CONFIG_PATH);
+  }
+  xSemaphoreGive(lock);
+
+  metricsFlashChanged();
+  return ok;
+}
@@ -0,0 +1,70 @@
+#ifndef CONFIG_STORE_h
+#define CONFIG_STORE_h
+
+#include <Arduino.h>
+#include "radio_service.h"
+#include "wor_listen.h"
+
+// ==========================================
+// CONFIG STORE
+// ==========================================
+// All persistent settings in one record on LittleFS: Wi-Fi, the last RX
+// preset of each module and the logging options. It is read in one go at
+// boot and rewritten as a whole into CONFIG_TMP_PATH, which is then
+// renamed over CONFIG_PATH, so a power loss leaves either the old or the
+// new record. A record with a bad magic, version, size or CRC is ignored.
+//
+// File layout: ConfigHeader followed by ConfigData, little-endian. Fields
+// are only ever appended to ConfigData, with a CONFIG_VERSION bump; an
+// older, shorter record is read over the defaults, so the fields it lacks
+// keep their default values.
+
+#define CONFIG_PATH "/config.bin"
+#define CONFIG_TMP_PATH "/config.tmp"
+#define CONFIG_MAGIC 0x47464345UL // "ECFG"
+#define CONFIG_VERSION 3
+
+#define CONFIG_DEFAULT_SSID "Evil Crow RF v2"
+#define CONFIG_DEFAULT_PASS "123456789ECRFv2"
+
+enum ConfigWifiMode : uint8_t { CONFIG_WIFI_AP, CONFIG_WIFI_STA };
+
+#define CONFIG_LOG_RAW 0x01      // pulse timings of each burst
+#define CONFIG_LOG_ANALYSIS 0x02 // analyser output of each burst
+#define CONFIG_LOG_EXPAND 0x04   // every repeated frame, not one per run
+#define CONFIG_LOG_SUB 0x08      // each burst as a .sub file
+
+struct ConfigHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size; // sizeof(ConfigData)
+  uint32_t crc;  // CRC-32 of the ConfigData bytes
+};
+
+struct ConfigData {
+  char ssid[33];
+  char pass[65];
+  uint8_t wifiMode; // ConfigWifiMode
+  uint8_t logFlags; // CONFIG_LOG_*
+  uint8_t rxModule; // module of the last /setrx
+  uint8_t rxResume; // receiving on rxModule when saved
+  uint8_t rxValid;  // bit n set: rx[n] holds a preset
+  RadioRxParams rx[2];
+  // Version 2
+  uint8_t csGate;        // bit n set: module n captures under carrier only
+  int8_t csThreshold[2]; // carrier sense threshold, dB, -7..7
+  // Version 3
+  WorParams wor[2]; // Wake-on-Radio listening, interval 0: off
+};
+
+extern ConfigData settings;
+
+// Once in setup(), before any task can save
+void configBegin(void);
+void configDefaults(ConfigData &data);
+// Fills data from CONFIG_PATH, or with defaults when there is no valid
+// record. Returns whether a record was read.
+bool configLoad(ConfigData &data);
+bool configSave(const ConfigData &data);
+
+#endif
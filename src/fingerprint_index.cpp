@@ -0,0 +1,165 @@
+#include "fingerprint_index.h"
+#include "metrics.h"
+#include "sub_export.h"
+#include <vector>
+
+struct IndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;
+};
+
+static fs::FS *libraryFs = NULL;
+static fs::FS *indexFs = NULL;
+static volatile bool building = false;
+static volatile int entries = -1;
+
+// ==========================================
+// BUILD
+// ==========================================
+struct IndexBuild {
+  File out;
+  SubParser parser;
+  char chunk[256];
+  uint16_t count;
+};
+
+static void addFile(IndexBuild &b, File &file) {
+  const char *path = file.path();
+  size_t len = strlen(path);
+  if (len >= FP_PATH_MAX || len < 4 || strcmp(path + len - 4, ".sub") != 0)
+    return;
+  b.parser.begin();
+  int n;
+  while ((n = file.read((uint8_t *)b.chunk, sizeof(b.chunk))) > 0)
+    b.parser.feed(b.chunk, n);
+  Fingerprint fp;
+  if (!b.parser.finish(fp))
+    return;
+  uint8_t l = len;
+  b.out.write((const uint8_t *)&fp, sizeof(fp));
+  b.out.write(&l, 1);
+  b.out.write((const uint8_t *)path, len);
+  b.count++;
+}
+
+// One directory at a time, so only it and one of its files are open on
+// the card whatever the depth (the SD driver allows 5 open files).
+// Subdirectories are queued by path and opened after their parent closed.
+static void addTree(IndexBuild &b, const char *root) {
+  std::vector<String> pending;
+  pending.push_back(root);
+  while (!pending.empty() && b.count < 0xFFFF) {
+    File dir = libraryFs->open(pending.back());
+    pending.pop_back();
+    if (!dir)
+      continue;
+    for (File f = dir.openNextFile(); f && b.count < 0xFFFF;
+         f = dir.openNextFile()) {
+      if (!f.isDirectory())
+        addFile(b, f);
+      else if (strcmp(f.path(), SUB_EXPORT_DIR) != 0)
+        pending.push_back(f.path());
+      f.close();
+    }
+    dir.close();
+  }
+}
+
+static void indexTask(void *arg) {
+  unsigned long start = millis();
+  IndexBuild *b = new IndexBuild();
+  b->count = 0;
+  b->out = indexFs->open(FP_INDEX_TMP_PATH, FILE_WRITE);
+  if (b->out && libraryFs->exists(FP_INDEX_ROOT)) {
+    IndexHeader h = {FP_INDEX_MAGIC, FP_INDEX_VERSION, 0};
+    b->out.write((const uint8_t *)&h, sizeof(h));
+    addTree(*b, FP_INDEX_ROOT);
+    h.count = b->count;
+    b->out.seek(0);
+    b->out.write((const uint8_t *)&h, sizeof(h));
+    b->out.close();
+    indexFs->remove(FP_INDEX_PATH);
+    if (indexFs->rename(FP_INDEX_TMP_PATH, FP_INDEX_PATH))
+      entries = b->count;
+    metricsFlashChanged();
+    Serial.printf("Fingerprint index: %u files in %lu ms\n", b->count,
+                  millis() - start);
+  } else if (b->out) {
+    b->out.close();
+    indexFs->remove(FP_INDEX_TMP_PATH);
+  }
+  delete b;
+  building = false;
+  vTaskDelete(NULL);
+}
+
+// ==========================================
+// PUBLIC API
+// ==========================================
+void fingerprintIndexBegin(fs::FS &lib, fs::FS &idx) {
+  libraryFs = &lib;
+  indexFs = &idx;
+  File file = indexFs->open(FP_INDEX_PATH, FILE_READ);
+  IndexHeader h;
+  if (file && file.read((uint8_t *)&h, sizeof(h)) == sizeof(h) &&
+      h.magic == FP_INDEX_MAGIC && h.version == FP_INDEX_VERSION)
+    entries = h.count;
+  if (file)
+    file.close();
+}
+
+bool fingerprintIndexStart(void) {
+  if (indexFs == NULL || building)
+    return false;
+  building = true;
+  if (xTaskCreatePinnedToCore(indexTask, "fpindex", FP_INDEX_TASK_STACK, NULL,
+                              FP_INDEX_TASK_PRIORITY, NULL,
+                              FP_INDEX_TASK_CORE) != pdPASS) {
+    building = false;
+    return false;
+  }
+  return true;
+}
+
+bool fingerprintIndexBusy(void) { return building; }
+
+int fingerprintIndexSize(void) { return entries; }
+
+int fingerprintLookup(const Fingerprint &fp, FingerprintMatch *top, int k) {
+  if (indexFs == NULL || k <= 0)
+    return 0;
+  File file = indexFs->open(FP_INDEX_PATH, FILE_READ);
+  if (!file)
+    return 0;
+  IndexHeader h;
+  int found = 0;
+  if (file.read((uint8_t *)&h, sizeof(h)) == sizeof(h) &&
+      h.magic == FP_INDEX_MAGIC && h.version == FP_INDEX_VERSION) {
+    for (uint16_t e = 0; e < h.count; e++) {
+      Fingerprint entry;
+      uint8_t len;
+      char path[FP_PATH_MAX];
+      if (file.read((uint8_t *)&entry, sizeof(entry)) != sizeof(entry) ||
+          file.read(&len, 1) != 1 || len >= FP_PATH_MAX ||
+          file.read((uint8_t *)path, len) != len)
+        break;
+      uint8_t score = fingerprintScore(fp, entry);
+      // Insertion into the sorted top k
+      int at = found < k ? found : k - 1;
+      if (found == k && score <= top[at].score)
+        continue;
+      while (at > 0 && top[at - 1].score < score) {
+        top[at] = top[at - 1];
+        at--;
+      }
+      top[at].score = score;
+      memcpy(top[at].path, path, len);
+      top[at].path[len] = 0;
+      if (found < k)
+        found++;
+    }
+  }
+  file.close();
+  return found;
+}
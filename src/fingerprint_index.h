@@ -0,0 +1,46 @@
+#ifndef FINGERPRINT_INDEX_h
+#define FINGERPRINT_INDEX_h
+
+#include <Arduino.h>
+#include <FS.h>
+#include "SubFingerprint.h"
+
+// ==========================================
+// FINGERPRINT INDEX
+// ==========================================
+// Signatures of every RAW file under /SUBGHZ on the SD card (Key files
+// carry no timings and are skipped, and so is the capture export
+// directory), kept in one file on LittleFS so a lookup never touches the
+// SD bus:
+//   header  u32 magic "FPIX", u16 version, u16 entries
+//   entry   u16 sig[FP_HASHES], u8 path length, path
+// The index is built on a core 0 task, at boot when there is none and on
+// /buildindex, into a temporary file that replaces the old one when done.
+// A lookup reads the file once and keeps the best k scores.
+
+#define FP_INDEX_PATH "/fingerprints.bin"
+#define FP_INDEX_TMP_PATH "/fingerprints.tmp"
+#define FP_INDEX_MAGIC 0x58495046UL // "FPIX"
+#define FP_INDEX_VERSION 1
+#define FP_INDEX_ROOT "/SUBGHZ"
+#define FP_INDEX_TASK_STACK 6144
+#define FP_INDEX_TASK_PRIORITY 1
+#define FP_INDEX_TASK_CORE 0
+#define FP_PATH_MAX 96
+#define FP_TOP 3
+
+struct FingerprintMatch {
+  uint8_t score; // 0..100
+  char path[FP_PATH_MAX];
+};
+
+void fingerprintIndexBegin(fs::FS &library, fs::FS &index);
+// Rebuilds the index in the background; false while a build runs
+bool fingerprintIndexStart(void);
+bool fingerprintIndexBusy(void);
+// Entries in the current index, -1 without one
+int fingerprintIndexSize(void);
+// Best k matches, highest score first. Returns how many were found.
+int fingerprintLookup(const Fingerprint &fp, FingerprintMatch *top, int k);
+
+#endif
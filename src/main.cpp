@@ -1,5 +1,19 @@
 #include "ELECHOUSE_CC1101_SRC_DRV.h"
 #include "SD.h"
+#include "SignalCapture.h"
+#include "board.h"
+#include "config_store.h"
+#include "fingerprint_index.h"
+#include "metrics.h"
+#include "packet_rx.h"
+#include "packet_tx.h"
+#include "pipeline_stats.h"
+#include "radio_service.h"
+#include "rx_hopper.h"
+#include "spectrum.h"
+#include "sub_export.h"
+#include "web_ui.h"
+#include "wor_listen.h"
 #include <Arduino.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
@@ -9,6 +23,9 @@
 #include <WiFi.h>
 #include <WiFiAP.h>
 #include <WiFiClient.h>
+#include <freertos/event_groups.h>
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
 
 // ==========================================
 // FORWARD DECLARATIONS
@@ -23,73 +40,90 @@ void printReceived();
 void signalanalyse();
 // ==========================================
 
-// Default Fallbacks (used if SD card fails)
-String configSSID = "Evil Crow RF v2";
-String configPASS = "123456789ECRFv2";
-String configMODE = "AP";
-
-// MicroSD slot pins
-#define SD_SCLK 18
-#define SD_MISO 19
-#define SD_MOSI 23
-#define SD_SS 22
+// MicroSD slot, pins in board.h
 SPIClass sdspi(VSPI);
 
-// SPI Pins
-int sck_pin = 14;
-int miso_pin = 12;
-int mosi_pin = 13;
-
-// CC1101 Module 1
-int rx_pin1 = 4;
-int tx_pin1 = 2;
-int cs_pin1 = 5;
+// One driver object per module, each with its own state. After setup()
+// they are only touched from the radio service task.
+ELECHOUSE_CC1101 cc1101[2];
+byte rx_module = 0;
 
-// CC1101 Module 2
-int rx_pin2 = 26;
-int tx_pin2 = 25;
-int cs_pin2 = 27;
+// Web handlers wait this long for the radio task to apply a command
+#define RADIO_REPLY_MS 200
 
 // RF variables
 #define RECEIVE_ATTR IRAM_ATTR
-#define samplesize 2000
-int error_toleranz = 200;
-const int minsample = 30;
-unsigned long sample[samplesize];
-unsigned long samplesmooth[samplesize];
-String lastSampleSmooth;
-int lastIndex;
-int samplecount;
-static unsigned long lastTime = 0;
+#define samplesize CAPTURE_SAMPLES
+SignalCapture capture;
+
+// Capture front-end filter at boot (see SignalCapture.h). Real pulses are
+// at least 100 us, so more than 12 edges per ms cannot be a signal.
+#define FILTER_MERGE true
+#define FILTER_MAX_EDGES_PER_MS 12
+#define FILTER_ADAPTIVE 50
+
+// Carrier-sense gating per module, see CARRIER-SENSE GATING
+bool csGate[2] = {false, false};
+int8_t csThreshold[2] = {0, 0};
+WorParams worParams[2] = {}; // interval 0: continuous RX
 int mod;
 float deviation;
 int datarate;
 float frequency;
 float setrxbw;
-int power_jammer;
-byte jammer[] = {0xff, 0xff};
-const size_t jammer_len = sizeof(jammer) / sizeof(jammer[0]);
-long data_to_send[2000];
+
+// Who owns the capture and the RX settings above: the radio task (the
+// interrupts, hopper retunes) until radioCapturePoll() sets burstReported,
+// then loop() until its REARM_RX is executed on the radio task. burstRx
+// is the channel the burst was heard on.
+static volatile bool burstReported = false;
+static SubRxSettings burstRx;
 
 // Other variables
 const bool formatOnFail = true;
-String OutputLog;
 
 // File
 File logs;
 
 // Web Server
-String tmp_module;
-String tmp_frequency;
-String tmp_setrxbw;
-String tmp_mod;
-String tmp_deviation;
-String tmp_datarate;
-String raw_rx = "0";
-String jammer_tx = "0";
-String transmit;
 AsyncWebServer controlserver(80);
 
+// loop() sleeps until the radio task reports a complete burst or a
+// received packet, and wakes at least every LOOP_IDLE_MS
+#define LOOP_IDLE_MS 1000
+static TaskHandle_t loopTask = NULL;
+
+// ==========================================
+// BOOT
+// ==========================================
+// setup() brings up the radios and arms the capture, then leaves the slow
+// parts to two tasks on core 0:
+//   storage  LittleFS and the config (resuming the last RX preset), then
+//            the SD card. The card sits on VSPI, so this runs alongside
+//            the CC1101 init on HSPI
+//   network  once storage is up: web UI overrides, Wi-Fi, web server and
+//            mDNS. A station gets BOOT_STA_TIMEOUT_MS to obtain an address
+//            before the default access point is started instead
+// Every phase is logged on Serial as "[boot] <ms since start> <phase>".
+#define BOOT_STORAGE_READY (1 << 0)
+#define BOOT_STA_GOT_IP (1 << 1)
+#define BOOT_RADIOS_READY (1 << 2)
+#define BOOT_STA_TIMEOUT_MS 15000
+#define BOOT_TASK_STACK 4096
+#define BOOT_TASK_PRIORITY 1
+#define BOOT_TASK_CORE 0
+
+static EventGroupHandle_t bootEvents;
+
+static void bootPhase(const char *phase) {
+  Serial.printf("[boot] %6lu ms  %s\n", millis(), phase);
+}
+
+// Nothing may touch the SD card before this
+static bool storageReady() {
+  return xEventGroupGetBits(bootEvents) & BOOT_STORAGE_READY;
+}
+
 // ==========================================
 // HELPER: Read File Content as String
 // ==========================================
@@ -106,374 +140,666 @@ String readFile(fs::FS &fs, const char *path) {
 }
 
 // ==========================================
-// NEW CONFIG LOAD FUNCTION
+// CONFIG
 // ==========================================
-void loadConfig() {
-  // Try to read settings from /CONFIG/ folder
+// One-time import of the /CONFIG/*.txt files used before config.bin
+static void migrateTextConfig() {
   String s = readFile(SD, "/CONFIG/SSID.txt");
   String p = readFile(SD, "/CONFIG/PASS.txt");
   String m = readFile(SD, "/CONFIG/MODE.txt");
 
   if (s.length() > 0)
-    configSSID = s;
+    strlcpy(settings.ssid, s.c_str(), sizeof(settings.ssid));
   if (p.length() > 0)
-    configPASS = p;
+    strlcpy(settings.pass, p.c_str(), sizeof(settings.pass));
   if (m.length() > 0)
-    configMODE = m;
+    settings.wifiMode = m == "AP" ? CONFIG_WIFI_AP : CONFIG_WIFI_STA;
+  configSave(settings);
 }
 
-void connectToWiFi() {
-  loadConfig(); // Load from SD Card
+// Re-applies the RX preset that was active when the config was saved
+static void resumeReceive() {
+  byte module = settings.rxModule;
+  if (!settings.rxResume || !(settings.rxValid & (1 << module)))
+    return;
 
-  if (configMODE == "AP") {
-    // --- ACCESS POINT MODE ---
-    WiFi.mode(WIFI_AP);
+  xEventGroupWaitBits(bootEvents, BOOT_RADIOS_READY, pdFALSE, pdTRUE,
+                      portMAX_DELAY);
+  csGate[module] = settings.csGate & (1 << module);
+  csThreshold[module] = settings.csThreshold[module];
+  worParams[module] = settings.wor[module];
+  RadioCommand cmd = {};
+  cmd.type = RADIO_CMD_SET_RX;
+  cmd.module = module;
+  cmd.rx = settings.rx[module];
+  frequency = cmd.rx.frequency;
+  setrxbw = cmd.rx.setrxbw;
+  mod = cmd.rx.mod;
+  deviation = cmd.rx.deviation;
+  datarate = cmd.rx.datarate;
+  if (radioSubmit(cmd, RADIO_REPLY_MS) == RADIO_OK)
+    bootPhase("rx resumed");
+}
 
-    // Check if password is valid for WPA2 (min 8 chars)
-    if (configPASS.length() < 8) {
-      WiFi.softAP(configSSID.c_str()); // Open Network
-    } else {
-      WiFi.softAP(configSSID.c_str(), configPASS.c_str());
-    }
+static void startAccessPoint(const char *ssid, const char *pass) {
+  WiFi.mode(WIFI_AP);
 
-    // Force IP to 192.168.4.1
-    IPAddress local_IP(192, 168, 4, 1);
-    IPAddress gateway(192, 168, 4, 1);
-    IPAddress subnet(255, 255, 255, 0);
-    WiFi.softAPConfig(local_IP, gateway, subnet);
+  // Check if password is valid for WPA2 (min 8 chars)
+  if (strlen(pass) < 8) {
+    WiFi.softAP(ssid); // Open Network
+  } else {
+    WiFi.softAP(ssid, pass);
+  }
 
+  // Force IP to 192.168.4.1
+  IPAddress local_IP(192, 168, 4, 1);
+  IPAddress gateway(192, 168, 4, 1);
+  IPAddress subnet(255, 255, 255, 0);
+  WiFi.softAPConfig(local_IP, gateway, subnet);
+}
+
+static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+    xEventGroupSetBits(bootEvents, BOOT_STA_GOT_IP);
+  else
+    xEventGroupClearBits(bootEvents, BOOT_STA_GOT_IP);
+}
+
+// Returns as soon as the interface is started; in STA mode the address
+// arrives later as ARDUINO_EVENT_WIFI_STA_GOT_IP
+void connectToWiFi() {
+  if (settings.wifiMode == CONFIG_WIFI_AP) {
+    // --- ACCESS POINT MODE ---
+    startAccessPoint(settings.ssid, settings.pass);
   } else {
     // --- STATION MODE (Connect to Router/Hotspot) ---
+    WiFi.onEvent(onWiFiEvent, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    WiFi.onEvent(onWiFiEvent, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
     WiFi.mode(WIFI_STA);
-    WiFi.begin(configSSID.c_str(), configPASS.c_str());
-
-    unsigned long start = millis();
-    while (WiFi.status() != WL_CONNECTED) {
-      delay(500);
-      if (millis() - start > 15000)
-        break; // Timeout
-    }
+    WiFi.begin(settings.ssid, settings.pass);
   }
 }
 
+// ==========================================
+// STATS
+// ==========================================
+// Sampled once per second by the metrics task, never on a request
+void metricsApp(MetricsApp &app) {
+  // From the interface, which differs from the config after a fallback
+  bool ap = WiFi.getMode() == WIFI_AP;
+  strlcpy(app.mode, ap ? "AP" : "STA", sizeof(app.mode));
+  strlcpy(app.ssid, (ap ? WiFi.softAPSSID() : WiFi.SSID()).c_str(),
+          sizeof(app.ssid));
+  strlcpy(app.ip,
+          (ap ? WiFi.softAPIP().toString() : WiFi.localIP().toString()).c_str(),
+          sizeof(app.ip));
+  app.rxActive = radiostate.any(RADIO_MODE_RX_ASYNC) ||
+                 radiostate.any(RADIO_MODE_RX_PACKET);
+  app.txActive = radiostate.any(RADIO_MODE_TX);
+  app.frequency = frequency;
+}
+
+int metricsExtra(char *buf, size_t size) {
+  int n = snprintf(buf, size, ",\"pipeline\":");
+  if (n > 0 && n < (int)size)
+    n += pipeline.print(buf + n, size - n, capture);
+  return n;
+}
+
 void handleStats(AsyncWebServerRequest *request) {
-  uint64_t cardSize = 0;
-  uint64_t usedBytes = 0;
-  uint64_t freeBytes = 0;
-  bool sd_present = SD.cardType() != CARD_NONE;
-
-  if (sd_present) {
-    cardSize = SD.cardSize();
-    freeBytes = (cardSize > usedBytes) ? (cardSize - usedBytes) : 0;
+  String etag = "\"" + String(metricsSeq(), HEX) + "\"";
+  if (request->hasHeader("If-None-Match") &&
+      request->header("If-None-Match") == etag) {
+    request->send(304);
+    return;
   }
 
-  size_t freeSpiffs = 0;
-  if (LittleFS.begin(true)) {
-    freeSpiffs = LittleFS.totalBytes() - LittleFS.usedBytes();
-  }
+  AsyncResponseStream *response =
+      request->beginResponseStream("application/json");
+  etag = "\"" + String(metricsWrite(*response), HEX) + "\"";
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
 
-  float cardSizeGB = cardSize / (1024.0 * 1024.0 * 1024.0);
-  float freeGB = freeBytes / (1024.0 * 1024.0 * 1024.0);
-
-  String json = "{";
-  json += "\"uptime\":" + String(millis() / 1000);
-  json += ",\"cpu0\":" + String(getCpuFrequencyMhz());
-  json += ",\"cpu1\":" + String(getXtalFrequencyMhz());
-  json += ",\"temperature\":" + String(temperatureRead());
-  json += ",\"freespiffs\":" + String(freeSpiffs);
-  json += ",\"sdcard_size_gb\":" + String(cardSizeGB, 2);
-  json += ",\"sdcard_free_gb\":" + String(freeGB, 2);
-  json += ",\"sdcard_present\":" + String(sd_present ? "true" : "false");
-  json += ",\"totalram\":" + String(ESP.getHeapSize());
-  json += ",\"freeram\":" + String(ESP.getFreeHeap());
-
-  // Dynamic Info
-  json += ",\"mode\":\"" + configMODE + "\"";
-  json +=
-      ",\"ssid\":\"" + (configMODE == "AP" ? configSSID : WiFi.SSID()) + "\"";
-  json += ",\"ipaddress\":\"" +
-          (configMODE == "AP" ? WiFi.softAPIP().toString()
-                              : WiFi.localIP().toString()) +
-          "\"";
-  json += ",\"rx_active\":" + String(raw_rx == "1" ? "true" : "false");
-  json += ",\"tx_active\":" + String(jammer_tx == "1" ? "true" : "false");
-  json += ",\"current_freq\":" + String(frequency);
-
-  json += "}";
-
-  request->send(200, "application/json", json);
+// Keeps the metrics task's idea of filesystem usage current
+static void fsChanged(fs::FS &fs, int32_t bytes) {
+  if (&fs == &SD)
+    metricsSdChanged(bytes);
+  else
+    metricsFlashChanged();
 }
 
 void appendFile(fs::FS &fs, const char *path, const char *message) {
   logs = fs.open(path, FILE_APPEND);
   if (!logs)
     return;
-  logs.print(message);
+  fsChanged(fs, logs.print(message));
   logs.close();
 }
 
-void deleteFile(fs::FS &fs, const char *path) { fs.remove(path); }
+void deleteFile(fs::FS &fs, const char *path) {
+  File file = fs.open(path);
+  int32_t size = (file && !file.isDirectory()) ? file.size() : 0;
+  if (file)
+    file.close();
+  if (fs.remove(path))
+    fsChanged(fs, -size);
+}
+
+// ==========================================
+// CAPTURE CLOCK
+// ==========================================
+#ifdef CAPTURE_CYCLE_TIMESTAMPS
+// CCOUNT extended to 64 bits. The counter is per core, which works
+// because every capture timestamp is taken on core 1: the edge interrupt
+// is attached there (setup() and the radio task), and loop() and the
+// radio task run there. The extension must see every wrap (about 18 s at
+// 240 MHz), so loop() calls captureNow() on each pass, which comes at
+// least every LOOP_IDLE_MS.
+static uint32_t clockHigh = 0;
+static uint32_t clockLast = 0;
+
+static inline uint64_t IRAM_ATTR clockExtend(uint32_t ccount) {
+  if (ccount < clockLast)
+    clockHigh++;
+  clockLast = ccount;
+  return ((uint64_t)clockHigh << 32) | ccount;
+}
+
+static capture_time_t captureNow() {
+  portDISABLE_INTERRUPTS(); // the edge interrupt extends too
+  uint64_t now = clockExtend(ESP.getCycleCount());
+  portENABLE_INTERRUPTS();
+  return now;
+}
+
+static inline capture_time_t IRAM_ATTR captureNowFromISR() {
+  return clockExtend(ESP.getCycleCount());
+}
+
+static unsigned int captureTickRate() { return getCpuFrequencyMhz(); }
+#else
+static capture_time_t captureNow() { return micros(); }
+
+static inline capture_time_t IRAM_ATTR captureNowFromISR() {
+  return micros();
+}
+
+static unsigned int captureTickRate() { return 1; }
+#endif
+
+// ==========================================
+// CARRIER-SENSE GATING
+// ==========================================
+// With csGate set for the receiving module (/setrx csgate=1), its GDO0,
+// otherwise only used as TX data input, outputs carrier sense. The edge
+// interrupt on GDO2 is enabled only while GDO0 is high, and a falling
+// GDO0 ends the burst right away instead of after CAPTURE_GAP_US.
+static volatile bool gateArmed = false;
+static byte gatePin = 0;     // GDO0 of the gated module
+static byte gateDataPin = 0; // its GDO2
+
+static inline void IRAM_ATTR gateData(bool on) {
+  GPIO.pin[gateDataPin].int_type = on ? GPIO_INTR_ANYEDGE : GPIO_INTR_DISABLE;
+}
+
+void RECEIVE_ATTR carrierSense() {
+  if (!gateArmed)
+    return;
+  if (digitalRead(gatePin)) {
+    // A carrier ends the WOR sleep of the radio task too
+    if (wormeter.wake(micros()))
+      radioWakeFromISR();
+    gateData(capture.open(captureNowFromISR()));
+  } else {
+    gateData(false);
+    capture.close();
+  }
+}
+
+// Stops every capture interrupt, gated or not
+void disableReceive() {
+  gateArmed = false;
+  detachInterrupt(gatePin);
+  detachInterrupt(Board::gdo2(0));
+  detachInterrupt(Board::gdo2(1));
+}
 
 bool checkReceived(void) {
-  delay(1);
-  if (samplecount >= minsample && micros() - lastTime > 100000) {
-    detachInterrupt(rx_pin1);
-    detachInterrupt(rx_pin2);
+  if (capture.complete(captureNow())) {
+    disableReceive();
     return true;
   } else {
     return false;
   }
 }
 
-void printReceived() {
-  OutputLog = "";
-  appendFile(SD, "/logs.txt",
-             "-------------------------------------------------------\n");
-  OutputLog += "\nCount=" + String(samplecount) + "\n";
+// Time spent in SD writes and in the analyser for the current burst
+static uint32_t sinkUs = 0;
+static uint32_t analysisUs = 0;
 
-  for (int i = 0; i < samplecount; i++) {
-    OutputLog += String(sample[i]) + ",";
-  }
-  OutputLog += "\n";
-  appendFile(SD, "/logs.txt", OutputLog.c_str());
+static void logSink(void *ctx, const char *text, size_t len) {
+  unsigned long start = micros();
+  ((File *)ctx)->write((const uint8_t *)text, len);
+  sinkUs += micros() - start;
 }
 
-void RECEIVE_ATTR receiver() {
-  const long time = micros();
-  const unsigned int duration = time - lastTime;
+// Frames of the capture that get logged: one per run of repeats unless
+// CONFIG_LOG_EXPAND is set
+static bool frameLogged(const CaptureFrame &f) {
+  return f.repeats > 0 || (settings.logFlags & CONFIG_LOG_EXPAND);
+}
 
-  if (duration > 100000) {
-    samplecount = 0;
+static void frameHeader(CaptureWriter &out, int n, const CaptureFrame &f) {
+  out.put("\nFrame ");
+  out.put((unsigned long)n);
+  out.put(" +");
+  out.put(f.offsetUs);
+  out.put(" us, ");
+  out.put((unsigned long)f.count);
+  out.put(" pulses");
+  if (f.rssi != CAPTURE_RSSI_NONE) {
+    out.put(", RSSI ");
+    out.put((float)f.rssi, 0);
+    out.put(" dBm");
   }
-
-  if (duration >= 100 && samplecount < samplesize) {
-    sample[samplecount++] = duration;
+  if (f.repeats > 1) {
+    out.put(", x");
+    out.put((unsigned long)f.repeats);
+    out.put(" every ");
+    out.put(f.periodUs);
+    out.put(" us, jitter ");
+    out.put(f.jitterUs);
+    out.put(" us");
   }
+  out.put('\n');
+}
 
-  if (samplecount >= samplesize) {
-    samplecount = samplesize - 1;
-    bool received = checkReceived();
-    if (received) {
+void printReceived() {
+  logs = SD.open("/logs.txt", FILE_APPEND);
+  if (!logs)
+    return;
+  size_t written =
+      logs.print("-------------------------------------------------------\n");
+  CaptureWriter out(logSink, &logs);
+  if (capture.framecount == 0 || (settings.logFlags & CONFIG_LOG_EXPAND)) {
+    capture.writeRaw(out, burstRx.frequency);
+  } else {
+    out.put("\nFrequency=");
+    out.put(burstRx.frequency, 2);
+    out.put("\nFrames=");
+    out.put((unsigned long)capture.uniquecount);
+    out.put('/');
+    out.put((unsigned long)capture.framecount);
+    out.put('\n');
+    for (int i = 0; i < capture.framecount; i++) {
+      const CaptureFrame &f = capture.frames[i];
+      if (!frameLogged(f))
+        continue;
+      frameHeader(out, i + 1, f);
+      capture.writeFrame(out, f);
     }
-    detachInterrupt(rx_pin1);
-    detachInterrupt(rx_pin2);
   }
+  out.flush();
+  logs.close();
+  metricsSdChanged(written + out.total());
+}
 
-  if (mod == 0) {
-    if (samplecount == 1 and digitalRead(rx_pin2) != HIGH) {
-      samplecount = 0;
-    }
-
-    else if (samplecount == 1 and digitalRead(rx_pin1) != HIGH) {
-      samplecount = 0;
-    }
+// One packet from the packet mode receiver, payload in hex
+void printPacket(const RxPacket &p) {
+  logs = SD.open("/logs.txt", FILE_APPEND);
+  if (!logs)
+    return;
+  CaptureWriter out(logSink, &logs);
+  out.put("-------------------------------------------------------\n");
+  out.put("Packet module=");
+  out.put((unsigned long)p.module + 1);
+  out.put(" +");
+  out.put((unsigned long)p.millis);
+  out.put(" ms, ");
+  out.put((unsigned long)p.length);
+  out.put(" bytes, RSSI ");
+  out.put((float)p.rssi, 0);
+  out.put(" dBm, LQI ");
+  out.put((unsigned long)p.lqi);
+  out.put(p.crcOk ? ", CRC ok\nData:" : ", CRC error\nData:");
+  static const char digits[] = "0123456789ABCDEF";
+  for (uint16_t i = 0; i < p.length; i++) {
+    out.put(' ');
+    out.put(digits[p.data[i] >> 4]);
+    out.put(digits[p.data[i] & 0x0F]);
   }
-
-  lastTime = time;
+  out.put('\n');
+  out.flush();
+  logs.close();
+  metricsSdChanged(out.total());
 }
 
-void signalanalyse() {
-  OutputLog = "";
-#define signalstorage 10
-
-  int signalanz = 0;
-  int timingdelay[signalstorage];
-  long signaltimings[signalstorage * 2];
-  int signaltimingscount[signalstorage];
-  long signaltimingssum[signalstorage];
-  long signalsum = 0;
-
-  for (int i = 0; i < signalstorage; i++) {
-    signaltimings[i * 2] = 100000;
-    signaltimings[i * 2 + 1] = 0;
-    signaltimingscount[i] = 0;
-    signaltimingssum[i] = 0;
-  }
-  for (int i = 1; i < samplecount; i++) {
-    signalsum += sample[i];
-  }
+// Library files the last burst resembles most
+static FingerprintMatch matches[FP_TOP];
+static int matchCount = 0;
 
-  for (int p = 0; p < signalstorage; p++) {
+void matchReceived() {
+  Fingerprint fp;
+  matchCount = 0;
+  if (fingerprint(capture, fp))
+    matchCount = fingerprintLookup(fp, matches, FP_TOP);
+}
 
-    for (int i = 1; i < samplecount; i++) {
-      if (p == 0) {
-        if (sample[i] < signaltimings[p * 2]) {
-          signaltimings[p * 2] = sample[i];
-        }
-      } else {
-        if (sample[i] < signaltimings[p * 2] &&
-            sample[i] > signaltimings[p * 2 - 1]) {
-          signaltimings[p * 2] = sample[i];
-        }
-      }
-    }
+// Set by /exportsub: write the next burst as .sub, sub logging or not
+static volatile bool exportNext = false;
 
-    for (int i = 1; i < samplecount; i++) {
-      if (sample[i] < signaltimings[p * 2] + error_toleranz &&
-          sample[i] > signaltimings[p * 2 + 1]) {
-        signaltimings[p * 2 + 1] = sample[i];
-      }
-    }
+void exportReceived() {
+  char path[SUB_EXPORT_PATH_SIZE];
+  size_t written = subExport(SD, capture, burstRx, path);
+  if (written == 0)
+    return;
+  exportNext = false;
+  metricsSdChanged(written);
+  Serial.printf("Capture saved to %s\n", path);
+}
 
-    for (int i = 1; i < samplecount; i++) {
-      if (sample[i] >= signaltimings[p * 2] &&
-          sample[i] <= signaltimings[p * 2 + 1]) {
-        signaltimingscount[p]++;
-        signaltimingssum[p] += sample[i];
-      }
-    }
-  }
-  int firstsample = signaltimings[0];
-  signalanz = signalstorage;
+static inline bool RECEIVE_ATTR gdo2Level(byte m) {
+  return m ? FastPin<Board::gdo2(1)>::read() : FastPin<Board::gdo2(0)>::read();
+}
 
-  for (int i = 0; i < signalstorage; i++) {
-    if (signaltimingscount[i] == 0) {
-      signalanz = i;
-      i = signalstorage;
-    }
+void RECEIVE_ATTR receiver() {
+  uint32_t start = PipelineStats::cycles();
+  uint8_t level = gdo2Level(rx_module);
+
+#ifdef CAPTURE_CYCLE_TIMESTAMPS
+  bool room = capture.edge(clockExtend(start));
+#else
+  bool room = capture.edge(micros());
+#endif
+  if (!room) {
+    gateArmed = false;
+    detachInterrupt(Board::gdo2(0));
+    detachInterrupt(Board::gdo2(1));
   }
 
-  for (int s = 1; s < signalanz; s++) {
-    for (int i = 0; i < signalanz - s; i++) {
-      if (signaltimingscount[i] < signaltimingscount[i + 1]) {
-        int temp1 = signaltimings[i * 2];
-        int temp2 = signaltimings[i * 2 + 1];
-        int temp3 = signaltimingssum[i];
-        int temp4 = signaltimingscount[i];
-        signaltimings[i * 2] = signaltimings[(i + 1) * 2];
-        signaltimings[i * 2 + 1] = signaltimings[(i + 1) * 2 + 1];
-        signaltimingssum[i] = signaltimingssum[i + 1];
-        signaltimingscount[i] = signaltimingscount[i + 1];
-        signaltimings[(i + 1) * 2] = temp1;
-        signaltimings[(i + 1) * 2 + 1] = temp2;
-        signaltimingssum[i + 1] = temp3;
-        signaltimingscount[i + 1] = temp4;
-      }
-    }
+  if (mod == 0 && capture.samplecount == 1 &&
+      (!gdo2Level(1) || !gdo2Level(0))) {
+    capture.samplecount = 0;
   }
+  pipeline.isr(start, level);
+}
 
-  for (int i = 0; i < signalanz; i++) {
-    timingdelay[i] = signaltimingssum[i] / signaltimingscount[i];
+void signalanalyse() {
+  logs = SD.open("/logs.txt", FILE_APPEND);
+  if (!logs)
+    return;
+  CaptureWriter out(logSink, &logs);
+  uint32_t written = sinkUs;
+  unsigned long start = micros();
+  if (capture.framecount == 0)
+    capture.analyse(out);
+  for (int i = 0; i < capture.framecount; i++) {
+    const CaptureFrame &f = capture.frames[i];
+    if (!frameLogged(f))
+      continue;
+    frameHeader(out, i + 1, f);
+    capture.analyse(out, f.first, f.count);
+    out.put('\n');
   }
-
-  if (firstsample == sample[1] and firstsample < timingdelay[0]) {
-    sample[1] = timingdelay[0];
+  for (int i = 0; i < matchCount; i++) {
+    out.put(i ? ", " : "\nResembles: ");
+    out.put(matches[i].path);
+    out.put(" (");
+    out.put((unsigned long)matches[i].score);
+    out.put("%)");
   }
+  analysisUs += micros() - start - (sinkUs - written);
+  out.put("\n-------------------------------------------------------\n");
+  out.flush();
+  logs.close();
+  metricsSdChanged(out.total());
+}
 
-  bool lastbin = 0;
-  for (int i = 1; i < samplecount; i++) {
-    float r = (float)sample[i] / timingdelay[0];
-    int calculate = r;
-    r = r - calculate;
-    r *= 10;
-    if (r >= 5) {
-      calculate += 1;
-    }
-    if (calculate > 0) {
-      if (lastbin == 0) {
-        lastbin = 1;
-      } else {
-        lastbin = 0;
-      }
-      if (lastbin == 0 && calculate > 8) {
-        OutputLog += " [Pause: " + String(sample[i]) + " samples]\n";
-      } else {
-        for (int b = 0; b < calculate; b++) {
-          OutputLog += String(lastbin);
-        }
-      }
-    }
+static void loopWake(void) {
+  if (loopTask != NULL)
+    xTaskNotifyGive(loopTask);
+}
+
+void enableReceive() {
+  pinMode(Board::gdo2(0), INPUT);
+  pinMode(Board::gdo2(1), INPUT);
+
+  ELECHOUSE_CC1101 &radio = cc1101[rx_module];
+  const WorParams &wor = worParams[rx_module];
+  bool gated = csGate[rx_module] || wor.interval;
+  if (gated || radio.getShadowReg(CC1101_IOCFG0) == 0x0E)
+    radio.setCarrierSense(gated, csThreshold[rx_module]);
+  if (wor.interval) {
+    worListen(radio, wor);
+    wormeter.arm(micros(), rx_module, wor, datarate);
+  } else {
+    worRelease(radio);
+    radio.SetRx();
   }
-  OutputLog += "\nSamples/Symbol: " + String(timingdelay[0]) + "\n\n";
+  capture.reset();
+  capture.setTickRate(captureTickRate());
+  pipeline.arm();
+  burstReported = false;
+
+  if (!gated) {
+    attachInterrupt(Board::gdo2(0), receiver, CHANGE);
+    attachInterrupt(Board::gdo2(1), receiver, CHANGE);
+    return;
+  }
+  gatePin = Board::gdo0(rx_module);
+  gateDataPin = Board::gdo2(rx_module);
+  pinMode(gatePin, INPUT);
+  attachInterrupt(gateDataPin, receiver, CHANGE);
+  gateData(false);
+  gateArmed = true;
+  attachInterrupt(gatePin, carrierSense, CHANGE);
+  // The carrier may already be up
+  portDISABLE_INTERRUPTS();
+  carrierSense();
+  portENABLE_INTERRUPTS();
+}
+
+// ==========================================
+// RADIO SERVICE GLUE
+// ==========================================
+// Called on the radio task
+void radioArmCapture(byte module) {
+  rx_module = module;
+  enableReceive();
+}
 
-  int smoothcount = 0;
+void radioDisarmCapture() {
+  disableReceive();
+  wormeter.stop(micros());
+  worRelease(cc1101[rx_module]);
+}
 
-  for (int i = 1; i < samplecount; i++) {
-    float r = (float)sample[i] / timingdelay[0];
-    int calculate = r;
-    r = r - calculate;
-    r *= 10;
-    if (r >= 5) {
-      calculate += 1;
-    }
-    if (calculate > 0) {
-      samplesmooth[smoothcount] = calculate * timingdelay[0];
-      smoothcount++;
-    }
-  }
-  appendFile(SD, "/logs.txt", "\n");
-  lastIndex = smoothcount - 1;
-  lastSampleSmooth = samplesmooth[lastIndex];
+// A burst that just completed counts too until radioCapturePoll() has
+// handed it over, so the hopper cannot retune in between
+bool radioCaptureBusy() {
+  capture_time_t now = captureNow();
+  return capture.busy(now) || capture.complete(now);
+}
 
-  OutputLog += "Rawdata corrected:\nCount=" + String(smoothcount + 1) + "\n";
+bool radioCaptureAsleep() { return wormeter.asleep(); }
 
-  for (int i = 0; i < smoothcount; i++) {
-    OutputLog += String(samplesmooth[i]) + ",";
+bool radioCapturePoll() {
+  if (!burstReported && capture.complete(captureNow())) {
+    burstRx = {frequency, mod, setrxbw, deviation};
+    if (rxhopper.active())
+      rxhopper.burstCaptured();
+    burstReported = true;
+    loopWake();
   }
-  appendFile(SD, "/logs.txt", OutputLog.c_str());
-  appendFile(SD, "/logs.txt",
-             "\n-------------------------------------------------------\n");
-  return;
+  return burstReported;
 }
 
-void enableReceive() {
-  rx_pin1 = digitalPinToInterrupt(rx_pin1);
-  rx_pin2 = digitalPinToInterrupt(rx_pin2);
-  pinMode(rx_pin1, INPUT);
-  pinMode(rx_pin2, INPUT);
-  ELECHOUSE_cc1101.SetRx();
-  samplecount = 0;
-  attachInterrupt(rx_pin1, receiver, CHANGE);
-  attachInterrupt(rx_pin2, receiver, CHANGE);
+void radioCaptureRssi(int rssi) { capture.rssi(captureNow(), rssi); }
+
+// Only while the radio task owns the capture: the hopper holds the
+// channel while a burst is handed over to loop()
+void radioChannelChanged(const HopChannel &channel) {
+  capture.reset();
+  mod = channel.mod;
+  frequency = channel.frequency;
+  setrxbw = channel.setrxbw;
+  deviation = channel.deviation;
 }
 
-void setup() {
-  Serial.begin(38400);
+// Maps a radio service result to an HTTP error. Returns true on success.
+bool radioReply(AsyncWebServerRequest *request, RadioResult result) {
+  if (result == RADIO_OK)
+    return true;
+  if (result == RADIO_ERR_INVALID)
+    request->send(400, "application/json",
+                  "{\"status\":\"error\",\"message\":\"Invalid module\"}");
+  else if (result == RADIO_ERR_BUSY)
+    request->send(503, "application/json",
+                  "{\"status\":\"error\",\"message\":\"Radio busy\"}");
+  else
+    request->send(504, "application/json",
+                  "{\"status\":\"error\",\"message\":\"Radio did not "
+                  "respond\"}");
+  return false;
+}
+
+bool sendRadioCommand(AsyncWebServerRequest *request, RadioCommand &cmd) {
+  return radioReply(request, radioSubmit(cmd, RADIO_REPLY_MS));
+}
+
+// Hex digits, whitespace ignored. Returns the byte count, -1 on a stray
+// character, an odd digit count or more than size bytes.
+static int parseHex(const String &hex, byte *out, int size) {
+  int n = 0;
+  int high = -1;
+  for (unsigned int i = 0; i < hex.length(); i++) {
+    char c = hex.charAt(i);
+    int v;
+    if (c >= '0' && c <= '9')
+      v = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      v = c - 'A' + 10;
+    else if (c == ' ' || c == ':' || c == '\n' || c == '\r')
+      continue;
+    else
+      return -1;
+    if (high < 0) {
+      high = v;
+      continue;
+    }
+    if (n >= size)
+      return -1;
+    out[n++] = (high << 4) | v;
+    high = -1;
+  }
+  return high < 0 ? n : -1;
+}
 
+static void storageTask(void *arg) {
   if (!LittleFS.begin(true)) {
     LittleFS.format();
     delay(1000);
     ESP.restart();
   }
+  bool stored = configLoad(settings);
+  bootPhase(stored ? "config loaded" : "no config, using defaults");
+  resumeReceive();
 
-  delay(2000);
-  sdspi.begin(18, 19, 23, 22);
-  SD.begin(22, sdspi);
+  sdspi.begin(Board::SD_SCLK, Board::SD_MISO, Board::SD_MOSI, Board::SD_SS);
+  SD.begin(Board::SD_SS, sdspi);
+  bootPhase("sd mounted");
 
-  connectToWiFi(); // Will now read /CONFIG/SSID.txt, /CONFIG/MODE.txt etc.
-
-  if (!MDNS.begin("evilcrow-rf")) {
+  if (!stored) {
+    migrateTextConfig();
+    bootPhase("config migrated");
   }
 
-  controlserver.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(SD, "/HTML/index.html", "text/html");
-  });
+  MetricsHooks metrics = {metricsApp, metricsExtra};
+  metricsBegin(metrics);
 
-  controlserver.on("/rxconfig", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(SD, "/HTML/rxconfig.html", "text/html");
-  });
+  fingerprintIndexBegin(SD, LittleFS);
+  if (fingerprintIndexSize() < 0)
+    fingerprintIndexStart();
 
-  controlserver.on("/viewlog", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(SD, "/HTML/viewlog.html", "text/html");
-  });
+  xEventGroupSetBits(bootEvents, BOOT_STORAGE_READY);
+  bootPhase("storage ready");
+  vTaskDelete(NULL);
+}
+
+static void networkTask(void *arg) {
+  xEventGroupWaitBits(bootEvents, BOOT_STORAGE_READY, pdFALSE, pdTRUE,
+                      portMAX_DELAY);
+
+  // Pages, stylesheet and script, embedded at build time
+  webUiBegin(controlserver);
+
+  connectToWiFi();
+  controlserver.begin();
+  bootPhase("web server started");
+
+  if (settings.wifiMode != CONFIG_WIFI_AP) {
+    EventBits_t bits =
+        xEventGroupWaitBits(bootEvents, BOOT_STA_GOT_IP, pdFALSE, pdTRUE,
+                            pdMS_TO_TICKS(BOOT_STA_TIMEOUT_MS));
+    if (bits & BOOT_STA_GOT_IP) {
+      bootPhase("wifi connected");
+    } else {
+      startAccessPoint(CONFIG_DEFAULT_SSID, CONFIG_DEFAULT_PASS);
+      bootPhase("wifi timeout, default access point started");
+    }
+  }
+
+  if (MDNS.begin("evilcrow-rf"))
+    bootPhase("mdns started");
+  vTaskDelete(NULL);
+}
+
+void setup() {
+  Serial.begin(38400);
+  bootEvents = xEventGroupCreate();
+  configBegin();
+  bootPhase("setup");
+
+  xTaskCreatePinnedToCore(storageTask, "storage", BOOT_TASK_STACK, NULL,
+                          BOOT_TASK_PRIORITY, NULL, BOOT_TASK_CORE);
+
+  for (byte m = 0; m < 2; m++)
+    cc1101[m].setSpiPin(Board::SCK, Board::MISO, Board::MOSI, Board::cs(m));
+  cc1101[0].Init();
+  cc1101[1].Init();
+
+  CaptureFilter filter = {CAPTURE_MIN_PULSE_US, FILTER_MERGE,
+                          CAPTURE_MIN_SAMPLES, FILTER_MAX_EDGES_PER_MS,
+                          FILTER_ADAPTIVE};
+  capture.setFilter(filter);
+
+  loopTask = xTaskGetCurrentTaskHandle();
+  RadioHooks hooks;
+  hooks.armCapture = radioArmCapture;
+  hooks.disarmCapture = radioDisarmCapture;
+  hooks.captureBusy = radioCaptureBusy;
+  hooks.captureAsleep = radioCaptureAsleep;
+  hooks.capturePoll = radioCapturePoll;
+  hooks.packetQueued = loopWake;
+  hooks.captureRssi = radioCaptureRssi;
+  hooks.channelChanged = radioChannelChanged;
+  radioServiceBegin(cc1101, hooks);
+  xEventGroupSetBits(bootEvents, BOOT_RADIOS_READY);
+  bootPhase("radios ready");
 
   controlserver.on("/logs", HTTP_GET, [](AsyncWebServerRequest *request) {
     request->send(SD, "/logs.txt", "text/plain");
   });
 
-  controlserver.on("/txconfig", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(SD, "/HTML/txconfig.html", "text/html");
-  });
-
   controlserver.on("/delete", HTTP_POST, [](AsyncWebServerRequest *request) {
     deleteFile(SD, "/logs.txt");
     request->send(200, "application/json", "{\"status\":\"deleted\"}");
   });
 
-  controlserver.on("/config", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(SD, "/HTML/config.html", "text/html");
-  });
-
   controlserver.on("/stats", HTTP_GET, handleStats);
 
   controlserver.on("/reboot", HTTP_POST, [](AsyncWebServerRequest *request) {
@@ -488,11 +814,6 @@ void setup() {
         request->send(200, "application/json", "{\"status\":\"ok\"}");
       });
 
-  controlserver.on(
-      "/javascript.js", HTTP_GET, [](AsyncWebServerRequest *request) {
-        request->send(SD, "/HTML/javascript.js", "text/javascript");
-      });
-
   controlserver.on("/setrx", HTTP_POST, [](AsyncWebServerRequest *request) {
     if (!request->hasArg("module") || !request->hasArg("frequency") ||
         !request->hasArg("setrxbw") || !request->hasArg("mod") ||
@@ -504,43 +825,50 @@ void setup() {
       return;
     }
 
-    tmp_module = request->arg("module");
-    tmp_frequency = request->arg("frequency");
-    tmp_setrxbw = request->arg("setrxbw");
-    tmp_mod = request->arg("mod");
-    tmp_deviation = request->arg("deviation");
-    tmp_datarate = request->arg("datarate");
-
     if (request->hasArg("configmodule")) {
-      frequency = tmp_frequency.toFloat();
-      setrxbw = tmp_setrxbw.toFloat();
-      mod = tmp_mod.toInt();
-      deviation = tmp_deviation.toFloat();
-      datarate = tmp_datarate.toInt();
-
-      if (tmp_module == "1") {
-        ELECHOUSE_cc1101.setModul(0);
-        ELECHOUSE_cc1101.Init();
-      } else if (tmp_module == "2") {
-        ELECHOUSE_cc1101.setModul(1);
-        ELECHOUSE_cc1101.Init();
+      byte module = (request->arg("module") == "1") ? 0 : 1;
+      csGate[module] =
+          request->hasArg("csgate") && request->arg("csgate") == "1";
+      csThreshold[module] =
+          request->hasArg("csthreshold")
+              ? constrain(request->arg("csthreshold").toInt(), -7, 7)
+              : 0;
+      WorParams &wor = worParams[module];
+      wor = {};
+      if (request->hasArg("wor") && request->arg("wor") == "1") {
+        wor.interval = request->hasArg("worinterval")
+                           ? request->arg("worinterval").toInt()
+                           : 100;
+        if (request->hasArg("worterm") && request->arg("worterm") == "pqt")
+          wor.term = WOR_TERM_PQT;
+        if (request->hasArg("worrxtime"))
+          wor.rxTime = request->arg("worrxtime").toInt();
+        wor.pqt = request->hasArg("pqt") ? request->arg("pqt").toInt() : 4;
+        worNormalize(wor);
       }
+      frequency = request->arg("frequency").toFloat();
+      setrxbw = request->arg("setrxbw").toFloat();
+      mod = request->arg("mod").toInt();
+      deviation = request->arg("deviation").toFloat();
+      datarate = request->arg("datarate").toInt();
+
+      RadioCommand cmd = {};
+      cmd.type = RADIO_CMD_SET_RX;
+      cmd.module = module;
+      cmd.rx = {frequency, setrxbw, deviation, mod, datarate};
+      if (!sendRadioCommand(request, cmd))
+        return;
+
+      settings.rx[cmd.module] = cmd.rx;
+      settings.rxValid |= 1 << cmd.module;
+      settings.rxModule = cmd.module;
+      settings.rxResume = 1;
+      settings.csGate = (settings.csGate & ~(1 << module)) |
+                        (csGate[module] << module);
+      settings.csThreshold[module] = csThreshold[module];
+      settings.wor[module] = wor;
+      configSave(settings);
 
-      if (mod == 2) {
-        ELECHOUSE_cc1101.setDcFilterOff(0);
-      } else if (mod == 0) {
-        ELECHOUSE_cc1101.setDcFilterOff(1);
-        ELECHOUSE_cc1101.setDeviation(deviation);
-      }
-
-      ELECHOUSE_cc1101.setModulation(mod);
-      ELECHOUSE_cc1101.setMHZ(frequency);
-      ELECHOUSE_cc1101.setSyncMode(0);
-      ELECHOUSE_cc1101.setPktFormat(3);
-      ELECHOUSE_cc1101.setRxBW(setrxbw);
-      ELECHOUSE_cc1101.setDRate(datarate);
-      enableReceive();
-      raw_rx = "1";
       request->send(200, "application/json",
                     "{\"status\":\"success\",\"message\":\"RX configuration "
                     "applied successfully.\"}");
@@ -552,16 +880,284 @@ void setup() {
   });
 
   controlserver.on("/stoprx", HTTP_POST, [](AsyncWebServerRequest *request) {
-    ELECHOUSE_cc1101.setModul(0);
-    ELECHOUSE_cc1101.setSidle();
-    ELECHOUSE_cc1101.setModul(1);
-    ELECHOUSE_cc1101.setSidle();
+    RadioCommand cmd = {};
+    cmd.type = RADIO_CMD_STOP_RX;
+    if (!sendRadioCommand(request, cmd))
+      return;
 
-    raw_rx = "0";
+    if (settings.rxResume) {
+      settings.rxResume = 0;
+      configSave(settings);
+    }
     request->send(200, "application/json",
                   "{\"status\":\"success\",\"message\":\"RX stopped.\"}");
   });
 
+  controlserver.on(
+      "/setpacketrx", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasArg("module") || !request->hasArg("frequency") ||
+            !request->hasArg("datarate")) {
+          request->send(400, "application/json",
+                        "{\"status\":\"error\",\"message\":\"Missing "
+                        "parameters (module, frequency, datarate "
+                        "required)\"}");
+          return;
+        }
+
+        RadioCommand cmd = {};
+        cmd.type = RADIO_CMD_START_PACKET_RX;
+        cmd.module = (request->arg("module") == "1") ? 0 : 1;
+        PacketRxParams &p = cmd.packet;
+        p.frequency = request->arg("frequency").toFloat();
+        p.datarate = request->arg("datarate").toFloat();
+        p.mod = request->hasArg("mod") ? request->arg("mod").toInt() : 0;
+        p.setrxbw = request->hasArg("setrxbw")
+                        ? request->arg("setrxbw").toFloat()
+                        : 203;
+        p.deviation = request->hasArg("deviation")
+                          ? request->arg("deviation").toFloat()
+                          : 47.6;
+        p.sync = request->hasArg("sync")
+                     ? strtoul(request->arg("sync").c_str(), NULL, 16)
+                     : 0xD391;
+        p.syncmode = request->hasArg("syncmode")
+                         ? request->arg("syncmode").toInt()
+                         : 2;
+        p.length =
+            request->hasArg("length") ? request->arg("length").toInt() : 0;
+        p.crc = !request->hasArg("crc") || request->arg("crc") == "1";
+
+        RadioResult result = radioSubmit(cmd, RADIO_REPLY_MS);
+        if (result == RADIO_ERR_INVALID) {
+          request->send(400, "application/json",
+                        "{\"status\":\"error\",\"message\":\"Invalid "
+                        "settings (syncmode 1-7, length at most " +
+                            String(PACKET_RX_MAX) + ")\"}");
+          return;
+        }
+        if (!radioReply(request, result))
+          return;
+        // The raw capture is stopped and packet RX is not persisted
+        if (settings.rxResume) {
+          settings.rxResume = 0;
+          configSave(settings);
+        }
+        request->send(200, "application/json",
+                      "{\"status\":\"success\",\"message\":\"Packet RX "
+                      "started.\"}");
+      });
+
+  controlserver.on(
+      "/stoppacketrx", HTTP_POST, [](AsyncWebServerRequest *request) {
+        RadioCommand cmd = {};
+        cmd.type = RADIO_CMD_STOP_PACKET_RX;
+        if (!sendRadioCommand(request, cmd))
+          return;
+        request->send(200, "application/json",
+                      "{\"status\":\"success\",\"message\":\"Packet RX "
+                      "stopped.\"}");
+      });
+
+  controlserver.on(
+      "/settxpacket", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!request->hasArg("module") || !request->hasArg("frequency") ||
+            !request->hasArg("datarate") || !request->hasArg("data")) {
+          request->send(400, "application/json",
+                        "{\"status\":\"error\",\"message\":\"Missing "
+                        "parameters (module, frequency, datarate, data "
+                        "required)\"}");
+          return;
+        }
+
+        // Handed over to the radio task, freed once the packet is sent
+        byte *payload = new byte[PACKET_TX_MAX];
+        int count = parseHex(request->arg("data"), payload, PACKET_TX_MAX);
+        if (count <= 0) {
+          delete[] payload;
+          request->send(400, "application/json",
+                        "{\"status\":\"error\",\"message\":\"data must "
+                        "be 1 to " +
+                            String(PACKET_TX_MAX) + " hex bytes\"}");
+          return;
+        }
+
+        RadioCommand cmd = {};
+        cmd.type = RADIO_CMD_TX_PACKET;
+        cmd.module = (request->arg("module") == "1") ? 0 : 1;
+        PacketTxParams &p = cmd.packetTx;
+        p.frequency = request->arg("frequency").toFloat();
+        p.datarate = request->arg("datarate").toFloat();
+        p.mod = request->hasArg("mod") ? request->arg("mod").toInt() : 0;
+        p.deviation = request->hasArg("deviation")
+                          ? request->arg("deviation").toFloat()
+                          : 47.6;
+        p.power = request->hasArg("power") ? request->arg("power").toInt()
+                                           : 10;
+        p.sync = request->hasArg("sync")
+                     ? strtoul(request->arg("sync").c_str(), NULL, 16)
+                     : 0xD391;
+        p.syncmode = request->hasArg("syncmode")
+                         ? request->arg("syncmode").toInt()
+                         : 2;
+        p.crc = !request->hasArg("crc") || request->arg("crc") == "1";
+        p.lengthByte = (!request->hasArg("lengthbyte") ||
+                        request->arg("lengthbyte") == "1") &&
+                       count <= 255;
+        p.count = count;
+        p.data = payload;
+
+        // Completion shows up in /packetstats and /radiostats
+        if (radioSubmit(cmd, 0) != RADIO_QUEUED) {
+          request->send(503, "application/json",
+                        "{\"status\":\"error\",\"message\":\"Radio "
+                        "busy\"}");
+          return;
+        }
+        request->send(200, "application/json",
+                      "{\"status\":\"success\",\"message\":\"Packet "
+                      "queued for transmission.\"}");
+      });
+
+  controlserver.on(
+      "/packetstats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json",
+                      "{\"rx\":" + packetrx.statsJson() +
+                          ",\"tx\":" + packettx.statsJson() + "}");
+      });
+
+  controlserver.on("/worstats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "application/json", wormeter.statsJson());
+  });
+
+  controlserver.on("/sethop", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!request->hasArg("module") || !request->hasArg("channels")) {
+      request->send(400, "application/json",
+                    "{\"status\":\"error\",\"message\":\"Missing parameters "
+                    "(module, channels required)\"}");
+      return;
+    }
+
+    // Shared preset, overridable per channel in the "channels" list
+    HopChannel defaults = {0, 2, 58, 0, 5, 250};
+    if (request->hasArg("mod"))
+      defaults.mod = request->arg("mod").toInt();
+    if (request->hasArg("setrxbw"))
+      defaults.setrxbw = request->arg("setrxbw").toFloat();
+    if (request->hasArg("deviation"))
+      defaults.deviation = request->arg("deviation").toFloat();
+    if (request->hasArg("datarate"))
+      defaults.datarate = request->arg("datarate").toInt();
+    if (request->hasArg("dwell"))
+      defaults.dwell = request->arg("dwell").toInt();
+
+    HopChannel *list = new HopChannel[HOP_MAX_CHANNELS];
+    byte count = parseHopChannels(request->arg("channels"), defaults, list);
+    if (count == 0) {
+      delete[] list;
+      request->send(400, "application/json",
+                    "{\"status\":\"error\",\"message\":\"Invalid channel "
+                    "list\"}");
+      return;
+    }
+
+    byte sense = HOP_SENSE_RSSI;
+    if (request->hasArg("sense") && request->arg("sense") == "cs")
+      sense = HOP_SENSE_CS;
+    int threshold =
+        request->hasArg("threshold") ? request->arg("threshold").toInt() : -70;
+    uint16_t maxhold =
+        request->hasArg("maxhold") ? request->arg("maxhold").toInt() : 2000;
+
+    RadioCommand cmd = {};
+    cmd.type = RADIO_CMD_START_HOP;
+    cmd.module = (request->arg("module") == "1") ? 0 : 1;
+    csGate[cmd.module] = false; // hopping holds on RSSI/CS itself
+    worParams[cmd.module].interval = 0;
+    cmd.hop = {list, count, sense, threshold, maxhold};
+    if (!sendRadioCommand(request, cmd))
+      return;
+    // Hopping is not persisted, don't come back with the plain preset
+    if (settings.rxResume) {
+      settings.rxResume = 0;
+      configSave(settings);
+    }
+    request->send(200, "application/json",
+                  "{\"status\":\"success\",\"message\":\"Hopping started on " +
+                      String(count) + " channels.\"}");
+  });
+
+  controlserver.on("/stophop", HTTP_POST, [](AsyncWebServerRequest *request) {
+    RadioCommand cmd = {};
+    cmd.type = RADIO_CMD_STOP_HOP;
+    if (!sendRadioCommand(request, cmd))
+      return;
+    request->send(200, "application/json",
+                  "{\"status\":\"success\",\"message\":\"Hopping stopped.\"}");
+  });
+
+  controlserver.on("/hopstats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send(200, "application/json", rxhopper.statsJson());
+  });
+
+  controlserver.on("/setsweep", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!request->hasArg("module") || !request->hasArg("start") ||
+        !request->hasArg("stop") || !request->hasArg("step")) {
+      request->send(400, "application/json",
+                    "{\"status\":\"error\",\"message\":\"Missing parameters "
+                    "(module, start, stop, step required)\"}");
+      return;
+    }
+
+    RadioCommand cmd = {};
+    cmd.type = RADIO_CMD_START_SWEEP;
+    SpectrumConfig &cfg = cmd.sweep;
+    cfg.module = (request->arg("module") == "1") ? 0 : 1;
+    cfg.start = request->arg("start").toFloat();
+    cfg.stop = request->arg("stop").toFloat();
+    cfg.step = request->arg("step").toFloat();
+    cfg.rbw = request->hasArg("rbw") ? request->arg("rbw").toFloat() : 58;
+    cfg.settle =
+        request->hasArg("settle") ? request->arg("settle").toInt() : 400;
+    cmd.module = cfg.module;
+
+    RadioResult result = radioSubmit(cmd, RADIO_REPLY_MS);
+    if (result == RADIO_ERR_INVALID) {
+      request->send(400, "application/json",
+                    "{\"status\":\"error\",\"message\":\"Invalid sweep range "
+                    "(one band, at most " +
+                        String(SPECTRUM_MAX_POINTS) + " points)\"}");
+      return;
+    }
+    if (!radioReply(request, result))
+      return;
+    request->send(200, "application/json",
+                  "{\"status\":\"success\",\"message\":\"Sweep started.\"}");
+  });
+
+  controlserver.on(
+      "/stopsweep", HTTP_POST, [](AsyncWebServerRequest *request) {
+        RadioCommand cmd = {};
+        cmd.type = RADIO_CMD_STOP_SWEEP;
+        if (!sendRadioCommand(request, cmd))
+          return;
+        request->send(200, "application/json",
+                      "{\"status\":\"success\",\"message\":\"Sweep "
+                      "stopped.\"}");
+      });
+
+  controlserver.on("/spectrum", HTTP_GET, [](AsyncWebServerRequest *request) {
+    uint32_t since = 0;
+    if (request->hasArg("since"))
+      since = strtoul(request->arg("since").c_str(), NULL, 10);
+    AsyncResponseStream *response =
+        request->beginResponseStream("application/octet-stream");
+    response->addHeader("Cache-Control", "no-store");
+    // Empty 503 when the frame buffer cannot be allocated
+    if (!spectrum.writeFrame(*response, since))
+      response->setCode(503);
+    request->send(response);
+  });
+
   controlserver.on("/settx", HTTP_POST, [](AsyncWebServerRequest *request) {
     if (!request->hasArg("module") || !request->hasArg("frequency") ||
         !request->hasArg("rawdata") || !request->hasArg("mod") ||
@@ -570,45 +1166,35 @@ void setup() {
       return;
     }
 
-    tmp_module = request->arg("module");
-    tmp_frequency = request->arg("frequency");
-    transmit = request->arg("rawdata");
-    tmp_deviation = request->arg("deviation");
-    tmp_mod = request->arg("mod");
-
+    const String &transmit = request->arg("rawdata");
     int counter = 0;
     int pos = 0;
-    frequency = tmp_frequency.toFloat();
-    deviation = tmp_deviation.toFloat();
-    mod = tmp_mod.toInt();
+    frequency = request->arg("frequency").toFloat();
+    deviation = request->arg("deviation").toFloat();
+    mod = request->arg("mod").toInt();
 
-    for (int i = 0; i < transmit.length(); i++) {
-      if (transmit.substring(i, i + 1) == ",") {
+    // Handed over to the radio task, which frees it after transmitting
+    long *data_to_send = new long[samplesize];
+    for (int i = 0; i < transmit.length() && counter < samplesize; i++) {
+      if (transmit.charAt(i) == ',') {
         data_to_send[counter++] = transmit.substring(pos, i).toInt();
         pos = i + 1;
       }
     }
-    if (pos < transmit.length())
+    if (pos < transmit.length() && counter < samplesize)
       data_to_send[counter++] = transmit.substring(pos).toInt();
 
-    int tx_pin = (tmp_module == "1") ? 2 : 25;
-    ELECHOUSE_cc1101.setModul((tmp_module == "1") ? 0 : 1);
-    ELECHOUSE_cc1101.Init();
-    ELECHOUSE_cc1101.setModulation(mod);
-    ELECHOUSE_cc1101.setMHZ(frequency);
-    ELECHOUSE_cc1101.setDeviation(deviation);
-    ELECHOUSE_cc1101.SetTx();
-    pinMode(tx_pin, OUTPUT);
-
-    for (int i = 0; i < counter; i += 2) {
-      digitalWrite(tx_pin, HIGH);
-      delayMicroseconds(data_to_send[i]);
-      digitalWrite(tx_pin, LOW);
-      delayMicroseconds(data_to_send[i + 1]);
-    }
+    RadioCommand cmd = {};
+    cmd.type = RADIO_CMD_TX_RAW;
+    cmd.module = (request->arg("module") == "1") ? 0 : 1;
+    cmd.tx = {frequency, deviation, mod, (uint16_t)counter, data_to_send};
 
-    ELECHOUSE_cc1101.setSidle();
-    request->send(200, "text/plain", "Signal has been transmitted");
+    // The transmission can take seconds; do not hold the async_tcp task
+    if (radioSubmit(cmd, 0) != RADIO_QUEUED) {
+      request->send(503, "text/plain", "Radio busy");
+      return;
+    }
+    request->send(200, "text/plain", "Signal queued for transmission");
   });
 
   controlserver.on("/setjammer", HTTP_POST, [](AsyncWebServerRequest *request) {
@@ -620,41 +1206,35 @@ void setup() {
       return;
     }
 
-    tmp_module = request->arg("module");
+    const String &module = request->arg("module");
     frequency = request->arg("frequency").toFloat();
     int power_jammer = request->arg("power").toInt();
 
-    if (tmp_module != "1" && tmp_module != "2") {
+    if (module != "1" && module != "2") {
       request->send(400, "application/json",
                     "{\"status\":\"error\",\"message\":\"Invalid module (must "
                     "be 1 or 2)\"}");
       return;
     }
 
-    int moduleIndex = (tmp_module == "1") ? 0 : 1;
-    int tx_pin = (tmp_module == "1") ? tx_pin1 : tx_pin2;
-
-    pinMode(tx_pin, OUTPUT);
-    ELECHOUSE_cc1101.setModul(moduleIndex);
-    ELECHOUSE_cc1101.Init();
-    ELECHOUSE_cc1101.setModulation(2);
-    ELECHOUSE_cc1101.setMHZ(frequency);
-    ELECHOUSE_cc1101.setPA(power_jammer);
-    ELECHOUSE_cc1101.SetTx();
+    RadioCommand cmd = {};
+    cmd.type = RADIO_CMD_SET_JAMMER;
+    cmd.module = (module == "1") ? 0 : 1;
+    cmd.jammer = {frequency, power_jammer};
+    if (!sendRadioCommand(request, cmd))
+      return;
 
-    jammer_tx = "1";
     request->send(200, "application/json",
                   "{\"status\":\"success\",\"message\":\"Jammer started\"}");
   });
 
   controlserver.on(
       "/stopjammer", HTTP_POST, [](AsyncWebServerRequest *request) {
-        ELECHOUSE_cc1101.setModul(0);
-        ELECHOUSE_cc1101.setSidle();
-        ELECHOUSE_cc1101.setModul(1);
-        ELECHOUSE_cc1101.setSidle();
+        RadioCommand cmd = {};
+        cmd.type = RADIO_CMD_STOP_JAMMER;
+        if (!sendRadioCommand(request, cmd))
+          return;
 
-        jammer_tx = "0";
         request->send(
             200, "application/json",
             "{\"status\":\"success\",\"message\":\"Jammer stopped\"}");
@@ -681,15 +1261,15 @@ void setup() {
           return;
         }
 
-        // Save to SD Card
-        deleteFile(SD, "/CONFIG/SSID.txt");
-        deleteFile(SD, "/CONFIG/PASS.txt");
-        appendFile(SD, "/CONFIG/SSID.txt", ssid.c_str());
-        appendFile(SD, "/CONFIG/PASS.txt", pass.c_str());
-
-        // Update runtime config (optional, takes effect next boot usually)
-        configSSID = ssid;
-        configPASS = pass;
+        // Takes effect on the next boot
+        strlcpy(settings.ssid, ssid.c_str(), sizeof(settings.ssid));
+        strlcpy(settings.pass, pass.c_str(), sizeof(settings.pass));
+        if (!configSave(settings)) {
+          request->send(500, "application/json",
+                        "{\"status\":\"error\",\"message\":\"Could not "
+                        "save config\"}");
+          return;
+        }
 
         request->send(200, "application/json",
                       "{\"status\":\"success\",\"message\":\"Wi-Fi settings "
@@ -698,50 +1278,171 @@ void setup() {
 
   controlserver.on(
       "/deletewificonfig", HTTP_POST, [](AsyncWebServerRequest *request) {
+        // Also drop the legacy files so they are not migrated again
         deleteFile(SD, "/CONFIG/SSID.txt");
         deleteFile(SD, "/CONFIG/PASS.txt");
-        // Optionally reset runtime config to defaults
+        deleteFile(SD, "/CONFIG/MODE.txt");
+        strlcpy(settings.ssid, CONFIG_DEFAULT_SSID, sizeof(settings.ssid));
+        strlcpy(settings.pass, CONFIG_DEFAULT_PASS, sizeof(settings.pass));
+        settings.wifiMode = CONFIG_WIFI_AP;
+        configSave(settings);
         request->send(
             200, "application/json",
             "{\"status\":\"success\",\"message\":\"Wi-Fi config deleted. "
             "Device will revert to default AP on reboot.\"}");
       });
 
-  controlserver.on("/style.css", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(SD, "/HTML/style.css", "text/css");
+  controlserver.on(
+      "/setfilter", HTTP_POST, [](AsyncWebServerRequest *request) {
+        CaptureFilter f = capture.getFilter();
+        if (request->hasArg("minpulse"))
+          f.minPulse = request->arg("minpulse").toInt();
+        if (request->hasArg("merge"))
+          f.merge = request->arg("merge") == "1";
+        if (request->hasArg("minburst"))
+          f.minBurst = request->arg("minburst").toInt();
+        if (request->hasArg("maxrate"))
+          f.maxEdgesPerMs = request->arg("maxrate").toInt();
+        if (request->hasArg("adaptive"))
+          f.adaptive = request->arg("adaptive").toInt();
+        if (f.minBurst > CAPTURE_SAMPLES - 1) {
+          request->send(400, "application/json",
+                        "{\"status\":\"error\",\"message\":\"minburst "
+                        "too large\"}");
+          return;
+        }
+        // Applied to the live capture: each field is a single word the
+        // edge interrupt reads on its own
+        capture.setFilter(f);
+        f = capture.getFilter();
+        char json[128];
+        snprintf(json, sizeof(json),
+                 "{\"minpulse\":%u,\"merge\":%s,\"minburst\":%u,"
+                 "\"maxrate\":%u,\"adaptive\":%u,\"glitch_us\":%lu}",
+                 f.minPulse, f.merge ? "true" : "false", f.minBurst,
+                 f.maxEdgesPerMs, f.adaptive, capture.glitchUs());
+        request->send(200, "application/json", json);
+      });
+
+  controlserver.on(
+      "/setlogging", HTTP_POST, [](AsyncWebServerRequest *request) {
+        uint8_t flags = settings.logFlags;
+        if (request->hasArg("raw"))
+          flags = request->arg("raw") == "1" ? flags | CONFIG_LOG_RAW
+                                             : flags & ~CONFIG_LOG_RAW;
+        if (request->hasArg("analysis"))
+          flags = request->arg("analysis") == "1"
+                      ? flags | CONFIG_LOG_ANALYSIS
+                      : flags & ~CONFIG_LOG_ANALYSIS;
+        if (request->hasArg("expand"))
+          flags = request->arg("expand") == "1" ? flags | CONFIG_LOG_EXPAND
+                                                : flags & ~CONFIG_LOG_EXPAND;
+        if (request->hasArg("sub"))
+          flags = request->arg("sub") == "1" ? flags | CONFIG_LOG_SUB
+                                             : flags & ~CONFIG_LOG_SUB;
+        if (flags != settings.logFlags) {
+          settings.logFlags = flags;
+          configSave(settings);
+        }
+        request->send(200, "application/json",
+                      String("{\"raw\":") +
+                          (flags & CONFIG_LOG_RAW ? "true" : "false") +
+                          ",\"analysis\":" +
+                          (flags & CONFIG_LOG_ANALYSIS ? "true" : "false") +
+                          ",\"expand\":" +
+                          (flags & CONFIG_LOG_EXPAND ? "true" : "false") +
+                          ",\"sub\":" +
+                          (flags & CONFIG_LOG_SUB ? "true" : "false") + "}");
+      });
+
+  controlserver.on(
+      "/buildindex", HTTP_POST, [](AsyncWebServerRequest *request) {
+        if (!fingerprintIndexStart()) {
+          request->send(409, "application/json",
+                        "{\"status\":\"error\",\"message\":\"Index "
+                        "build already running.\"}");
+          return;
+        }
+        request->send(200, "application/json",
+                      "{\"status\":\"success\",\"message\":\"Index build "
+                      "started.\"}");
+      });
+
+  controlserver.on("/matches", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response =
+        request->beginResponseStream("application/json");
+    response->printf("{\"indexing\":%s,\"entries\":%d,\"matches\":[",
+                     fingerprintIndexBusy() ? "true" : "false",
+                     fingerprintIndexSize());
+    for (int i = 0; i < matchCount; i++)
+      response->printf("%s{\"path\":\"%s\",\"score\":%u}", i ? "," : "",
+                       matches[i].path, matches[i].score);
+    response->print("]}");
+    request->send(response);
   });
 
-  controlserver.begin();
-  ELECHOUSE_cc1101.addSpiPin(sck_pin, miso_pin, mosi_pin, cs_pin1, 0);
-  ELECHOUSE_cc1101.addSpiPin(sck_pin, miso_pin, mosi_pin, cs_pin2, 1);
+  controlserver.on(
+      "/exportsub", HTTP_POST, [](AsyncWebServerRequest *request) {
+        exportNext = true;
+        request->send(200, "application/json",
+                      "{\"status\":\"success\",\"message\":\"The next "
+                      "capture is saved to " SUB_EXPORT_DIR ".\"}");
+      });
 
-  enableReceive();
+  controlserver.on(
+      "/pipelinestats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response =
+            request->beginResponseStream("application/octet-stream");
+        response->addHeader("Cache-Control", "no-store");
+        pipeline.writeBlock(*response, capture);
+        request->send(response);
+      });
+
+  controlserver.on(
+      "/radiostats", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "application/json", radioStatsJson());
+      });
+
+  xTaskCreatePinnedToCore(networkTask, "network", BOOT_TASK_STACK, NULL,
+                          BOOT_TASK_PRIORITY, NULL, BOOT_TASK_CORE);
 }
 
+// Hopping, sweeping and jamming run on the radio service task
 void loop() {
-  if (raw_rx == "1") {
+  // Woken by radioCapturePoll() and the packet receiver; the timeout
+  // covers what arrived while the storage was not ready yet
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOOP_IDLE_MS));
+#ifdef CAPTURE_CYCLE_TIMESTAMPS
+  captureNow(); // keeps the clock extension current, see CAPTURE CLOCK
+#endif
+  static RxPacket packet;
+  while (storageReady() && packetrx.receive(packet, 0))
+    printPacket(packet);
+
+  if (burstReported && radiostate.mode(rx_module) == RADIO_MODE_RX_ASYNC &&
+      storageReady()) {
     if (checkReceived()) {
-      printReceived();
-      signalanalyse();
-      enableReceive();
+      unsigned long start = micros();
+      sinkUs = 0;
+      capture.segment();
+      capture.fold();
+      matchReceived();
+      analysisUs = micros() - start;
+      if (settings.logFlags & CONFIG_LOG_RAW)
+        printReceived();
+      // before the analyser rewrites a clipped first pulse
+      if ((settings.logFlags & CONFIG_LOG_SUB) || exportNext)
+        exportReceived();
+      if (settings.logFlags & CONFIG_LOG_ANALYSIS)
+        signalanalyse();
+      // everything but the analyser is file I/O
+      pipeline.burst(analysisUs, micros() - start - analysisUs);
+      RadioCommand cmd = {};
+      cmd.type = RADIO_CMD_REARM_RX;
+      // Hands the capture back; waited for so the next pass does not see
+      // this burst again
+      radioSubmit(cmd, RADIO_REPLY_MS);
       delay(700);
     }
   }
-  if (jammer_tx == "1") {
-    if (tmp_module == "1") {
-      for (int i = 0; i + 1 < jammer_len; i += 2) {
-        digitalWrite(tx_pin1, HIGH);
-        delayMicroseconds(jammer[i]);
-        digitalWrite(tx_pin1, LOW);
-        delayMicroseconds(jammer[i + 1]);
-      }
-    } else if (tmp_module == "2") {
-      for (int i = 0; i + 1 < jammer_len; i += 2) {
-        digitalWrite(tx_pin2, HIGH);
-        delayMicroseconds(jammer[i]);
-        digitalWrite(tx_pin2, LOW);
-        delayMicroseconds(jammer[i + 1]);
-      }
-    }
-  }
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "metrics.h"
+#include <LittleFS.h>
+#include <SD.h>
+#include <atomic>
+
+static MetricsHooks hooks;
+static SemaphoreHandle_t lock = NULL;
+static TaskHandle_t task = NULL;
+
+// Double buffered snapshot, the front one is only replaced under lock
+static char snapshot[2][METRICS_JSON_SIZE];
+static size_t length[2] = {0, 0};
+// Where the state starts in each buffer, after the per-second readings
+static size_t stateAt[2] = {0, 0};
+static uint8_t front = 0;
+static uint32_t seq = 0;
+
+// Filesystem usage, owned by the collector
+static std::atomic<int32_t> sdDelta(0);
+static std::atomic<bool> flashDirty(true);
+static bool sdPresent = false;
+static uint64_t sdSize = 0;
+static uint64_t sdUsed = 0;
+static size_t flashFree = 0;
+
+// ==========================================
+// COLLECTOR
+// ==========================================
+static void measureFs(void) {
+  if (flashDirty.exchange(false))
+    flashFree = LittleFS.totalBytes() - LittleFS.usedBytes();
+
+  int32_t delta = sdDelta.exchange(0);
+  if (delta < 0 && (uint64_t)-delta > sdUsed)
+    sdUsed = 0;
+  else
+    sdUsed += delta;
+}
+
+// Uptime, temperature and free heap move every second. They come first,
+// and *state is set to where the rest starts: only that part decides
+// whether the snapshot, and with it the ETag, changed.
+static size_t render(char *buf, size_t *state) {
+  MetricsApp app = {};
+  if (hooks.app != NULL)
+    hooks.app(app);
+
+  int n = snprintf(buf, METRICS_JSON_SIZE,
+                   "{\"uptime\":%lu,\"temperature\":%.2f,\"freeram\":%lu,",
+                   millis() / 1000, temperatureRead(),
+                   (unsigned long)ESP.getFreeHeap());
+  if (n <= 0 || n >= METRICS_JSON_SIZE)
+    return 0;
+  *state = n;
+
+  const double gb = 1024.0 * 1024.0 * 1024.0;
+  uint64_t sdFree = sdSize > sdUsed ? sdSize - sdUsed : 0;
+  n += snprintf(
+      buf + n, METRICS_JSON_SIZE - n,
+      "\"cpu0\":%lu,\"cpu1\":%lu,"
+      "\"freespiffs\":%lu,\"sdcard_size_gb\":%.2f,\"sdcard_free_gb\":%.2f,"
+      "\"sdcard_present\":%s,\"totalram\":%lu,"
+      "\"mode\":\"%s\",\"ssid\":\"%s\",\"ipaddress\":\"%s\","
+      "\"rx_active\":%s,\"tx_active\":%s,\"current_freq\":%.2f",
+      (unsigned long)getCpuFrequencyMhz(),
+      (unsigned long)getXtalFrequencyMhz(), (unsigned long)flashFree,
+      sdSize / gb, sdFree / gb, sdPresent ? "true" : "false",
+      (unsigned long)ESP.getHeapSize(), app.mode, app.ssid, app.ip,
+      app.rxActive ? "true" : "false", app.txActive ? "true" : "false",
+      app.frequency);
+  if (hooks.extra != NULL && n > 0 && n < METRICS_JSON_SIZE)
+    n += hooks.extra(buf + n, METRICS_JSON_SIZE - n);
+  if (n <= 0 || n >= METRICS_JSON_SIZE - 1)
+    return 0; // truncated, keep the previous snapshot
+  buf[n++] = '}';
+  buf[n] = 0;
+  return n;
+}
+
+// Renders into the back buffer and flips it to the front. The sequence
+// number only moves when the state part differs.
+static void publish(void) {
+  uint8_t back = front ^ 1;
+  size_t state = 0;
+  size_t n = render(snapshot[back], &state);
+  if (n == 0)
+    return;
+  size_t was = length[front] - stateAt[front];
+  bool changed = n - state != was ||
+                 memcmp(snapshot[back] + state,
+                        snapshot[front] + stateAt[front], was);
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  length[back] = n;
+  stateAt[back] = state;
+  front = back;
+  if (changed)
+    seq++;
+  xSemaphoreGive(lock);
+}
+
+static void metricsTask(void *arg) {
+  // Walking the FAT can take seconds on a large card, so it happens here
+  // once instead of on a request
+  if (sdPresent)
+    sdUsed = SD.usedBytes();
+
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    measureFs();
+    publish();
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(METRICS_PERIOD_MS));
+  }
+}
+
+// ==========================================
+// PUBLIC API
+// ==========================================
+void metricsBegin(const MetricsHooks &h) {
+  if (task != NULL)
+    return;
+  hooks = h;
+  lock = xSemaphoreCreateMutex();
+  seq = esp_random(); // ETags from before a reboot never match
+  sdPresent = SD.cardType() != CARD_NONE;
+  sdSize = sdPresent ? SD.cardSize() : 0;
+  measureFs();
+  publish();
+  xTaskCreatePinnedToCore(metricsTask, "metrics", METRICS_TASK_STACK, NULL,
+                          METRICS_TASK_PRIORITY, &task, METRICS_TASK_CORE);
+}
+
+uint32_t metricsWrite(Print &out) {
+  if (lock == NULL)
+    return 0;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  out.write((const uint8_t *)snapshot[front], length[front]);
+  uint32_t s = seq;
+  xSemaphoreGive(lock);
+  return s;
+}
+
+uint32_t metricsSeq(void) {
+  if (lock == NULL)
+    return 0;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  uint32_t s = seq;
+  xSemaphoreGive(lock);
+  return s;
+}
+
+void metricsSdChanged(int32_t bytes) { sdDelta += bytes; }
+
+void metricsFlashChanged(void) { flashDirty = true; }
@@ -0,0 +1,52 @@
+#ifndef METRICS_h
+#define METRICS_h
+
+#include <Arduino.h>
+
+// ==========================================
+// METRICS COLLECTOR
+// ==========================================
+// /stats used to remount LittleFS, query the SD card and concatenate
+// about 20 Strings on every poll. A low priority task on core 0 now
+// renders the whole /stats document once per period into one of two
+// fixed buffers and publishes it by flipping the front index, so a poll
+// only copies the current snapshot.
+//
+// Filesystem usage is measured once at start. SD usage is then kept up
+// to date from the byte counts reported by the writers, flash usage is
+// re-read only after metricsFlashChanged().
+
+#define METRICS_PERIOD_MS 1000
+#define METRICS_JSON_SIZE 1536
+#define METRICS_TASK_STACK 4096
+#define METRICS_TASK_PRIORITY 1
+#define METRICS_TASK_CORE 0
+
+// Application state sampled by the collector
+struct MetricsApp {
+  char mode[8];
+  char ssid[33];
+  char ip[16];
+  bool rxActive;
+  bool txActive;
+  float frequency;
+};
+
+struct MetricsHooks {
+  void (*app)(MetricsApp &app);
+  // Writes extra members (",\"name\":value...") into buf, returns the
+  // length like snprintf()
+  int (*extra)(char *buf, size_t size);
+};
+
+void metricsBegin(const MetricsHooks &hooks);
+// Writes the current snapshot and returns its sequence number (0 before
+// metricsBegin()). It changes only when the state does, not with the
+// uptime, temperature and free heap readings, so it can be the ETag.
+uint32_t metricsWrite(Print &out);
+uint32_t metricsSeq(void);
+// Bytes added (negative: removed) on the SD card
+void metricsSdChanged(int32_t bytes);
+void metricsFlashChanged(void);
+
+#endif
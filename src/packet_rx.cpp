@@ -0,0 +1,142 @@
+#include "packet_rx.h"
+#include "radio_service.h"
+
+PacketReceiver packetrx;
+
+static void IRAM_ATTR packetInterrupt(void) { packetrx.interrupt(); }
+
+// ==========================================
+// START / STOP
+// ==========================================
+bool PacketReceiver::begin(ELECHOUSE_CC1101 &rf, byte module, byte gdo0,
+                           byte gdo2, const PacketRxParams &p) {
+  if (module > 1 || p.length > PACKET_RX_MAX || p.syncmode == 0 ||
+      p.syncmode > 7)
+    return false;
+  if (queue == NULL)
+    queue = xQueueCreate(PACKET_RX_QUEUE, sizeof(RxPacket));
+  if (queue == NULL)
+    return false;
+  stop();
+
+  radio = &rf;
+  modul = module;
+  gdo0Pin = gdo0;
+  gdo2Pin = gdo2;
+  params = p;
+  memset(&stats, 0, sizeof(stats));
+
+  radio->setSidle();
+  if (p.mod == 2)
+    radio->setDcFilterOff(0);
+  else if (p.mod == 0)
+    radio->setDcFilterOff(1);
+  radio->setModulation(p.mod);
+  radio->setMHZ(p.frequency);
+  radio->setDeviation(p.deviation);
+  radio->setRxBW(p.setrxbw);
+  radio->setDRate(p.datarate);
+  radio->setSyncMode(p.syncmode);
+  radio->setSyncWord(p.sync >> 8, p.sync & 0xFF);
+  radio->setCrc(p.crc);
+  radio->SpiWriteReg(CC1101_IOCFG2, 0x00); // RX FIFO at threshold
+  radio->SpiWriteReg(CC1101_IOCFG0, 0x06); // sync word .. end of packet
+  radio->setFifoThreshold(PACKET_RX_FIFO_THR);
+
+  irq = false;
+  pinMode(gdo0Pin, INPUT);
+  pinMode(gdo2Pin, INPUT);
+  attachInterrupt(gdo2Pin, packetInterrupt, RISING);
+  attachInterrupt(gdo0Pin, packetInterrupt, FALLING);
+  radio->BeginPacketRx(work.data, PACKET_RX_MAX, p.length);
+  running = true;
+  return true;
+}
+
+// Back to the asynchronous serial mode the rest of the firmware expects
+void PacketReceiver::stop(void) {
+  if (!running)
+    return;
+  detachInterrupt(gdo0Pin);
+  detachInterrupt(gdo2Pin);
+  running = false;
+  irq = false;
+  radio->EndPacketRx();
+  radio->setCCMode(0);
+}
+
+bool PacketReceiver::restart(void) {
+  PacketRxStats kept = stats;
+  if (radio == NULL || !begin(*radio, modul, gdo0Pin, gdo2Pin, params))
+    return false;
+  stats = kept;
+  return true;
+}
+
+// ==========================================
+// FIFO SERVICE
+// ==========================================
+void IRAM_ATTR PacketReceiver::interrupt(void) {
+  irq = true;
+  radioWakeFromISR();
+}
+
+byte PacketReceiver::service(void) {
+  byte queued = 0;
+  if (!running)
+    return queued;
+  irq = false;
+  stats.wakeups++;
+  for (;;) {
+    CC1101PacketStatus status;
+    int n = radio->ServicePacketRx(status);
+    if (n == CC1101_RX_PENDING)
+      return queued;
+    if (n == CC1101_RX_OVERFLOW) {
+      stats.overflows++;
+      continue;
+    }
+    if (n == CC1101_RX_TOO_LONG) {
+      stats.tooLong++;
+      continue;
+    }
+    work.millis = millis();
+    work.module = modul;
+    work.rssi = status.rssi;
+    work.lqi = status.lqi;
+    work.crcOk = status.crcOk;
+    work.length = n;
+    stats.packets++;
+    stats.bytes += n;
+    if (!status.crcOk)
+      stats.crcErrors++;
+    if (xQueueSend(queue, &work, 0) == pdTRUE)
+      queued++;
+    else
+      stats.dropped++;
+  }
+}
+
+bool PacketReceiver::receive(RxPacket &packet, TickType_t wait) {
+  return queue != NULL && xQueueReceive(queue, &packet, wait) == pdTRUE;
+}
+
+String PacketReceiver::statsJson(void) const {
+  String json = "{";
+  json += "\"active\":" + String(running ? "true" : "false");
+  json += ",\"module\":" + String(modul + 1);
+  json += ",\"frequency\":" + String(params.frequency);
+  json += ",\"datarate\":" + String(params.datarate);
+  json += ",\"length\":" + String(params.length);
+  json += ",\"packets\":" + String(stats.packets);
+  json += ",\"bytes\":" + String(stats.bytes);
+  json += ",\"crc_errors\":" + String(stats.crcErrors);
+  json += ",\"overflows\":" + String(stats.overflows);
+  json += ",\"too_long\":" + String(stats.tooLong);
+  json += ",\"dropped\":" + String(stats.dropped);
+  json += ",\"wakeups\":" + String(stats.wakeups);
+  json += ",\"queued\":" +
+          String(queue ? uxQueueMessagesWaiting(queue) : 0);
+  json += "}";
+  return json;
+}
@@ -0,0 +1,92 @@
+#ifndef PACKET_RX_h
+#define PACKET_RX_h
+
+#include <Arduino.h>
+#include "ELECHOUSE_CC1101_SRC_DRV.h"
+
+// ==========================================
+// PACKET MODE RECEIVER
+// ==========================================
+// Lets the CC1101 packet engine do sync detection, framing and CRC,
+// instead of timing GDO edges in software, so FSK telemetry at rates the
+// edge interrupt cannot follow can be captured. GDO2 signals the RX FIFO
+// threshold and GDO0 the end of a packet; both interrupts only wake the
+// radio task, which burst-reads the FIFO in chunks
+// (ELECHOUSE_CC1101::ServicePacketRx) and so handles packets longer than
+// the 64 byte FIFO. Complete packets go into a queue with their RSSI,
+// LQI and CRC status; loop() is the consumer.
+//
+// The module stays in RX between packets. Packet RX and the raw capture
+// exclude each other: starting one stops the other.
+
+#define PACKET_RX_MAX 512     // payload bytes
+#define PACKET_RX_QUEUE 8     // packets waiting for the consumer
+#define PACKET_RX_FIFO_THR 7  // FIFOTHR: wake up at 32 bytes
+
+struct PacketRxParams {
+  float frequency; // MHz
+  float setrxbw;   // kHz
+  float deviation; // kHz
+  int mod;
+  float datarate;  // kBaud
+  uint16_t sync;
+  byte syncmode;   // MDMCFG2.SYNC_MODE, 1..7
+  uint16_t length; // fixed payload length, 0: length byte
+  bool crc;
+};
+
+struct RxPacket {
+  uint32_t millis;
+  byte module;
+  int8_t rssi;
+  byte lqi;
+  bool crcOk;
+  uint16_t length;
+  byte data[PACKET_RX_MAX];
+};
+
+struct PacketRxStats {
+  uint32_t packets;
+  uint32_t bytes;
+  uint32_t crcErrors;
+  uint32_t overflows;
+  uint32_t tooLong;
+  uint32_t dropped;   // queue full
+  uint32_t wakeups;
+};
+
+class PacketReceiver {
+public:
+  bool begin(ELECHOUSE_CC1101 &radio, byte module, byte gdo0, byte gdo2,
+             const PacketRxParams &params);
+  void stop(void);
+  // Same settings again, after a transmission on the module
+  bool restart(void);
+  bool active(void) const { return running; }
+  byte module(void) const { return modul; }
+  // From the GDO interrupts
+  void IRAM_ATTR interrupt(void);
+  bool pending(void) const { return irq; }
+  // Radio task: drains the FIFO, queues complete packets and returns
+  // how many
+  byte service(void);
+  // Consumer side
+  bool receive(RxPacket &packet, TickType_t wait);
+  String statsJson(void) const;
+
+private:
+  ELECHOUSE_CC1101 *radio = NULL;
+  QueueHandle_t queue = NULL;
+  PacketRxParams params = {};
+  byte modul = 0;
+  byte gdo0Pin = 0;
+  byte gdo2Pin = 0;
+  bool running = false;
+  volatile bool irq = false;
+  RxPacket work;
+  PacketRxStats stats = {};
+};
+
+extern PacketReceiver packetrx;
+
+#endif
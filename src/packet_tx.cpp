@@ -0,0 +1,126 @@
+#include "packet_tx.h"
+#include "radio_service.h"
+
+PacketTransmitter packettx;
+
+static void IRAM_ATTR packetTxInterrupt(void) { packettx.interrupt(); }
+
+// ==========================================
+// START / FINISH
+// ==========================================
+// Takes over params.data (set to NULL) on success
+bool PacketTransmitter::begin(ELECHOUSE_CC1101 &rf, byte module, byte gdo0,
+                              byte gdo2, PacketTxParams &p) {
+  if (running || module > 1 || p.data == NULL || p.count == 0 ||
+      p.count > PACKET_TX_MAX || p.syncmode == 0 || p.syncmode > 7 ||
+      p.datarate <= 0)
+    return false;
+
+  radio = &rf;
+  modul = module;
+  gdo0Pin = gdo0;
+  gdo2Pin = gdo2;
+  data = p.data;
+  count = p.count;
+  p.data = NULL;
+
+  // Whatever the module was set up for, see finish()
+  radio->getPreset(saved);
+  savedPa = radio->getPA();
+  radio->setSidle();
+  radio->setModulation(p.mod);
+  radio->setMHZ(p.frequency);
+  radio->setDeviation(p.deviation);
+  radio->setDRate(p.datarate);
+  radio->setPA(p.power);
+  radio->setSyncMode(p.syncmode);
+  radio->setSyncWord(p.sync >> 8, p.sync & 0xFF);
+  radio->setCrc(p.crc);
+  radio->SpiWriteReg(CC1101_IOCFG2, 0x02); // TX FIFO at threshold
+  radio->SpiWriteReg(CC1101_IOCFG0, 0x06); // sync word .. end of packet
+  radio->setFifoThreshold(PACKET_TX_FIFO_THR);
+
+  irq = false;
+  pinMode(gdo0Pin, INPUT);
+  pinMode(gdo2Pin, INPUT);
+  attachInterrupt(gdo2Pin, packetTxInterrupt, FALLING);
+  attachInterrupt(gdo0Pin, packetTxInterrupt, FALLING);
+  // Air time in ms: bits / kBaud, with preamble, sync and CRC
+  unsigned long airMs = (unsigned long)((count + 16) * 8 / p.datarate);
+  started = micros();
+  deadline = millis() + 2 * airMs + PACKET_TX_MARGIN_MS;
+  running = true;
+  radio->BeginPacketTx(data, count, p.lengthByte);
+  return true;
+}
+
+// Back to the registers from before begin(): the receive mode a
+// transmission interrupted resumes on its own data rate and bandwidth.
+// The PATABLE is not part of the preset, setPA() rebuilds it for the
+// restored band and modulation.
+void PacketTransmitter::finish(void) {
+  detachInterrupt(gdo0Pin);
+  detachInterrupt(gdo2Pin);
+  running = false;
+  irq = false;
+  delete[] data;
+  data = NULL;
+  radio->EndPacketTx();
+  radio->setPreset(saved);
+  radio->setPA(savedPa);
+}
+
+void PacketTransmitter::abort(void) {
+  if (!running)
+    return;
+  finish();
+}
+
+// ==========================================
+// FIFO SERVICE
+// ==========================================
+void IRAM_ATTR PacketTransmitter::interrupt(void) {
+  irq = true;
+  radioWakeFromISR();
+}
+
+int PacketTransmitter::service(void) {
+  if (!running)
+    return CC1101_TX_PENDING;
+  irq = false;
+  stats.wakeups++;
+  int result = radio->ServicePacketTx();
+  if (result == CC1101_TX_PENDING)
+    return result;
+  if (result == CC1101_TX_DONE) {
+    stats.packets++;
+    stats.bytes += count;
+    stats.last_us = micros() - started;
+  } else {
+    stats.underflows++;
+  }
+  finish();
+  return result;
+}
+
+bool PacketTransmitter::expired(void) {
+  if (!running || (long)(millis() - deadline) < 0)
+    return false;
+  stats.timeouts++;
+  finish();
+  return true;
+}
+
+String PacketTransmitter::statsJson(void) const {
+  String json = "{";
+  json += "\"active\":" + String(running ? "true" : "false");
+  json += ",\"module\":" + String(modul + 1);
+  json += ",\"packets\":" + String(stats.packets);
+  json += ",\"bytes\":" + String(stats.bytes);
+  json += ",\"underflows\":" + String(stats.underflows);
+  json += ",\"timeouts\":" + String(stats.timeouts);
+  json += ",\"wakeups\":" + String(stats.wakeups);
+  json += ",\"last_us\":" + String(stats.last_us);
+  json += "}";
+  return json;
+}
@@ -0,0 +1,87 @@
+#ifndef PACKET_TX_h
+#define PACKET_TX_h
+
+#include <Arduino.h>
+#include "ELECHOUSE_CC1101_SRC_DRV.h"
+
+// ==========================================
+// STREAMING PACKET TRANSMITTER
+// ==========================================
+// Sends one packet of any length through the CC1101 packet engine. The
+// TX FIFO is filled before STX and then refilled whenever it drains below
+// its threshold (GDO2 falling), so payloads longer than the FIFO go out
+// in infinite length mode. GDO0 falls at the end of the packet. Both
+// interrupts only wake the radio task, which does the SPI work, so no
+// core busy-waits while the packet is on air.
+//
+// The radio service completes the submitting command when the packet is
+// done: RADIO_OK, RADIO_ERR_UNDERFLOW when the FIFO ran empty, or
+// RADIO_ERR_TIMEOUT when the end of packet never came.
+
+#define PACKET_TX_MAX 4096        // payload bytes
+#define PACKET_TX_FIFO_THR 7      // FIFOTHR: refill below 33 bytes
+#define PACKET_TX_MARGIN_MS 100   // on top of twice the air time
+
+// data is allocated with new[] by the submitter and released by the
+// transmitter once the packet is done.
+struct PacketTxParams {
+  float frequency; // MHz
+  float deviation; // kHz
+  int mod;
+  float datarate;  // kBaud
+  int power;       // dBm
+  uint16_t sync;
+  byte syncmode;   // MDMCFG2.SYNC_MODE, 1..7
+  bool crc;
+  bool lengthByte; // variable length packet, up to 255 bytes
+  uint16_t count;
+  byte *data;
+};
+
+struct PacketTxStats {
+  uint32_t packets;
+  uint32_t bytes;
+  uint32_t underflows;
+  uint32_t timeouts;
+  uint32_t wakeups;
+  uint32_t last_us;  // STX to end of packet
+};
+
+class PacketTransmitter {
+public:
+  bool begin(ELECHOUSE_CC1101 &radio, byte module, byte gdo0, byte gdo2,
+             PacketTxParams &params);
+  bool active(void) const { return running; }
+  byte module(void) const { return modul; }
+  void IRAM_ATTR interrupt(void);
+  bool pending(void) const { return irq; }
+  // Radio task: refills the FIFO. Returns CC1101_TX_PENDING while the
+  // packet is on air, then CC1101_TX_DONE or CC1101_TX_UNDERFLOW once.
+  int service(void);
+  // Radio task: true once the end of packet is overdue, the packet is
+  // then aborted
+  bool expired(void);
+  void abort(void);
+  String statsJson(void) const;
+
+private:
+  void finish(void);
+
+  ELECHOUSE_CC1101 *radio = NULL;
+  byte modul = 0;
+  byte gdo0Pin = 0;
+  byte gdo2Pin = 0;
+  bool running = false;
+  volatile bool irq = false;
+  byte *data = NULL;
+  uint16_t count = 0;
+  unsigned long started = 0;
+  unsigned long deadline = 0;
+  PacketTxStats stats = {};
+  byte saved[CC1101_CONFIG_SIZE];
+  int savedPa = 0;
+};
+
+extern PacketTransmitter packettx;
+
+#endif
@@ -0,0 +1,129 @@
+#include "pipeline_stats.h"
+#include <inttypes.h>
+
+PipelineStats pipeline;
+
+static void writeU16(Print &out, uint16_t v) {
+  uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+  out.write(b, 2);
+}
+
+static void writeU32(Print &out, uint32_t v) {
+  uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16),
+                  (uint8_t)(v >> 24)};
+  out.write(b, 4);
+}
+
+// ==========================================
+// HOT PATH
+// ==========================================
+// Called last in receiver() with the cycle count taken on entry and the
+// GDO level read there.
+void IRAM_ATTR PipelineStats::isr(uint32_t start, uint8_t level) {
+  uint32_t spent = ESP.getCycleCount() - start;
+  uint8_t bucket = spent ? 31 - __builtin_clz(spent) : 0;
+  if (bucket >= PIPELINE_HIST_BUCKETS)
+    bucket = PIPELINE_HIST_BUCKETS - 1;
+
+  isrCalls++;
+  hist[bucket]++;
+  if (spent > cyclesMax)
+    cyclesMax = spent;
+  if (level == lastLevel)
+    levelRepeats++;
+  lastLevel = level;
+}
+
+// Called from loop() once a burst has been logged
+void PipelineStats::burst(uint32_t analysisUs, uint32_t sdUs) {
+  uint32_t second = millis() / 1000;
+  uint8_t slot = second % PIPELINE_RATE_SLOTS;
+  if (rateSecond[slot] != second) {
+    rateSecond[slot] = second;
+    rate[slot] = 0;
+  }
+  rate[slot]++;
+
+  bursts++;
+  analysisTotal += analysisUs;
+  if (analysisUs > analysisMax)
+    analysisMax = analysisUs;
+  sdTotal += sdUs;
+  if (sdUs > sdMax)
+    sdMax = sdUs;
+}
+
+// Bursts per second * 100 over the last PIPELINE_RATE_SLOTS seconds
+uint16_t PipelineStats::burstRate(void) {
+  uint32_t second = millis() / 1000;
+  uint32_t n = 0;
+  for (uint8_t i = 0; i < PIPELINE_RATE_SLOTS; i++)
+    if (second - rateSecond[i] < PIPELINE_RATE_SLOTS)
+      n += rate[i];
+  return n * 100 / PIPELINE_RATE_SLOTS;
+}
+
+// ==========================================
+// REPORTING
+// ==========================================
+int PipelineStats::print(char *buf, size_t size,
+                         const SignalCapture &capture) {
+  const CaptureCounters &c = capture.counters;
+  uint16_t rate100 = burstRate();
+  int n = snprintf(buf, size,
+                   "{\"isr_calls\":%" PRIu32 ",\"level_repeats\":%" PRIu32
+                   ",\"isr_cycles_max\":%" PRIu32 ",\"isr_cycles_log2\":[",
+                   isrCalls, levelRepeats, cyclesMax);
+  for (uint8_t i = 0; i < PIPELINE_HIST_BUCKETS && n < (int)size; i++)
+    n += snprintf(buf + n, size - n, "%s%" PRIu32, i ? "," : "", hist[i]);
+  if (n < (int)size)
+    n += snprintf(
+        buf + n, size - n,
+        "],\"edges_accepted\":%" PRIu32 ",\"edges_rejected\":%" PRIu32
+        ",\"overruns\":%" PRIu32 ",\"edges_merged\":%" PRIu32
+        ",\"edges_noisy\":%" PRIu32 ",\"noise_bursts\":%" PRIu32
+        ",\"short_bursts\":%" PRIu32 ",\"glitch_us\":%lu,\"bursts\":%" PRIu32
+        ",\"bursts_per_s\":%u.%02u,\"analysis_us_avg\":%" PRIu32
+        ",\"analysis_us_max\":%" PRIu32 ",\"sd_us_avg\":%" PRIu32
+        ",\"sd_us_max\":%" PRIu32 "}",
+        c.accepted, c.rejected, c.overruns, c.merged, c.noisy, c.noiseBursts,
+        c.shortBursts, capture.glitchUs(), bursts,
+        rate100 / 100, rate100 % 100, bursts ? analysisTotal / bursts : 0,
+        analysisMax, bursts ? sdTotal / bursts : 0, sdMax);
+  return n;
+}
+
+void PipelineStats::writeBlock(Print &out, const SignalCapture &capture) {
+  const CaptureCounters &c = capture.counters;
+  out.write((const uint8_t *)"PIPE", 4);
+  uint8_t head[2] = {PIPELINE_BLOCK_VERSION, PIPELINE_HIST_BUCKETS};
+  out.write(head, 2);
+  writeU16(out, getCpuFrequencyMhz());
+  writeU32(out, millis());
+
+  writeU32(out, isrCalls);
+  writeU32(out, levelRepeats);
+  writeU32(out, cyclesMax);
+
+  writeU32(out, c.accepted);
+  writeU32(out, c.rejected);
+  writeU32(out, c.overruns);
+
+  writeU32(out, c.merged);
+  writeU32(out, c.noisy);
+  writeU32(out, c.noiseBursts);
+  writeU32(out, c.shortBursts);
+  writeU32(out, capture.glitchUs());
+
+  writeU32(out, bursts);
+  writeU16(out, burstRate());
+  writeU16(out, 0);
+
+  writeU32(out, analysisTotal);
+  writeU32(out, analysisMax);
+  writeU32(out, sdTotal);
+  writeU32(out, sdMax);
+
+  for (uint8_t i = 0; i < PIPELINE_HIST_BUCKETS; i++)
+    writeU32(out, hist[i]);
+}
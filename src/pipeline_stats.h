@@ -0,0 +1,71 @@
+#ifndef PIPELINE_STATS_h
+#define PIPELINE_STATS_h
+
+#include <Arduino.h>
+#include "SignalCapture.h"
+
+// ==========================================
+// RX PIPELINE INSTRUMENTATION
+// ==========================================
+// Always-on counters for the raw capture path, cheap enough for the edge
+// interrupt: a handful of increments and one cycle counter read per edge.
+//   ISR        invocations, cycles spent in receiver() as a log2
+//              histogram, and level repeats: two interrupts in a row that
+//              see the same GDO level mean an edge was missed because the
+//              handler ran too late (firmware side, not RF)
+//   capture    edges accepted, dropped or merged as glitches and over the
+//              rate ceiling, bursts discarded as noise or too short, buffer
+//              overruns (SignalCapture::counters) and the glitch threshold
+//   processing bursts, bursts per second over the last 10 s, time spent
+//              in analysis and in SD writes per burst
+//
+// Edge-to-entry latency cannot be read back in software, so the
+// histogram covers the handler itself and the level repeats count the
+// cases where entry was later than the next edge.
+
+#define PIPELINE_HIST_BUCKETS 16 // bucket n: 2^n <= cycles < 2^(n+1)
+#define PIPELINE_RATE_SLOTS 10   // one per second
+
+// /pipelinestats block, little-endian:
+//   header   "PIPE", u8 version, u8 buckets, u16 cpu_mhz, u32 uptime_ms
+//   isr      u32 calls, u32 level_repeats, u32 cycles_max
+//   capture  u32 accepted, u32 rejected, u32 overruns
+//   filter   u32 merged, u32 noisy, u32 noise_bursts, u32 short_bursts,
+//            u32 glitch_us
+//   bursts   u32 bursts, u16 bursts_per_s * 100, u16 reserved
+//   time     u32 analysis_us_total, u32 analysis_us_max,
+//            u32 sd_us_total, u32 sd_us_max
+//   hist     u32[buckets]
+#define PIPELINE_BLOCK_VERSION 2
+
+class PipelineStats {
+public:
+  // Start of a listening period; the next level is not compared
+  void arm(void) { lastLevel = 2; }
+  static uint32_t IRAM_ATTR cycles(void) { return ESP.getCycleCount(); }
+  void IRAM_ATTR isr(uint32_t start, uint8_t level);
+  void burst(uint32_t analysisUs, uint32_t sdUs);
+  // JSON object into buf, returns the length like snprintf()
+  int print(char *buf, size_t size, const SignalCapture &capture);
+  void writeBlock(Print &out, const SignalCapture &capture);
+
+private:
+  uint16_t burstRate(void);
+
+  volatile uint32_t isrCalls = 0;
+  volatile uint32_t levelRepeats = 0;
+  volatile uint32_t cyclesMax = 0;
+  volatile uint32_t hist[PIPELINE_HIST_BUCKETS] = {};
+  volatile uint8_t lastLevel = 2;
+  uint32_t bursts = 0;
+  uint32_t analysisTotal = 0;
+  uint32_t analysisMax = 0;
+  uint32_t sdTotal = 0;
+  uint32_t sdMax = 0;
+  uint16_t rate[PIPELINE_RATE_SLOTS] = {};
+  uint32_t rateSecond[PIPELINE_RATE_SLOTS] = {};
+};
+
+extern PipelineStats pipeline;
+
+#endif
@@ -0,0 +1,542 @@
+#include "radio_service.h"
+#include "board.h"
+#include <atomic>
+
+// Completion notifications carry (seq << 8) | result, so a waiter that
+// timed out earlier can tell a late completion apart from its own.
+#define RADIO_SEQ_MASK 0x00FFFFFF
+
+static const char *const radioCommandNames[RADIO_CMD_COUNT] = {
+    "set_rx",     "stop_rx",   "rearm_rx",   "tx_raw",      "set_jammer",
+    "stop_jammer", "start_hop", "stop_hop",  "start_sweep", "stop_sweep",
+    "start_packet_rx", "stop_packet_rx", "tx_packet", "wake"};
+
+static ELECHOUSE_CC1101 *radios = NULL;
+static RadioHooks hooks;
+static QueueHandle_t queue = NULL;
+static TaskHandle_t task = NULL;
+static std::atomic<uint32_t> nextSeq(0);
+static std::atomic<bool> wakePending(false);
+static RadioCommandStats stats[RADIO_CMD_COUNT];
+
+// State owned by the radio task
+static bool rxArmed = false;
+static byte rxModule = 0;
+// Last /setrx preset per module, reapplied when a transmission ends
+static RadioRxParams rxParams[2];
+static bool jamming = false;
+static byte jamModule = 0;
+static const byte jamPattern[] = {0xff, 0xff};
+// Streamed packet, completed when the transmitter is done
+static RadioCommand txCommand;
+static uint32_t txStarted = 0;
+
+// ==========================================
+// COMMAND EXECUTION
+// ==========================================
+static void servicePacketRx(void);
+static void serviceTx(void);
+
+static void applyRx(ELECHOUSE_CC1101 &radio, const RadioRxParams &p) {
+  radio.setSidle();
+  if (p.mod == 2) {
+    radio.setDcFilterOff(0);
+  } else if (p.mod == 0) {
+    radio.setDcFilterOff(1);
+    radio.setDeviation(p.deviation);
+  }
+  radio.setModulation(p.mod);
+  radio.setMHZ(p.frequency);
+  radio.setSyncMode(0);
+  radio.setPktFormat(3);
+  radio.setRxBW(p.setrxbw);
+  radio.setDRate(p.datarate);
+}
+
+// GDO0 is the TX data input; take it back from carrier-sense gating
+static void releaseGdo0(byte m) {
+  if (rxArmed && rxModule == m)
+    hooks.disarmCapture();
+  if (radios[m].getShadowReg(CC1101_IOCFG0) == 0x0E)
+    radios[m].setCarrierSense(false, 0);
+}
+
+// Alternating high/low widths in us on GDO0 of the module on pin P, each
+// edge a single GPIO register store
+template <byte P, typename T>
+static void sendPulses(const T *widths, uint16_t count) {
+  for (uint16_t i = 0; i + 1 < count; i += 2) {
+    FastPin<P>::high();
+    delayMicroseconds(widths[i]);
+    FastPin<P>::low();
+    delayMicroseconds(widths[i + 1]);
+  }
+  if (count & 1) {
+    FastPin<P>::high();
+    delayMicroseconds(widths[count - 1]);
+    FastPin<P>::low();
+  }
+}
+
+template <typename T>
+static void sendPulses(byte m, const T *widths, uint16_t count) {
+  if (m)
+    sendPulses<Board::gdo0(1)>(widths, count);
+  else
+    sendPulses<Board::gdo0(0)>(widths, count);
+}
+
+static void transmitRaw(byte m, const RadioTxParams &p) {
+  ELECHOUSE_CC1101 &radio = radios[m];
+  releaseGdo0(m);
+  radio.setSidle();
+  radio.setModulation(p.mod);
+  radio.setMHZ(p.frequency);
+  radio.setDeviation(p.deviation);
+  radio.SetTx();
+  pinMode(Board::gdo0(m), OUTPUT);
+  sendPulses(m, p.data, p.count);
+  radio.setSidle();
+}
+
+// ==========================================
+// MODE CHANGES
+// ==========================================
+// Each one leaves radiostate consistent with what it stopped. The raw
+// capture and packet RX exclude each other (the capture interrupt sits on
+// the GDO2 line of both modules), and there is one sweep at a time.
+
+// The raw capture, plain or hopping. Suspended by a transmission, it is
+// just not resumed.
+static void stopCapture(void) {
+  if (!rxArmed)
+    return;
+  rxhopper.stop();
+  hooks.disarmCapture();
+  rxArmed = false;
+  if (radiostate.suspended(rxModule) == RADIO_MODE_RX_ASYNC) {
+    radiostate.cancelResume(rxModule);
+    return;
+  }
+  radios[rxModule].setSidle();
+  radiostate.enter(rxModule, RADIO_MODE_IDLE);
+}
+
+static void stopPacket(void) {
+  for (byte m = 0; m < 2; m++)
+    if (radiostate.suspended(m) == RADIO_MODE_RX_PACKET)
+      radiostate.cancelResume(m);
+  if (!packetrx.active())
+    return;
+  packetrx.stop();
+  radiostate.enter(packetrx.module(), RADIO_MODE_IDLE);
+}
+
+static void stopSweep(void) {
+  if (!spectrum.active())
+    return;
+  spectrum.stop();
+  radiostate.enter(spectrum.module(), RADIO_MODE_IDLE);
+}
+
+// Whatever runs on m, before it is given something else
+static void stopModule(byte m) {
+  if (rxArmed && rxModule == m)
+    stopCapture();
+  if (packetrx.active() && packetrx.module() == m)
+    stopPacket();
+  if (spectrum.active() && spectrum.module() == m)
+    stopSweep();
+}
+
+// Receiving on m until a transmission there ends; GDO0 becomes TX data
+static void beginTx(byte m) {
+  if (packetrx.active() && packetrx.module() == m)
+    packetrx.stop();
+  releaseGdo0(m);
+  radiostate.enter(m, RADIO_MODE_TX);
+}
+
+// What the capture on m listens with: the hop channel it is on, or the
+// last /setrx preset
+static RadioRxParams rxPreset(byte m) {
+  if (!rxhopper.active() || rxhopper.module() != m)
+    return rxParams[m];
+  const HopChannel &c = rxhopper.current();
+  RadioRxParams p = {c.frequency, c.setrxbw, c.deviation, c.mod, c.datarate};
+  return p;
+}
+
+// The module was idled by a transmission, resume what it was doing. The
+// transmission reprogrammed the modem, so a capture gets its preset back.
+static void endTx(byte m) {
+  RadioMode back = radiostate.endTx(m);
+  if (back == RADIO_MODE_RX_ASYNC) {
+    applyRx(radios[m], rxPreset(m));
+    hooks.armCapture(m);
+  } else if (back == RADIO_MODE_RX_PACKET)
+    packetrx.restart();
+}
+
+// Armed capture that is not suspended by a transmission on its module
+static bool capturing(void) {
+  return rxArmed && radiostate.mode(rxModule) == RADIO_MODE_RX_ASYNC;
+}
+
+// Mode a command puts its module in, RADIO_MODE_COUNT for none
+static RadioMode commandMode(RadioCommandType type) {
+  switch (type) {
+  case RADIO_CMD_SET_RX:
+  case RADIO_CMD_START_HOP:
+    return RADIO_MODE_RX_ASYNC;
+  case RADIO_CMD_START_PACKET_RX:
+    return RADIO_MODE_RX_PACKET;
+  case RADIO_CMD_TX_RAW:
+  case RADIO_CMD_SET_JAMMER:
+  case RADIO_CMD_TX_PACKET:
+    return RADIO_MODE_TX;
+  case RADIO_CMD_START_SWEEP:
+    return RADIO_MODE_SWEEP;
+  default:
+    return RADIO_MODE_COUNT;
+  }
+}
+
+static RadioResult execute(RadioCommand &cmd) {
+  if (cmd.module > 1)
+    return RADIO_ERR_INVALID;
+  RadioMode to = commandMode(cmd.type);
+  if (to != RADIO_MODE_COUNT && !radiostate.allowed(cmd.module, to))
+    return RADIO_ERR_BUSY;
+
+  byte m = cmd.module;
+  switch (cmd.type) {
+  case RADIO_CMD_SET_RX:
+    stopCapture();
+    stopPacket();
+    stopModule(m);
+    applyRx(radios[m], cmd.rx);
+    rxParams[m] = cmd.rx;
+    rxModule = m;
+    rxArmed = true;
+    radiostate.enter(m, RADIO_MODE_RX_ASYNC);
+    hooks.armCapture(rxModule);
+    return RADIO_OK;
+
+  case RADIO_CMD_STOP_RX:
+    stopCapture();
+    stopPacket();
+    return RADIO_OK;
+
+  case RADIO_CMD_REARM_RX:
+    if (!rxArmed)
+      return RADIO_ERR_INVALID;
+    if (!capturing())
+      return RADIO_ERR_BUSY; // endTx() re-arms
+    hooks.armCapture(rxModule);
+    return RADIO_OK;
+
+  case RADIO_CMD_TX_RAW:
+    beginTx(m);
+    transmitRaw(m, cmd.tx);
+    endTx(m);
+    return RADIO_OK;
+
+  case RADIO_CMD_SET_JAMMER: {
+    // One jammer at a time: STOP_JAMMER only knows jamModule
+    if (jamming)
+      return RADIO_ERR_BUSY;
+    ELECHOUSE_CC1101 &radio = radios[m];
+    stopModule(m);
+    releaseGdo0(m);
+    radiostate.enter(m, RADIO_MODE_TX);
+    pinMode(Board::gdo0(m), OUTPUT);
+    radio.setSidle();
+    radio.setModulation(2);
+    radio.setMHZ(cmd.jammer.frequency);
+    radio.setPA(cmd.jammer.power);
+    radio.SetTx();
+    jamModule = m;
+    jamming = true;
+    return RADIO_OK;
+  }
+
+  case RADIO_CMD_STOP_JAMMER:
+    if (jamming) {
+      jamming = false;
+      digitalWrite(Board::gdo0(jamModule), LOW);
+      radios[jamModule].setSidle();
+      radiostate.enter(jamModule, RADIO_MODE_IDLE);
+    }
+    return RADIO_OK;
+
+  case RADIO_CMD_START_HOP:
+    stopCapture();
+    stopPacket();
+    stopModule(m);
+    if (!rxhopper.begin(radios[m], m, cmd.hop.channels, cmd.hop.count,
+                        cmd.hop.sense, cmd.hop.threshold, cmd.hop.maxhold))
+      return RADIO_ERR_INVALID;
+    hooks.channelChanged(rxhopper.current());
+    rxModule = m;
+    rxArmed = true;
+    radiostate.enter(m, RADIO_MODE_RX_ASYNC);
+    hooks.armCapture(rxModule);
+    return RADIO_OK;
+
+  case RADIO_CMD_STOP_HOP:
+    if (rxhopper.active())
+      stopCapture();
+    return RADIO_OK;
+
+  case RADIO_CMD_START_SWEEP:
+    stopSweep();
+    stopModule(m);
+    if (!spectrum.begin(radios[m], cmd.sweep))
+      return RADIO_ERR_INVALID;
+    radiostate.enter(m, RADIO_MODE_SWEEP);
+    return RADIO_OK;
+
+  case RADIO_CMD_STOP_SWEEP:
+    stopSweep();
+    return RADIO_OK;
+
+  case RADIO_CMD_START_PACKET_RX:
+    stopCapture();
+    stopPacket();
+    stopModule(m);
+    if (!packetrx.begin(radios[m], m, Board::gdo0(m), Board::gdo2(m),
+                        cmd.packet))
+      return RADIO_ERR_INVALID;
+    radiostate.enter(m, RADIO_MODE_RX_PACKET);
+    return RADIO_OK;
+
+  case RADIO_CMD_STOP_PACKET_RX:
+    stopPacket();
+    return RADIO_OK;
+
+  case RADIO_CMD_TX_PACKET:
+    beginTx(m);
+    if (!packettx.begin(radios[m], m, Board::gdo0(m), Board::gdo2(m),
+                        cmd.packetTx)) {
+      endTx(m);
+      return RADIO_ERR_INVALID;
+    }
+    return RADIO_IN_PROGRESS;
+
+  case RADIO_CMD_WAKE:
+    // A WOR carrier wake-up only needs the task out of its blocking wait
+    wakePending = false;
+    if (packetrx.pending())
+      servicePacketRx();
+    if (packettx.pending())
+      serviceTx();
+    return RADIO_OK;
+
+  default:
+    return RADIO_ERR_INVALID;
+  }
+}
+
+// Heap payloads handed over by the submitter. A streamed packet's data
+// belongs to the transmitter once it started.
+static void release(RadioCommand &cmd) {
+  if (cmd.type == RADIO_CMD_TX_RAW)
+    delete[] cmd.tx.data;
+  else if (cmd.type == RADIO_CMD_START_HOP)
+    delete[] cmd.hop.channels;
+  else if (cmd.type == RADIO_CMD_TX_PACKET)
+    delete[] cmd.packetTx.data;
+}
+
+static void record(const RadioCommand &cmd, RadioResult result,
+                   uint32_t started, uint32_t finished) {
+  RadioCommandStats &s = stats[cmd.type];
+  uint32_t wait = started - cmd.enqueued;
+  uint32_t exec = finished - started;
+  s.count++;
+  if (result != RADIO_OK)
+    s.errors++;
+  s.wait_us_total += wait;
+  s.exec_us_total += exec;
+  if (wait > s.wait_us_max)
+    s.wait_us_max = wait;
+  if (exec > s.exec_us_max)
+    s.exec_us_max = exec;
+}
+
+static void complete(RadioCommand &cmd, RadioResult result,
+                     uint32_t started) {
+  uint32_t finished = micros();
+  release(cmd);
+  if (cmd.type < RADIO_CMD_COUNT)
+    record(cmd, result, started, finished);
+  if (cmd.notify != NULL)
+    xTaskNotify(cmd.notify, ((cmd.seq & RADIO_SEQ_MASK) << 8) | result,
+                eSetValueWithOverwrite);
+}
+
+static void finishTx(RadioResult result) {
+  endTx(txCommand.module);
+  complete(txCommand, result, txStarted);
+}
+
+static void servicePacketRx(void) {
+  if (packetrx.service())
+    hooks.packetQueued();
+}
+
+static void serviceTx(void) {
+  int result = packettx.service();
+  if (result == CC1101_TX_DONE)
+    finishTx(RADIO_OK);
+  else if (result == CC1101_TX_UNDERFLOW)
+    finishTx(RADIO_ERR_UNDERFLOW);
+}
+
+// ==========================================
+// BACKGROUND WORK
+// ==========================================
+static void background(void) {
+  // Interrupts whose wake-up did not fit in the queue
+  if (packetrx.pending())
+    servicePacketRx();
+  if (packettx.pending())
+    serviceTx();
+  if (packettx.expired())
+    finishTx(RADIO_ERR_TIMEOUT);
+
+  // Per-frame RSSI for the segmenter, and loop() woken once a burst is
+  // complete
+  bool pending = false;
+  if (capturing()) {
+    if (hooks.captureBusy())
+      hooks.captureRssi(radios[rxModule].getRssi());
+    pending = hooks.capturePoll();
+  }
+
+  if (capturing() && rxhopper.active() &&
+      rxhopper.tick(hooks.captureBusy(), pending))
+    hooks.channelChanged(rxhopper.current());
+
+  spectrum.tick();
+
+  // GDO0 is left high afterwards: the carrier stays up while the task
+  // blocks until the next pass, instead of being keyed off for a tick
+  if (jamming) {
+    sendPulses(jamModule, jamPattern, sizeof(jamPattern));
+    digitalWrite(Board::gdo0(jamModule), HIGH);
+  }
+}
+
+static void radioTask(void *arg) {
+  RadioCommand cmd;
+  for (;;) {
+    // Block while idle, poll every tick while the radio has periodic work
+    // to do. Never 0: a jam or a sweep would spin on core 1 and starve the
+    // capture path; tick() bounds the sweep's work per pass.
+    TickType_t wait = portMAX_DELAY;
+    if (jamming || spectrum.active() || packettx.active() ||
+        (capturing() && !hooks.captureAsleep()))
+      wait = 1;
+
+    if (xQueueReceive(queue, &cmd, wait) == pdTRUE) {
+      uint32_t started = micros();
+      RadioResult result = execute(cmd);
+      if (result == RADIO_IN_PROGRESS) {
+        txCommand = cmd;
+        txStarted = started;
+      } else {
+        complete(cmd, result, started);
+      }
+    }
+    background();
+  }
+}
+
+// ==========================================
+// PUBLIC API
+// ==========================================
+void radioServiceBegin(ELECHOUSE_CC1101 *modules, const RadioHooks &h) {
+  if (task != NULL)
+    return;
+  radios = modules;
+  hooks = h;
+  memset(stats, 0, sizeof(stats));
+  spectrum.init();
+  queue = xQueueCreate(RADIO_QUEUE_LENGTH, sizeof(RadioCommand));
+  xTaskCreatePinnedToCore(radioTask, "radio", RADIO_TASK_STACK, NULL,
+                          RADIO_TASK_PRIORITY, &task, RADIO_TASK_CORE);
+}
+
+// wait_ms == 0 posts the command and returns RADIO_QUEUED at once.
+// Otherwise the caller blocks until the radio task has executed it or the
+// timeout expires; a timed-out command still runs later. Heap payloads
+// (tx.data, hop.channels) belong to the service from this call on.
+RadioResult radioSubmit(RadioCommand &cmd, uint32_t wait_ms) {
+  cmd.seq = ++nextSeq & RADIO_SEQ_MASK;
+  cmd.enqueued = micros();
+  cmd.notify = wait_ms ? xTaskGetCurrentTaskHandle() : NULL;
+
+  if (queue == NULL ||
+      xQueueSend(queue, &cmd, pdMS_TO_TICKS(wait_ms)) != pdTRUE) {
+    release(cmd);
+    return RADIO_ERR_BUSY;
+  }
+  if (wait_ms == 0)
+    return RADIO_QUEUED;
+
+  TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(wait_ms);
+  for (;;) {
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(deadline - now) <= 0)
+      return RADIO_ERR_TIMEOUT;
+    uint32_t value = 0;
+    if (xTaskNotifyWait(0, 0xFFFFFFFF, &value, deadline - now) != pdTRUE)
+      return RADIO_ERR_TIMEOUT;
+    if ((value >> 8) == cmd.seq)
+      return (RadioResult)(value & 0xFF);
+    // Completion of an earlier command we stopped waiting for
+  }
+}
+
+// At most one wake-up waits in the queue, at its front. Its wait time in
+// /radiostats is the interrupt to service latency.
+void IRAM_ATTR radioWakeFromISR(void) {
+  if (queue == NULL || wakePending.exchange(true))
+    return;
+  RadioCommand cmd;
+  memset(&cmd, 0, sizeof(cmd));
+  cmd.type = RADIO_CMD_WAKE;
+  cmd.enqueued = micros();
+  BaseType_t woken = pdFALSE;
+  if (xQueueSendToFrontFromISR(queue, &cmd, &woken) != pdTRUE)
+    wakePending = false;
+  if (woken)
+    portYIELD_FROM_ISR();
+}
+
+String radioStatsJson(void) {
+  String json = "{";
+  json += "\"queued\":" +
+          String(queue ? uxQueueMessagesWaiting(queue) : 0);
+  json += ",\"modes\":[\"" + String(radioModeName(radiostate.mode(0))) +
+          "\",\"" + String(radioModeName(radiostate.mode(1))) + "\"]";
+  json += ",\"refused\":" + String(radiostate.refused());
+  json += ",\"commands\":[";
+  for (int i = 0; i < RADIO_CMD_COUNT; i++) {
+    RadioCommandStats s = stats[i];
+    if (i > 0)
+      json += ",";
+    json += "{\"type\":\"" + String(radioCommandNames[i]) + "\"";
+    json += ",\"count\":" + String(s.count);
+    json += ",\"errors\":" + String(s.errors);
+    json += ",\"wait_us_avg\":" + String(s.count ? s.wait_us_total / s.count : 0);
+    json += ",\"wait_us_max\":" + String(s.wait_us_max);
+    json += ",\"exec_us_avg\":" + String(s.count ? s.exec_us_total / s.count : 0);
+    json += ",\"exec_us_max\":" + String(s.exec_us_max);
+    json += "}";
+  }
+  json += "]}";
+  return json;
+}
@@ -0,0 +1,140 @@
+#ifndef RADIO_SERVICE_h
+#define RADIO_SERVICE_h
+
+#include <Arduino.h>
+#include "ELECHOUSE_CC1101_SRC_DRV.h"
+#include "packet_rx.h"
+#include "packet_tx.h"
+#include "radio_state.h"
+#include "rx_hopper.h"
+#include "spectrum.h"
+
+// ==========================================
+// RADIO COMMAND SERVICE
+// ==========================================
+// A single FreeRTOS task owns both CC1101 modules and the shared CCSPI
+// bus. Web handlers and loop() never touch the radios directly: they post
+// typed commands to a queue and, if they need the outcome, wait for a
+// completion notification. Hopping, sweeping and jamming run inside the
+// same task between commands, so SPI access is serialized by construction.
+
+#define RADIO_QUEUE_LENGTH 8
+#define RADIO_TASK_STACK 4096
+#define RADIO_TASK_PRIORITY 1
+#define RADIO_TASK_CORE 1
+
+enum RadioCommandType : uint8_t {
+  RADIO_CMD_SET_RX,
+  RADIO_CMD_STOP_RX,
+  RADIO_CMD_REARM_RX,
+  RADIO_CMD_TX_RAW,
+  RADIO_CMD_SET_JAMMER,
+  RADIO_CMD_STOP_JAMMER,
+  RADIO_CMD_START_HOP,
+  RADIO_CMD_STOP_HOP,
+  RADIO_CMD_START_SWEEP,
+  RADIO_CMD_STOP_SWEEP,
+  RADIO_CMD_START_PACKET_RX,
+  RADIO_CMD_STOP_PACKET_RX,
+  RADIO_CMD_TX_PACKET,
+  RADIO_CMD_WAKE, // posted by radioWakeFromISR()
+  RADIO_CMD_COUNT
+};
+
+enum RadioResult : uint8_t {
+  RADIO_OK,
+  RADIO_QUEUED,
+  RADIO_ERR_INVALID,
+  RADIO_ERR_BUSY,
+  RADIO_ERR_TIMEOUT,
+  RADIO_ERR_UNDERFLOW,
+  RADIO_IN_PROGRESS // internal: completed later by the radio task
+};
+
+struct RadioRxParams {
+  float frequency;
+  float setrxbw;
+  float deviation;
+  int mod;
+  int datarate;
+};
+
+// data is allocated with new[] by the submitter and released by the
+// service once the transmission is done.
+struct RadioTxParams {
+  float frequency;
+  float deviation;
+  int mod;
+  uint16_t count;
+  long *data;
+};
+
+struct RadioJammerParams {
+  float frequency;
+  int power;
+};
+
+// channels is allocated with new[] and released by the service.
+struct RadioHopParams {
+  HopChannel *channels;
+  byte count;
+  byte sense;
+  int threshold;
+  uint16_t maxhold;
+};
+
+struct RadioCommand {
+  RadioCommandType type;
+  byte module;
+  uint32_t seq;
+  uint32_t enqueued; // micros
+  TaskHandle_t notify;
+  union {
+    RadioRxParams rx;
+    RadioTxParams tx;
+    RadioJammerParams jammer;
+    RadioHopParams hop;
+    SpectrumConfig sweep;
+    PacketRxParams packet;
+    PacketTxParams packetTx;
+  };
+};
+
+struct RadioCommandStats {
+  uint32_t count;
+  uint32_t errors;
+  uint32_t wait_us_total;
+  uint32_t wait_us_max;
+  uint32_t exec_us_total;
+  uint32_t exec_us_max;
+};
+
+// Capture glue provided by main.cpp. All of them run on the radio task.
+struct RadioHooks {
+  void (*armCapture)(byte module);
+  // Before a transmission on the receiving module
+  void (*disarmCapture)(void);
+  bool (*captureBusy)(void);
+  // Armed but the module sleeps in WOR: the carrier interrupt wakes the
+  // task with radioWakeFromISR(), no need to poll
+  bool (*captureAsleep)(void);
+  // RSSI of the receiving module, every ms while captureBusy()
+  void (*captureRssi)(int rssi);
+  // Every pass while capturing, so main.cpp can hand a complete burst to
+  // loop(). True while that burst waits for loop() and REARM_RX; the
+  // hopper stays on its channel meanwhile.
+  bool (*capturePoll)(void);
+  // packetrx queued at least one packet
+  void (*packetQueued)(void);
+  void (*channelChanged)(const HopChannel &channel);
+};
+
+// GDO pins come from the board profile (board.h)
+void radioServiceBegin(ELECHOUSE_CC1101 *modules, const RadioHooks &hooks);
+RadioResult radioSubmit(RadioCommand &cmd, uint32_t wait_ms);
+// From a GDO interrupt: service the packet receiver and transmitter, or the
+// WOR capture, now rather than after the next command
+void IRAM_ATTR radioWakeFromISR(void);
+String radioStatsJson(void);
+
+#endif
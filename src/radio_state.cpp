@@ -0,0 +1,58 @@
+#include "radio_state.h"
+
+RadioState radiostate;
+
+static const char *const modeNames[RADIO_MODE_COUNT] = {
+    "idle", "rx_async", "rx_packet", "tx", "sweep"};
+
+#define MODE(m) (1 << RADIO_MODE_##m)
+#define MODE_ALL ((1 << RADIO_MODE_COUNT) - 1)
+
+// Bit n of transitions[from] set: from -> n is allowed
+static const uint8_t transitions[RADIO_MODE_COUNT] = {
+    MODE_ALL,            // IDLE
+    MODE_ALL,            // RX_ASYNC
+    MODE_ALL,            // RX_PACKET
+    MODE(IDLE),          // TX, see endTx()
+    MODE_ALL & ~MODE(TX) // SWEEP
+};
+
+const char *radioModeName(RadioMode mode) {
+  return mode < RADIO_MODE_COUNT ? modeNames[mode] : "?";
+}
+
+bool RadioState::any(RadioMode mode) const {
+  return modes[0] == mode || modes[1] == mode;
+}
+
+bool RadioState::allowed(byte m, RadioMode to) const {
+  return to < RADIO_MODE_COUNT && (transitions[mode(m)] & (1 << to));
+}
+
+bool RadioState::enter(byte m, RadioMode to) {
+  m &= 1;
+  if (!allowed(m, to)) {
+    refusals++;
+    return false;
+  }
+  if (to == RADIO_MODE_TX)
+    interrupted[m] = mode(m);
+  modes[m] = to;
+  return true;
+}
+
+RadioMode RadioState::endTx(byte m) {
+  m &= 1;
+  if (modes[m] != RADIO_MODE_TX)
+    return mode(m);
+  RadioMode back = interrupted[m];
+  if (back != RADIO_MODE_RX_ASYNC && back != RADIO_MODE_RX_PACKET)
+    back = RADIO_MODE_IDLE;
+  modes[m] = back;
+  return back;
+}
+
+RadioMode RadioState::suspended(byte m) const {
+  m &= 1;
+  return modes[m] == RADIO_MODE_TX ? interrupted[m] : RADIO_MODE_IDLE;
+}
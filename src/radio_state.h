@@ -0,0 +1,63 @@
+#ifndef RADIO_STATE_h
+#define RADIO_STATE_h
+
+#include <Arduino.h>
+#include <atomic>
+
+// ==========================================
+// PER-MODULE RADIO STATE
+// ==========================================
+// What each CC1101 is doing, as one typed value per module instead of
+// "1"/"0" Strings scattered over the web handlers. Only the radio task
+// changes it, through enter() and endTx(), which refuse transitions the
+// table below does not allow; loop(), the web handlers and the metrics
+// task read it without locking.
+//
+//   IDLE       nothing, the chip is in IDLE
+//   RX_ASYNC   raw capture on GDO2: plain, carrier-sense gated, WOR or
+//              hopping
+//   RX_PACKET  packet receiver (packetrx)
+//   TX         raw replay, streamed packet or jammer
+//   SWEEP      RSSI sweep (spectrum)
+//
+// A module in TX takes no new work: it only goes back to IDLE (stop) or,
+// with endTx(), to the receive mode the transmission interrupted. A sweep
+// owns the module's registers until it is stopped, so TX is refused there.
+
+enum RadioMode : uint8_t {
+  RADIO_MODE_IDLE,
+  RADIO_MODE_RX_ASYNC,
+  RADIO_MODE_RX_PACKET,
+  RADIO_MODE_TX,
+  RADIO_MODE_SWEEP,
+  RADIO_MODE_COUNT
+};
+
+const char *radioModeName(RadioMode mode);
+
+class RadioState {
+public:
+  RadioMode mode(byte m) const { return (RadioMode)modes[m & 1].load(); }
+  bool any(RadioMode mode) const;
+  bool allowed(byte m, RadioMode to) const;
+  // Radio task only. Returns false, leaving the state alone, when the
+  // table does not allow the transition.
+  bool enter(byte m, RadioMode to);
+  // End of a transmission: back to the receive mode it interrupted, or
+  // IDLE. Returns the new mode.
+  RadioMode endTx(byte m);
+  // Receive mode a transmission on m interrupted, IDLE when not in TX
+  RadioMode suspended(byte m) const;
+  // It was stopped meanwhile: endTx() goes to IDLE
+  void cancelResume(byte m) { interrupted[m & 1] = RADIO_MODE_IDLE; }
+  uint32_t refused(void) const { return refusals; }
+
+private:
+  std::atomic<uint8_t> modes[2] = {{RADIO_MODE_IDLE}, {RADIO_MODE_IDLE}};
+  RadioMode interrupted[2] = {RADIO_MODE_IDLE, RADIO_MODE_IDLE};
+  uint32_t refusals = 0;
+};
+
+extern RadioState radiostate;
+
+#endif
@@ -0,0 +1,227 @@
+#include "rx_hopper.h"
+
+// RSSI is not valid until the demodulator has settled after SRX.
+#define HOP_SETTLE_MS 2
+
+RxHopper rxhopper;
+
+// ==========================================
+// START / STOP
+// ==========================================
+bool RxHopper::begin(ELECHOUSE_CC1101 &rf, byte module,
+                     const HopChannel *list, byte n, byte s, int thr,
+                     uint16_t hold) {
+  if (n == 0 || n > HOP_MAX_CHANNELS || module > 1)
+    return false;
+
+  for (byte i = 0; i < n; i++) {
+    channels[i] = list[i];
+    stats[i] = {0, 0, 0, 0, -128};
+  }
+  count = n;
+  radio = &rf;
+  modul = module;
+  sense = s;
+  threshold = thr;
+  maxhold = hold;
+  hops = 0;
+  holds = 0;
+  bursts = 0;
+  holding = false;
+
+  radio->setSyncMode(0);
+  radio->setPktFormat(3);
+  index = 0;
+  applyPreset(channels[0], true);
+  tunedAt = millis();
+  stats[0].visits++;
+  running = true;
+  return true;
+}
+
+void RxHopper::stop(void) {
+  if (running)
+    stats[index].listen_ms += millis() - tunedAt;
+  running = false;
+  holding = false;
+}
+
+// ==========================================
+// SCHEDULER
+// ==========================================
+// Called from the radio service task. capturing (a burst on air) holds
+// the channel for up to maxhold; pending (a complete burst the caller has
+// not processed yet) holds it until it is cleared, since that burst was
+// heard here. Returns true when the module was retuned, in which case any
+// partial capture belongs to the previous channel and must be discarded
+// by the caller.
+bool RxHopper::tick(bool capturing, bool pending) {
+  if (!running || pending)
+    return false;
+
+  unsigned long now = millis();
+  if (now - tunedAt < HOP_SETTLE_MS)
+    return false;
+
+  bool busy = capturing || carrierPresent();
+  if (busy) {
+    if (!holding) {
+      holding = true;
+      holdStart = now;
+      holds++;
+      stats[index].holds++;
+    }
+    if (now - holdStart < maxhold)
+      return false;
+  } else {
+    holding = false;
+  }
+
+  if (now - tunedAt < channels[index].dwell && !holding)
+    return false;
+
+  holding = false;
+  if (count == 1)
+    return false;
+
+  tune((index + 1) % count);
+  return true;
+}
+
+void RxHopper::burstCaptured(void) {
+  bursts++;
+  stats[index].bursts++;
+}
+
+void RxHopper::tune(byte next) {
+  unsigned long now = millis();
+  stats[index].listen_ms += now - tunedAt;
+
+  const HopChannel &prev = channels[index];
+  const HopChannel &c = channels[next];
+  bool full = c.mod != prev.mod || c.setrxbw != prev.setrxbw ||
+              c.deviation != prev.deviation || c.datarate != prev.datarate;
+
+  radio->setSidle();
+  index = next;
+  applyPreset(c, full);
+
+  tunedAt = millis();
+  hops++;
+  stats[index].visits++;
+}
+
+// Same register sequence as /setrx. When only the frequency changes the
+// modem registers are left alone and just the synthesizer is retuned.
+void RxHopper::applyPreset(const HopChannel &c, bool full) {
+  if (full) {
+    if (c.mod == 2) {
+      radio->setDcFilterOff(0);
+    } else if (c.mod == 0) {
+      radio->setDcFilterOff(1);
+      radio->setDeviation(c.deviation);
+    }
+    radio->setModulation(c.mod);
+  }
+  radio->setMHZ(c.frequency);
+  if (full) {
+    radio->setRxBW(c.setrxbw);
+    radio->setDRate(c.datarate);
+  }
+  radio->SetRx();
+}
+
+bool RxHopper::carrierPresent(void) {
+  int rssi = radio->getRssi();
+  if (rssi > stats[index].peak_rssi)
+    stats[index].peak_rssi = rssi;
+
+  if (sense == HOP_SENSE_CS) {
+    // PKTSTATUS bit 6: carrier sense, thresholds from AGCCTRL1/2
+    return radio->SpiReadStatus(CC1101_PKTSTATUS) & 0x40;
+  }
+  return rssi >= threshold;
+}
+
+// ==========================================
+// CHANNEL LIST PARSER
+// ==========================================
+// "433.92;315:2:58:0:5:300;868.35:0" -> one channel per ';', fields
+// frequency:mod:setrxbw:deviation:datarate:dwell. Missing fields are
+// taken from defaults. Returns the number of channels, 0 on error.
+byte parseHopChannels(const String &spec, const HopChannel &defaults,
+                      HopChannel *out) {
+  byte n = 0;
+  int pos = 0;
+  int len = spec.length();
+
+  while (pos < len) {
+    int end = spec.indexOf(';', pos);
+    if (end < 0)
+      end = len;
+    if (end > pos) {
+      if (n >= HOP_MAX_CHANNELS)
+        return 0;
+      HopChannel c = defaults;
+      int field = 0;
+      int fpos = pos;
+      while (fpos <= end && field < 6) {
+        int fend = spec.indexOf(':', fpos);
+        if (fend < 0 || fend > end)
+          fend = end;
+        if (fend > fpos) {
+          String v = spec.substring(fpos, fend);
+          switch (field) {
+          case 0: c.frequency = v.toFloat(); break;
+          case 1: c.mod = v.toInt(); break;
+          case 2: c.setrxbw = v.toFloat(); break;
+          case 3: c.deviation = v.toFloat(); break;
+          case 4: c.datarate = v.toInt(); break;
+          case 5: c.dwell = v.toInt(); break;
+          }
+        }
+        field++;
+        fpos = fend + 1;
+      }
+      if (c.frequency < 300 || c.frequency > 928 || c.dwell == 0)
+        return 0;
+      out[n++] = c;
+    }
+    pos = end + 1;
+  }
+  return n;
+}
+
+// ==========================================
+// STATISTICS
+// ==========================================
+String RxHopper::statsJson(void) const {
+  unsigned long dwelling = running ? millis() - tunedAt : 0;
+
+  String json = "{";
+  json += "\"active\":" + String(running ? "true" : "false");
+  json += ",\"module\":" + String(modul + 1);
+  json += ",\"channel\":" + String(index);
+  json += ",\"frequency\":" + String(count ? channels[index].frequency : 0);
+  json += ",\"holding\":" + String(holding ? "true" : "false");
+  json += ",\"hops\":" + String(hops);
+  json += ",\"holds\":" + String(holds);
+  json += ",\"bursts\":" + String(bursts);
+  json += ",\"channels\":[";
+  for (byte i = 0; i < count; i++) {
+    uint32_t listen = stats[i].listen_ms + (i == index ? dwelling : 0);
+    if (i > 0)
+      json += ",";
+    json += "{\"frequency\":" + String(channels[i].frequency);
+    json += ",\"mod\":" + String(channels[i].mod);
+    json += ",\"dwell\":" + String(channels[i].dwell);
+    json += ",\"visits\":" + String(stats[i].visits);
+    json += ",\"holds\":" + String(stats[i].holds);
+    json += ",\"bursts\":" + String(stats[i].bursts);
+    json += ",\"listen_ms\":" + String(listen);
+    json += ",\"peak_rssi\":" + String(stats[i].peak_rssi);
+    json += "}";
+  }
+  json += "]}";
+  return json;
+}
@@ -0,0 +1,77 @@
+#ifndef RX_HOPPER_h
+#define RX_HOPPER_h
+
+#include <Arduino.h>
+#include "ELECHOUSE_CC1101_SRC_DRV.h"
+
+// ==========================================
+// MULTI-FREQUENCY HOPPING RECEIVER
+// ==========================================
+// Cycles one CC1101 module through a list of channels, each with its own
+// RX preset and dwell time. Hopping is suspended while a carrier is
+// present (RSSI above threshold or CC1101 carrier-sense) or while a burst
+// is being captured, so a capture is always tagged with the channel it
+// was heard on.
+
+#define HOP_MAX_CHANNELS 16
+#define HOP_SENSE_RSSI 0
+#define HOP_SENSE_CS 1
+
+struct HopChannel {
+  float frequency; // MHz
+  int mod;
+  float setrxbw;   // kHz
+  float deviation; // kHz
+  int datarate;    // kBaud
+  uint16_t dwell;  // ms
+};
+
+struct HopChannelStats {
+  uint32_t visits;
+  uint32_t holds;
+  uint32_t bursts;
+  uint32_t listen_ms;
+  int peak_rssi;
+};
+
+class RxHopper {
+public:
+  bool begin(ELECHOUSE_CC1101 &radio, byte module, const HopChannel *list,
+             byte count, byte sense, int threshold, uint16_t maxhold);
+  void stop(void);
+  bool active(void) const { return running; }
+  byte module(void) const { return modul; }
+  bool tick(bool capturing, bool pending);
+  void burstCaptured(void);
+  const HopChannel &current(void) const { return channels[index]; }
+  String statsJson(void) const;
+
+private:
+  void tune(byte next);
+  void applyPreset(const HopChannel &c, bool full);
+  bool carrierPresent(void);
+
+  ELECHOUSE_CC1101 *radio = NULL;
+  HopChannel channels[HOP_MAX_CHANNELS];
+  HopChannelStats stats[HOP_MAX_CHANNELS];
+  byte count = 0;
+  byte index = 0;
+  byte modul = 0;
+  byte sense = HOP_SENSE_RSSI;
+  int threshold = -70;
+  uint16_t maxhold = 2000;
+  bool running = false;
+  bool holding = false;
+  unsigned long tunedAt = 0;
+  unsigned long holdStart = 0;
+  uint32_t hops = 0;
+  uint32_t holds = 0;
+  uint32_t bursts = 0;
+};
+
+byte parseHopChannels(const String &spec, const HopChannel &defaults,
+                      HopChannel *out);
+
+extern RxHopper rxhopper;
+
+#endif
@@ -0,0 +1,226 @@
+#include "spectrum.h"
+
+SpectrumSweep spectrum;
+
+static bool sameBand(float a, float b) {
+  const float bands[3][2] = {{300, 348}, {378, 464}, {779, 928}};
+  for (int i = 0; i < 3; i++) {
+    if (a >= bands[i][0] && a <= bands[i][1] && b >= bands[i][0] &&
+        b <= bands[i][1])
+      return true;
+  }
+  return false;
+}
+
+static void putU16(uint8_t *&p, uint16_t v) {
+  *p++ = v;
+  *p++ = v >> 8;
+}
+
+static void putU32(uint8_t *&p, uint32_t v) {
+  putU16(p, v);
+  putU16(p, v >> 16);
+}
+
+static void putBytes(uint8_t *&p, const void *src, size_t n) {
+  memcpy(p, src, n);
+  p += n;
+}
+
+// ==========================================
+// START / STOP
+// ==========================================
+void SpectrumSweep::init(void) {
+  if (lock == NULL)
+    lock = xSemaphoreCreateMutex();
+}
+
+bool SpectrumSweep::begin(ELECHOUSE_CC1101 &rf, const SpectrumConfig &cfg) {
+  if (cfg.module > 1 || cfg.step <= 0 || cfg.stop <= cfg.start ||
+      !sameBand(cfg.start, cfg.stop))
+    return false;
+  uint32_t n = (uint32_t)((cfg.stop - cfg.start) * 1000.0 / cfg.step) + 1;
+  if (n > SPECTRUM_MAX_POINTS)
+    return false;
+
+  if (running)
+    stop();
+
+  // A different module has a different register file and calibration
+  if (radio != &rf)
+    presetValid = false;
+  radio = &rf;
+
+  // The modem preset only depends on the RBW and the calibration cache
+  // only on the frequency grid, so a restarted sweep reuses both.
+  bool samePreset = presetValid && presetRbw == cfg.rbw;
+  bool sameGrid = samePreset && points == n && config.start == cfg.start &&
+                  config.step == cfg.step;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  config = cfg;
+  points = n;
+  pos = 0;
+  seq = 0;
+  startKhz = (uint32_t)(cfg.start * 1000.0 + 0.5);
+  stepHz = (uint32_t)(cfg.step * 1000.0 + 0.5);
+
+  // Snapshot whatever the module was doing so stop() can restore it
+  radio->getPreset(saved);
+  radio->setSidle();
+
+  if (samePreset) {
+    radio->setPreset(preset);
+  } else {
+    radio->setModulation(2);
+    radio->setDcFilterOff(0);
+    radio->setMHZ(config.start);
+    radio->setRxBW(config.rbw);
+    radio->setSyncMode(0);
+    radio->setPktFormat(3);
+    // FS_AUTOCAL = 0: IDLE -> RX must use the FSCAL values we load
+    radio->SpiWriteReg(CC1101_MCSM0, 0x08);
+    radio->getPreset(preset);
+    presetValid = true;
+    presetRbw = config.rbw;
+  }
+
+  for (uint16_t i = 0; i < points; i++) {
+    if (!sameGrid) {
+      double mhz = config.start + i * (config.step / 1000.0);
+      uint32_t word = (uint32_t)(mhz * 65536.0 / 26.0 + 0.5);
+      freq[i][0] = word >> 16;
+      freq[i][1] = word >> 8;
+      freq[i][2] = word;
+      calibrated[i] = false;
+    }
+    peak[i] = -128;
+    average[i] = INT16_MIN;
+  }
+  memset(rowSeq, 0, sizeof(rowSeq));
+  rateStart = millis();
+  ratePoints = 0;
+  pointsPerSecond = 0;
+  running = true;
+  xSemaphoreGive(lock);
+  return true;
+}
+
+void SpectrumSweep::stop(void) {
+  if (!running)
+    return;
+  running = false;
+  radio->setPreset(saved);
+}
+
+// ==========================================
+// SWEEP
+// ==========================================
+// Called from the radio service task. Measures a bounded number of points
+// per call so a wide sweep does not hold up the command queue.
+void SpectrumSweep::tick(void) {
+  if (!running)
+    return;
+
+  for (int n = 0; n < SPECTRUM_POINTS_PER_TICK; n++) {
+    measure(pos);
+    if (++pos >= points) {
+      pos = 0;
+      commitRow();
+    }
+  }
+
+  ratePoints += SPECTRUM_POINTS_PER_TICK;
+  unsigned long elapsed = millis() - rateStart;
+  if (elapsed >= 1000) {
+    pointsPerSecond = ratePoints * 1000UL / elapsed;
+    ratePoints = 0;
+    rateStart = millis();
+  }
+}
+
+void SpectrumSweep::measure(uint16_t i) {
+  if (!calibrated[i]) {
+    // First visit: SCAL leaves the synthesizer calibrated for this point
+    radio->calibrateFreq(freq[i], fscal[i]);
+    calibrated[i] = true;
+  } else {
+    radio->setFreqCal(freq[i], fscal[i]);
+  }
+  radio->SpiStrobe(CC1101_SRX);
+  delayMicroseconds(config.settle);
+  int rssi = radio->getRssi();
+  radio->SpiStrobe(CC1101_SIDLE);
+  current[i] = constrain(rssi, -128, 127);
+}
+
+void SpectrumSweep::commitRow(void) {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  seq++;
+  uint16_t r = seq % SPECTRUM_ROWS;
+  memcpy(rows[r], current, points);
+  rowSeq[r] = seq;
+  rowTime[r] = millis();
+  for (uint16_t i = 0; i < points; i++) {
+    if (current[i] > peak[i])
+      peak[i] = current[i];
+    if (average[i] == INT16_MIN)
+      average[i] = current[i] * 16;
+    else
+      average[i] += (current[i] * 16 - average[i]) / 8;
+  }
+  xSemaphoreGive(lock);
+}
+
+// ==========================================
+// BINARY FRAME
+// ==========================================
+// Rows newer than "since" are sent, oldest first. A client that sees
+// last_seq < since knows the sweep was restarted and resets its view.
+//
+// The frame is copied out under the lock and written after releasing it:
+// the Print is a network stream, and commitRow() on the radio task must
+// not wait for it.
+bool SpectrumSweep::writeFrame(Print &out, uint32_t since) {
+  uint8_t *frame = (uint8_t *)malloc(SPECTRUM_FRAME_MAX);
+  if (frame == NULL)
+    return false;
+  uint8_t *p = frame;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  uint32_t first = (seq > SPECTRUM_ROWS) ? seq - SPECTRUM_ROWS + 1 : 1;
+  if (since >= first && since <= seq)
+    first = since + 1;
+  uint16_t nrows = (seq >= first) ? seq - first + 1 : 0;
+
+  putBytes(p, "SPEC", 4);
+  *p++ = SPECTRUM_FRAME_VERSION;
+  *p++ = config.module + 1;
+  putU16(p, (uint16_t)config.rbw);
+  putU16(p, points);
+  putU16(p, nrows);
+  putU32(p, startKhz);
+  putU32(p, stepHz);
+  putU32(p, seq);
+  putU16(p, pointsPerSecond);
+  putU16(p, 0);
+
+  putBytes(p, peak, points);
+  for (uint16_t i = 0; i < points; i++) {
+    int16_t a = average[i] == INT16_MIN ? -128 * 16 : average[i];
+    *p++ = (int8_t)((a + (a >= 0 ? 8 : -8)) / 16);
+  }
+
+  for (uint32_t s = first; s <= seq; s++) {
+    uint16_t r = s % SPECTRUM_ROWS;
+    putU32(p, rowSeq[r]);
+    putU32(p, rowTime[r]);
+    putBytes(p, rows[r], points);
+  }
+  xSemaphoreGive(lock);
+
+  out.write(frame, p - frame);
+  free(frame);
+  return true;
+}
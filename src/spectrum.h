@@ -0,0 +1,94 @@
+#ifndef SPECTRUM_h
+#define SPECTRUM_h
+
+#include <Arduino.h>
+#include "ELECHOUSE_CC1101_SRC_DRV.h"
+
+// ==========================================
+// RSSI SPECTRUM SWEEP ENGINE
+// ==========================================
+// Steps one module across [start, stop] and samples RSSI at every point.
+// The modem is configured once and snapshotted as a burst-loadable
+// preset, every point is calibrated once and retuned afterwards from the
+// cached FSCAL values, so a point costs two register bursts, SRX, the RSSI
+// settle time and one status read.
+//
+// Completed sweeps go into a fixed ring of rows for the waterfall, next to
+// a peak-hold row and an exponential average row.
+
+#define SPECTRUM_MAX_POINTS 256
+#define SPECTRUM_ROWS 32
+#define SPECTRUM_POINTS_PER_TICK 32
+
+// /spectrum frame layout, little-endian:
+//   header  "SPEC", u8 version, u8 module, u16 rbw_khz, u16 points,
+//           u16 rows, u32 start_khz, u32 step_hz, u32 last_seq,
+//           u16 points_per_s, u16 reserved
+//   peak    i8[points] dBm
+//   average i8[points] dBm
+//   rows    { u32 seq, u32 millis, i8[points] dBm } x rows, oldest first
+#define SPECTRUM_FRAME_VERSION 1
+#define SPECTRUM_HEADER_SIZE 28
+#define SPECTRUM_FRAME_MAX                                                     \
+  (SPECTRUM_HEADER_SIZE + 2 * SPECTRUM_MAX_POINTS +                            \
+   SPECTRUM_ROWS * (8 + SPECTRUM_MAX_POINTS))
+
+struct SpectrumConfig {
+  byte module;
+  float start;      // MHz
+  float stop;       // MHz
+  float step;       // kHz
+  float rbw;        // kHz
+  uint16_t settle;  // us between SRX and the RSSI read
+};
+
+class SpectrumSweep {
+public:
+  // Once, before the radio task and the web server use the sweep
+  void init(void);
+  bool begin(ELECHOUSE_CC1101 &radio, const SpectrumConfig &cfg);
+  void stop(void);
+  bool active(void) const { return running; }
+  byte module(void) const { return config.module; }
+  void tick(void);
+  // False, with nothing written, if the frame buffer cannot be allocated
+  bool writeFrame(Print &out, uint32_t since);
+
+private:
+  void measure(uint16_t i);
+  void commitRow(void);
+
+  ELECHOUSE_CC1101 *radio = NULL;
+  SpectrumConfig config;
+  bool running = false;
+  uint16_t points = 0;
+  uint16_t pos = 0;
+  uint32_t startKhz = 0;
+  uint32_t stepHz = 0;
+
+  bool presetValid = false;
+  float presetRbw = 0;
+  byte preset[CC1101_CONFIG_SIZE];
+  byte saved[CC1101_CONFIG_SIZE];
+  byte freq[SPECTRUM_MAX_POINTS][3];
+  byte fscal[SPECTRUM_MAX_POINTS][3];
+  bool calibrated[SPECTRUM_MAX_POINTS];
+
+  int8_t current[SPECTRUM_MAX_POINTS];
+  int8_t peak[SPECTRUM_MAX_POINTS];
+  int16_t average[SPECTRUM_MAX_POINTS]; // dBm * 16
+  int8_t rows[SPECTRUM_ROWS][SPECTRUM_MAX_POINTS];
+  uint32_t rowSeq[SPECTRUM_ROWS];
+  uint32_t rowTime[SPECTRUM_ROWS];
+  uint32_t seq = 0;
+
+  unsigned long rateStart = 0;
+  uint32_t ratePoints = 0;
+  uint16_t pointsPerSecond = 0;
+
+  SemaphoreHandle_t lock = NULL;
+};
+
+extern SpectrumSweep spectrum;
+
+#endif
@@ -0,0 +1,58 @@
+#include "sub_export.h"
+
+static long nextIndex = -1;
+
+static void fileSink(void *ctx, const char *text, size_t len) {
+  ((File *)ctx)->write((const uint8_t *)text, len);
+}
+
+const char *subPreset(const SubRxSettings &rx) {
+  if (rx.mod == 2)
+    return rx.setrxbw < 400 ? "FuriHalSubGhzPresetOok270Async"
+                            : "FuriHalSubGhzPresetOok650Async";
+  return rx.deviation < 10 ? "FuriHalSubGhzPreset2FSKDev238Async"
+                           : "FuriHalSubGhzPreset2FSKDev476Async";
+}
+
+// Highest RAW_<n>.sub in the directory plus one
+static long scanIndex(fs::FS &fs) {
+  long next = 0;
+  File dir = fs.open(SUB_EXPORT_DIR);
+  if (!dir)
+    return next;
+  for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    const char *name = strrchr(f.name(), '/');
+    name = name ? name + 1 : f.name();
+    long n;
+    if (sscanf(name, "RAW_%ld.sub", &n) == 1 && n >= next)
+      next = n + 1;
+    f.close();
+  }
+  dir.close();
+  return next;
+}
+
+size_t subExport(fs::FS &fs, const SignalCapture &capture,
+                 const SubRxSettings &rx, char *path) {
+  if (capture.samplecount < 2)
+    return 0;
+  if (nextIndex < 0) {
+    fs.mkdir("/SUBGHZ");
+    fs.mkdir(SUB_EXPORT_DIR);
+    nextIndex = scanIndex(fs);
+  }
+  snprintf(path, SUB_EXPORT_PATH_SIZE, SUB_EXPORT_DIR "/RAW_%05ld.sub",
+           nextIndex);
+  File file = fs.open(path, FILE_WRITE);
+  if (!file)
+    return 0;
+  nextIndex++;
+
+  CaptureWriter out(fileSink, &file);
+  // kHz steps, as in the library files; float MHz is not exact below that
+  unsigned long hz = lroundf(rx.frequency * 1000) * 1000UL;
+  capture.writeSub(out, hz, subPreset(rx));
+  out.flush();
+  file.close();
+  return out.total();
+}
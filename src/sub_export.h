@@ -0,0 +1,34 @@
+#ifndef SUB_EXPORT_h
+#define SUB_EXPORT_h
+
+#include <Arduino.h>
+#include <FS.h>
+#include "SignalCapture.h"
+
+// ==========================================
+// FLIPPER .SUB EXPORT
+// ==========================================
+// Streams a capture into SUB_EXPORT_DIR/RAW_<n>.sub in the format of the
+// SD/SUBGHZ library, through the 256-byte CaptureWriter buffer. The
+// preset is the stock Flipper one closest to the RX settings:
+//   ASK/OOK   Ook270Async below 400 kHz RX bandwidth, else Ook650Async
+//   FSK       2FSKDev238Async below 10 kHz deviation, else 2FSKDev476Async
+// File numbers continue from the highest one in the directory, which is
+// scanned on the first export only.
+
+#define SUB_EXPORT_DIR "/SUBGHZ/Captures"
+#define SUB_EXPORT_PATH_SIZE 40
+
+struct SubRxSettings {
+  float frequency; // MHz
+  int mod;
+  float setrxbw;   // kHz
+  float deviation; // kHz
+};
+
+const char *subPreset(const SubRxSettings &rx);
+// Returns the bytes written, 0 on failure. path receives the file name.
+size_t subExport(fs::FS &fs, const SignalCapture &capture,
+                 const SubRxSettings &rx, char *path);
+
+#endif
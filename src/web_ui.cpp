@@ -0,0 +1,86 @@
+#include "web_ui.h"
+#include <SD.h>
+#include "web_assets_data.h"
+
+#define WEB_CACHE_VERSIONED "public, max-age=31536000, immutable"
+#define WEB_CACHE_REVALIDATE "no-cache"
+
+// ETag of the SD file for overridden assets, 0 when the embedded copy
+// is served
+static uint32_t sdEtag[WEB_ASSET_COUNT];
+
+static uint32_t fnv1a(File &file) {
+  uint8_t buf[256];
+  uint32_t h = 0x811C9DC5;
+  for (;;) {
+    size_t n = file.read(buf, sizeof(buf));
+    if (n == 0)
+      break;
+    for (size_t i = 0; i < n; i++)
+      h = (h ^ buf[i]) * 0x01000193;
+  }
+  return h;
+}
+
+static bool notModified(AsyncWebServerRequest *request, const String &etag) {
+  return request->hasHeader("If-None-Match") &&
+         request->header("If-None-Match") == etag;
+}
+
+static void serve(AsyncWebServerRequest *request, size_t i) {
+  const WebAsset &a = webAssets[i];
+  bool gzip = request->hasHeader("Accept-Encoding") &&
+              request->header("Accept-Encoding").indexOf("gzip") >= 0;
+  // Without gzip support the SD copy is the only plain one there is. It
+  // matches the embedded source, so it is tagged with that hash.
+  bool fromSd = sdEtag[i] != 0 || (!gzip && SD.exists(a.sdPath));
+  if (!fromSd && !gzip) {
+    AsyncWebServerResponse *response =
+        request->beginResponse(406, "text/plain", "gzip encoding required");
+    response->addHeader("Vary", "Accept-Encoding");
+    request->send(response);
+    return;
+  }
+  uint32_t tag = sdEtag[i] ? sdEtag[i] : fromSd ? a.source : a.etag;
+  String etag = "\"" + String(tag, HEX) + "\"";
+
+  if (notModified(request, etag)) {
+    AsyncWebServerResponse *response = request->beginResponse(304, a.type);
+    response->addHeader("ETag", etag);
+    response->addHeader("Vary", "Accept-Encoding");
+    request->send(response);
+    return;
+  }
+
+  AsyncWebServerResponse *response;
+  if (fromSd) {
+    response = request->beginResponse(SD, a.sdPath, a.type);
+  } else {
+    response = request->beginResponse(200, a.type, a.gz, a.gzLen);
+    response->addHeader("Content-Encoding", "gzip");
+  }
+  response->addHeader("ETag", etag);
+  response->addHeader("Vary", "Accept-Encoding");
+  response->addHeader("Cache-Control", a.versioned && !fromSd
+                                           ? WEB_CACHE_VERSIONED
+                                           : WEB_CACHE_REVALIDATE);
+  request->send(response);
+}
+
+void webUiBegin(AsyncWebServer &server) {
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++) {
+    const WebAsset &a = webAssets[i];
+    sdEtag[i] = 0;
+    File file = SD.open(a.sdPath);
+    if (file && !file.isDirectory()) {
+      uint32_t h = fnv1a(file);
+      if (h != a.source)
+        sdEtag[i] = h ? h : 1;
+    }
+    if (file)
+      file.close();
+
+    server.on(a.route, HTTP_GET,
+              [i](AsyncWebServerRequest *request) { serve(request, i); });
+  }
+}
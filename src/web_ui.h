@@ -0,0 +1,35 @@
+#ifndef WEB_UI_h
+#define WEB_UI_h
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// ==========================================
+// EMBEDDED WEB UI
+// ==========================================
+// The pages, stylesheet and script from SD/HTML are gzipped into the
+// firmware at build time (scripts/embed_web.py), so a page load no longer
+// reads the SD card over the bus the capture logging uses.
+//   pages        Cache-Control: no-cache, revalidated with ETag -> 304
+//   css/js       requested as "<file>?v=<hash>" by the pages, cached for
+//                a year
+// A file in /HTML on the SD card whose content differs from the embedded
+// copy overrides it. That is decided once in webUiBegin(); overrides are
+// served uncompressed and never cached for long. A client without gzip in
+// Accept-Encoding gets the SD copy, or 406 when the card has none.
+
+struct WebAsset {
+  const char *route;
+  const char *sdPath;
+  const char *type;
+  uint32_t source; // FNV-1a of the SD/HTML file, to spot SD overrides
+  uint32_t etag;   // FNV-1a of the content as served
+  bool versioned;  // referenced with ?v=, safe to cache for a year
+  const uint8_t *gz;
+  size_t gzLen;
+};
+
+// Registers one GET route per asset
+void webUiBegin(AsyncWebServer &server);
+
+#endif
@@ -0,0 +1,139 @@
+#include "wor_listen.h"
+
+WorMeter wormeter;
+
+// wake() runs on core 1, statsJson() on the web server's core
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// EVENT1 codes in RC periods of 750 / 26 MHz
+static const byte event1Periods[8] = {4, 6, 8, 12, 16, 24, 32, 48};
+#define WOR_RC_PERIOD_MS (750.0f / 26000.0f)
+
+// ==========================================
+// RADIO SETUP
+// ==========================================
+void worNormalize(WorParams &p) {
+  if (p.interval > WOR_INTERVAL_MAX)
+    p.interval = WOR_INTERVAL_MAX;
+  if (p.term > WOR_TERM_PQT)
+    p.term = WOR_TERM_RSSI;
+  if (p.rxTime > 6)
+    p.rxTime = 6;
+  p.pqt = constrain(p.pqt, 1, 7);
+}
+
+void worListen(ELECHOUSE_CC1101 &radio, const WorParams &p) {
+  // EVENT0 counts RC periods at WOR_RES 0: 26000 / 750 per ms
+  radio.setWorTimer((uint32_t)p.interval * 104 / 3, WOR_EVENT1, 0);
+  if (p.term == WOR_TERM_PQT) {
+    radio.setPQT(p.pqt);
+    radio.setRxTimeout(p.rxTime, false, true);
+  } else {
+    radio.setPQT(0);
+    radio.setRxTimeout(7, true, false);
+  }
+  radio.SetWor();
+}
+
+void worRelease(ELECHOUSE_CC1101 &radio) {
+  if (radio.getShadowReg(CC1101_MCSM2) == 0x07)
+    return;
+  radio.setSidle();
+  radio.setRxTimeout(7, false, false);
+  radio.setPQT(0);
+  radio.SpiWriteReg(CC1101_WORCTRL, 0xF8); // reset value, RC_PD set
+}
+
+// ==========================================
+// POWER ACCOUNTING
+// ==========================================
+// Caller holds the lock
+void IRAM_ATTR WorMeter::account(unsigned long now) {
+  if (phase == ASLEEP)
+    asleepUs += now - since;
+  else if (phase == AWAKE)
+    awakeUs += now - since;
+  since = now;
+}
+
+void WorMeter::arm(unsigned long now, byte m, const WorParams &p, int b) {
+  portENTER_CRITICAL(&lock);
+  account(now);
+  module = m;
+  params = p;
+  baud = b;
+  phase = ASLEEP;
+  portEXIT_CRITICAL(&lock);
+}
+
+bool IRAM_ATTR WorMeter::wake(unsigned long now) {
+  bool woke = false;
+  portENTER_CRITICAL_ISR(&lock);
+  if (phase == ASLEEP) {
+    account(now);
+    phase = AWAKE;
+    wakeups++;
+    woke = true;
+  }
+  portEXIT_CRITICAL_ISR(&lock);
+  return woke;
+}
+
+void WorMeter::stop(unsigned long now) {
+  portENTER_CRITICAL(&lock);
+  account(now);
+  phase = OFF;
+  portEXIT_CRITICAL(&lock);
+}
+
+// Time in RX of a sniff that finds nothing
+float WorMeter::sniffRxMs(void) const {
+  if (params.term == WOR_TERM_PQT)
+    return params.interval * 0.125f / (1 << params.rxTime);
+  return baud ? WOR_RSSI_SYMBOLS * 1000.0f / baud : 0;
+}
+
+String WorMeter::statsJson(void) {
+  portENTER_CRITICAL(&lock);
+  account(micros());
+  bool active = phase != OFF;
+  uint64_t sleepUs = asleepUs;
+  uint64_t rxUs = awakeUs;
+  uint32_t woken = wakeups;
+  portEXIT_CRITICAL(&lock);
+
+  // Charge in mA * ms: the sniffs, SLEEP in between, and RX from a
+  // carrier wake-up until the chip is put back into WOR
+  float sleepMs = sleepUs / 1000.0f;
+  float awakeMs = rxUs / 1000.0f;
+  float sniffs = params.interval ? sleepMs / params.interval : 0;
+  float event1 = event1Periods[WOR_EVENT1] * WOR_RC_PERIOD_MS;
+  float rx = sniffRxMs();
+  float sniffMs = event1 + WOR_CAL_MS + rx;
+  float sniffCharge =
+      event1 * WOR_IDLE_MA + WOR_CAL_MS * WOR_CAL_MA + rx * WOR_RX_MA;
+  float charge = sniffs * sniffCharge +
+                 max(sleepMs - sniffs * sniffMs, 0.0f) * WOR_SLEEP_MA +
+                 awakeMs * WOR_RX_MA;
+  float totalMs = sleepMs + awakeMs;
+  float onMs = sniffs * sniffMs + awakeMs;
+
+  String json = "{";
+  json += "\"active\":" + String(active ? "true" : "false");
+  json += ",\"module\":" + String(module + 1);
+  json += ",\"interval_ms\":" + String(params.interval);
+  json += ",\"term\":\"" +
+          String(params.term == WOR_TERM_PQT ? "pqt" : "rssi") + "\"";
+  json += ",\"listen_s\":" + String(totalMs / 1000.0f);
+  json += ",\"awake_s\":" + String(awakeMs / 1000.0f);
+  json += ",\"wakeups\":" + String(woken);
+  json += ",\"sniffs\":" + String((uint32_t)sniffs);
+  json += ",\"sniff_ms\":" + String(sniffMs, 3);
+  json += ",\"duty_pct\":" +
+          String(totalMs > 0 ? onMs * 100.0f / totalMs : 0.0f, 3);
+  json += ",\"mah_per_hour\":" +
+          String(totalMs > 0 ? charge / totalMs : 0.0f, 3);
+  json += ",\"rx_mah_per_hour\":" + String(WOR_RX_MA, 3);
+  json += "}";
+  return json;
+}
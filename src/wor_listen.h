@@ -0,0 +1,85 @@
+#ifndef WOR_LISTEN_h
+#define WOR_LISTEN_h
+
+#include <Arduino.h>
+#include "ELECHOUSE_CC1101_SRC_DRV.h"
+
+// ==========================================
+// WAKE-ON-RADIO LISTENING
+// ==========================================
+// Instead of sitting in RX at about 16 mA, the receiving module sleeps on
+// its RC oscillator and samples the channel every interval (/setrx wor=1).
+// A sniff with no carrier ends the short RX period early and the chip
+// goes back to SLEEP:
+//   rssi  RX_TIME_RSSI, no timeout: RX ends within a few symbols unless
+//         the RSSI is above the carrier sense threshold, and then lasts
+//         until the firmware takes the chip back
+//   pqt   RX timeout of 12.5% >> rxtime of the interval, RX continues past
+//         it only when the preamble quality reaches the PQT
+// GDO0 is carrier sense in both cases, so WOR always implies csgate: the
+// rising carrier opens the gated capture and wakes the radio task, which
+// otherwise blocks instead of polling every tick. The capture path then
+// runs as usual and REARM_RX puts the chip back into WOR.
+//
+// There is no current sensor on the board. WorMeter times the sleeping and
+// awake phases and turns them into mAh per listening hour with the CC1101
+// datasheet currents, radio only: the ESP32 stays up for Wi-Fi.
+
+#define WOR_EVENT1 4          // 16 RC periods (0.46 ms) for XOSC start-up
+#define WOR_INTERVAL_MAX 1890 // ms, EVENT0 0xFFFF at WOR_RES 0
+
+// CC1101 datasheet, 433 MHz, 3 V, typical
+#define WOR_SLEEP_MA 0.0005f // SLEEP with the RC oscillator running
+#define WOR_IDLE_MA 1.7f     // XOSC running (EVENT1)
+#define WOR_CAL_MA 8.4f      // FS calibration on IDLE -> RX (FS_AUTOCAL 1)
+#define WOR_RX_MA 16.0f
+#define WOR_CAL_MS 0.72f
+#define WOR_RSSI_SYMBOLS 8 // carrier sense decision, OOK worst case
+
+enum WorTermination : uint8_t { WOR_TERM_RSSI, WOR_TERM_PQT };
+
+struct WorParams {
+  uint16_t interval; // ms between sniffs, 0: continuous RX
+  uint8_t term;      // WorTermination
+  uint8_t rxTime;    // WOR_TERM_PQT: RX timeout 12.5% >> rxTime, 0..6
+  uint8_t pqt;       // WOR_TERM_PQT: preamble quality threshold, 1..7
+};
+
+// Clamps p in place
+void worNormalize(WorParams &p);
+// Programs the timer and the termination, then starts WOR. The carrier
+// sense threshold on GDO0 must already be set (setCarrierSense()).
+void worListen(ELECHOUSE_CC1101 &radio, const WorParams &p);
+// Back to plain RX behaviour after WOR: no RX timeout, RC oscillator off
+void worRelease(ELECHOUSE_CC1101 &radio);
+
+class WorMeter {
+public:
+  // The chip (re)enters WOR; ends an awake phase
+  void arm(unsigned long now, byte module, const WorParams &p, int baud);
+  // From the carrier interrupt: true on the first carrier after arm()
+  bool IRAM_ATTR wake(unsigned long now);
+  // Listening ends: capture stopped or the module taken for something else
+  void stop(unsigned long now);
+  // Armed and no carrier since: nothing to poll until wake()
+  bool asleep(void) const { return phase == ASLEEP; }
+  String statsJson(void);
+
+private:
+  enum Phase : uint8_t { OFF, ASLEEP, AWAKE };
+  void IRAM_ATTR account(unsigned long now);
+  float sniffRxMs(void) const;
+
+  volatile Phase phase = OFF;
+  volatile unsigned long since = 0; // start of the current phase, us
+  byte module = 0;
+  WorParams params = {};
+  int baud = 0;
+  uint64_t asleepUs = 0;
+  uint64_t awakeUs = 0;
+  uint32_t wakeups = 0;
+};
+
+extern WorMeter wormeter;
+
+#endif
@@ -0,0 +1,568 @@
+#include <SignalCapture.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unity.h>
+
+// ==========================================
+// CAPTURE PATH BENCHMARK
+// ==========================================
+// Replays every RAW_Data file under SD/SUBGHZ through the capture front
+// end and the analyser, as the firmware would see it over the air, and
+// writes the results to .pio/capture_bench.json (or $CAPTURE_BENCH_JSON).
+// Set CAPTURE_BENCH_MAX_NS to fail the run when edge() gets slower.
+
+#define BENCH_REPEAT 20
+
+typedef std::chrono::steady_clock Clock;
+
+struct FileResult {
+  std::string name;
+  unsigned long samples;
+  unsigned long captures;
+  unsigned long logBytes;
+  double edgeNs;
+  double analyseNs;
+};
+
+static SignalCapture capture;
+static std::vector<FileResult> results;
+
+static std::string projectRoot(void) {
+  const char *env = getenv("PROJECT_DIR");
+  if (env != NULL)
+    return env;
+  std::string p = __FILE__;
+  for (int i = 0; i < 3; i++) {
+    size_t cut = p.find_last_of('/');
+    p = cut == std::string::npos ? "." : p.substr(0, cut);
+  }
+  return p;
+}
+
+static void findSubFiles(const std::string &dir, std::vector<std::string> &out) {
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL)
+    return;
+  while (struct dirent *e = readdir(d)) {
+    if (e->d_name[0] == '.')
+      continue;
+    std::string path = dir + "/" + e->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode))
+      findSubFiles(path, out);
+    else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".sub") == 0)
+      out.push_back(path);
+  }
+  closedir(d);
+}
+
+static bool loadRaw(const std::string &path, std::vector<long> &raw) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+    return false;
+  char line[4096];
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "RAW_Data:", 9) != 0)
+      continue;
+    char *p = line + 9;
+    char *end;
+    for (long v = strtol(p, &end, 10); end != p; v = strtol(p, &end, 10)) {
+      raw.push_back(v);
+      p = end;
+    }
+  }
+  fclose(f);
+  return !raw.empty();
+}
+
+static void countSink(void *ctx, const char *text, size_t len) {
+  *(unsigned long *)ctx += len;
+}
+
+static void process(FileResult &r, unsigned long &bytes) {
+  Clock::time_point t0 = Clock::now();
+  CaptureWriter out(countSink, &bytes);
+  capture.writeRaw(out, 433.92);
+  capture.analyse(out);
+  out.flush();
+  r.analyseNs += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+  r.captures++;
+  capture.reset();
+}
+
+// Edges arrive at the level changes of the RAW_Data durations. Once the
+// buffer is full the firmware stops listening until the burst has ended,
+// then processes it and re-arms, which is what the replay does too.
+static void replay(const std::vector<long> &raw, FileResult &r) {
+  unsigned long t = 1000000;
+  bool listening = true;
+  capture.reset();
+  capture.lastTime = 0;
+
+  Clock::time_point t0 = Clock::now();
+  double processing = 0;
+  for (size_t i = 0; i < raw.size(); i++) {
+    t += labs(raw[i]);
+    if (capture.complete(t)) {
+      double before = r.analyseNs;
+      process(r, r.logBytes);
+      processing += r.analyseNs - before;
+      listening = true;
+    }
+    if (!listening)
+      continue;
+    r.samples++;
+    if (!capture.edge(t))
+      listening = false;
+  }
+  t += 2 * CAPTURE_GAP_US;
+  if (capture.complete(t)) {
+    double before = r.analyseNs;
+    process(r, r.logBytes);
+    processing += r.analyseNs - before;
+  }
+  r.edgeNs += std::chrono::duration<double, std::nano>(Clock::now() - t0).count() -
+              processing;
+}
+
+static void writeJson(const char *path, double nsPerSample, double capturesPerS,
+                      unsigned long samples, unsigned long captures) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL)
+    return;
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(f, "{\"benchmark\":\"capture\",\"repeat\":%d,\"files\":[", BENCH_REPEAT);
+  for (size_t i = 0; i < results.size(); i++) {
+    const FileResult &r = results[i];
+    fprintf(f,
+            "%s{\"file\":\"%s\",\"samples\":%lu,\"captures\":%lu,"
+            "\"log_bytes\":%lu,\"ns_per_sample\":%.2f,"
+            "\"us_per_capture\":%.2f}",
+            i ? "," : "", r.name.c_str(), r.samples, r.captures, r.logBytes,
+            r.samples ? r.edgeNs / r.samples : 0,
+            r.captures ? r.analyseNs / r.captures / 1000 : 0);
+  }
+  fprintf(f,
+          "],\"total\":{\"samples\":%lu,\"captures\":%lu,"
+          "\"ns_per_sample\":%.2f,\"captures_per_s\":%.1f},"
+          "\"peak_rss_kb\":%ld,\"capture_state_bytes\":%zu}\n",
+          samples, captures, nsPerSample, capturesPerS, ru.ru_maxrss,
+          sizeof(SignalCapture) + CAPTURE_WRITE_CHUNK);
+  fclose(f);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// PWM-style burst: 350 us symbol, a 1:3 / 3:1 pattern
+void test_analyse_symbol_time(void) {
+  std::string text;
+  capture.reset();
+  capture.lastTime = 0;
+  unsigned long t = 1000000;
+  capture.edge(t);
+  for (int i = 0; i < 40; i++) {
+    t += (i % 4 == 0) ? 1050 : 350;
+    capture.edge(t);
+  }
+  TEST_ASSERT_TRUE(capture.complete(t + CAPTURE_GAP_US + 1));
+
+  CaptureWriter out(
+      [](void *ctx, const char *s, size_t n) {
+        ((std::string *)ctx)->append(s, n);
+      },
+      &text);
+  capture.analyse(out);
+  out.flush();
+  TEST_ASSERT_TRUE(text.find("Samples/Symbol: 350\n") != std::string::npos);
+  TEST_ASSERT_EQUAL(40, capture.smoothcount);
+  TEST_ASSERT_EQUAL(1050, capture.smooth[0]);
+  TEST_ASSERT_EQUAL(350, capture.smooth[1]);
+}
+
+void test_edge_counters(void) {
+  SignalCapture c;
+  unsigned long t = 1000000;
+  c.edge(t); // burst start, stored as sample[0]
+  c.edge(t += 50); // glitch
+  for (int i = 0; i < CAPTURE_SAMPLES - 2; i++)
+    TEST_ASSERT_TRUE(c.edge(t += 300));
+  TEST_ASSERT_FALSE(c.edge(t += 300));
+  TEST_ASSERT_EQUAL_UINT32(CAPTURE_SAMPLES - 1, c.counters.accepted);
+  TEST_ASSERT_EQUAL_UINT32(1, c.counters.rejected);
+  TEST_ASSERT_EQUAL_UINT32(1, c.counters.overruns);
+  c.reset();
+  TEST_ASSERT_EQUAL_UINT32(1, c.counters.overruns);
+}
+
+// A 40 us dip in a 600 us pulse, then a 40 us spike in a 400 us gap
+void test_filter_merge(void) {
+  SignalCapture c;
+  CaptureFilter f = c.getFilter();
+  f.merge = true;
+  c.setFilter(f);
+  unsigned long t = 1000000;
+  c.edge(t);
+  c.edge(t += 300);
+  c.edge(t += 280); // dip
+  c.edge(t += 40);
+  c.edge(t += 280); // 600 us pulse ends
+  c.edge(t += 180); // spike
+  c.edge(t += 40);
+  c.edge(t += 180); // 400 us gap ends
+  TEST_ASSERT_EQUAL(4, c.samplecount);
+  TEST_ASSERT_EQUAL(300, c.sample[1]);
+  TEST_ASSERT_EQUAL(600, c.sample[2]);
+  TEST_ASSERT_EQUAL(400, c.sample[3]);
+  TEST_ASSERT_EQUAL_UINT32(4, c.counters.merged);
+  TEST_ASSERT_EQUAL_UINT32(0, c.counters.rejected);
+}
+
+void test_filter_rate_and_length(void) {
+  SignalCapture c;
+  CaptureFilter f = c.getFilter();
+  f.maxEdgesPerMs = 8;
+  f.minBurst = 10;
+  f.adaptive = 50;
+  c.setFilter(f);
+  unsigned long t = 1000000;
+
+  // Noise: 250 us pulses that last 5 pulses
+  c.edge(t);
+  for (int i = 0; i < 5; i++)
+    c.edge(t += 250);
+  t += CAPTURE_GAP_US + 1;
+  c.edge(t);
+  TEST_ASSERT_EQUAL_UINT32(1, c.counters.shortBursts);
+  // 50 % of the noise width, above the fixed 100 us
+  TEST_ASSERT_EQUAL(125, c.glitchUs());
+
+  // A storm of edges trips the ceiling and takes the burst with it
+  for (int i = 0; i < 20; i++)
+    c.edge(t += 110);
+  TEST_ASSERT_TRUE(c.counters.noisy > 0);
+  TEST_ASSERT_EQUAL_UINT32(1, c.counters.noiseBursts);
+
+  // A real burst gets through and completes after minBurst pulses
+  c.edge(t += CAPTURE_GAP_US + 1);
+  for (int i = 0; i < 12; i++)
+    c.edge(t += 400);
+  TEST_ASSERT_TRUE(c.complete(t + CAPTURE_GAP_US + 1));
+  unsigned long glitch = c.glitchUs();
+  c.reset();
+  TEST_ASSERT_TRUE(c.glitchUs() <= glitch);
+}
+
+// Carrier-sense gating ends a burst without waiting for the gap
+void test_gated_burst(void) {
+  SignalCapture c;
+  unsigned long t = 1000000;
+  TEST_ASSERT_TRUE(c.open(t));
+  for (int i = 0; i < 5; i++)
+    c.edge(t += 400);
+  c.close();
+  TEST_ASSERT_FALSE(c.complete(t + 1));
+  TEST_ASSERT_TRUE(c.open(t += 5000)); // too short, dropped
+  TEST_ASSERT_EQUAL_UINT32(1, c.counters.shortBursts);
+  TEST_ASSERT_EQUAL(0, c.samplecount);
+  for (int i = 0; i < 40; i++)
+    c.edge(t += 400);
+  TEST_ASSERT_FALSE(c.complete(t + 1));
+  c.close();
+  TEST_ASSERT_TRUE(c.complete(t + 1));
+  TEST_ASSERT_FALSE(c.busy(t + 1));
+  TEST_ASSERT_FALSE(c.open(t + 2)); // held until processed
+  c.reset();
+  TEST_ASSERT_TRUE(c.open(t + 3));
+}
+
+// The same burst as cycle timestamps at 240 MHz, with sub-us jitter
+void test_segment_frames(void) {
+  SignalCapture c;
+  unsigned long t = 1000000;
+  unsigned long starts[3];
+  c.edge(t);
+  for (int f = 0; f < 3; f++) {
+    if (f > 0)
+      c.edge(t += 9000); // inter-frame gap, 22 symbols
+    starts[f] = t;
+    for (int i = 0; i < 24; i++) {
+      c.edge(t += (i & 1) ? 400 : 1200);
+      c.rssi(t, -70 + f * 10 + (i == 4));
+    }
+  }
+  TEST_ASSERT_TRUE(c.complete(t + CAPTURE_GAP_US + 1));
+  TEST_ASSERT_EQUAL(3, c.segment());
+  for (int f = 0; f < 3; f++) {
+    const CaptureFrame &fr = c.frames[f];
+    TEST_ASSERT_EQUAL(24, fr.count);
+    TEST_ASSERT_EQUAL(1 + f * 25, fr.first);
+    TEST_ASSERT_EQUAL_UINT32(starts[f], fr.start);
+    TEST_ASSERT_EQUAL_UINT32(starts[f] - starts[0], fr.offsetUs);
+    TEST_ASSERT_EQUAL(-69 + f * 10, fr.rssi);
+  }
+
+  // Each frame alone quantises to the same bits
+  std::string bits[3];
+  for (int f = 0; f < 3; f++) {
+    CaptureWriter out(
+        [](void *ctx, const char *s, size_t n) {
+          ((std::string *)ctx)->append(s, n);
+        },
+        &bits[f]);
+    c.analyse(out, c.frames[f].first, c.frames[f].count);
+  }
+  TEST_ASSERT_EQUAL_STRING(bits[0].c_str(), bits[2].c_str());
+  TEST_ASSERT_EQUAL(24, c.smoothcount);
+}
+
+// Five repeats with up to 60 us of jitter, then a different frame
+void test_fold_repeats(void) {
+  SignalCapture c;
+  unsigned long t = 1000000;
+  c.edge(t);
+  for (int f = 0; f < 6; f++) {
+    if (f > 0)
+      c.edge(t += 10000);
+    for (int i = 0; i < 24; i++) {
+      unsigned long w = (i % 3 == 0) ? 1200 : 400;
+      if (f == 5 && i == 7)
+        w = 1200; // one bit differs
+      c.edge(t += w + (f & 1) * 60);
+    }
+  }
+  TEST_ASSERT_TRUE(c.complete(t + CAPTURE_GAP_US + 1));
+  TEST_ASSERT_EQUAL(6, c.segment());
+  TEST_ASSERT_EQUAL(2, c.fold());
+  TEST_ASSERT_EQUAL(5, c.frames[0].repeats);
+  TEST_ASSERT_EQUAL(0, c.frames[4].repeats);
+  TEST_ASSERT_EQUAL(1, c.frames[5].repeats);
+  TEST_ASSERT_EQUAL_UINT32(60, c.frames[0].jitterUs);
+  // 16000 us of pulses, 1440 us more in odd frames, and the gap
+  TEST_ASSERT_EQUAL_UINT32(16000 + 720 + 10000, c.frames[0].periodUs);
+  TEST_ASSERT_EQUAL_UINT32(c.frames[0].hash, c.frames[2].hash);
+  TEST_ASSERT_TRUE(c.frames[0].hash != c.frames[5].hash);
+}
+
+// 600 pulses wrap after 512 values, marks positive, spaces negative
+void test_write_sub(void) {
+  SignalCapture c;
+  std::string text;
+  unsigned long t = 1000000;
+  c.edge(t);
+  for (int i = 1; i <= 600; i++)
+    c.edge(t += (i & 1) ? 500 : 1500);
+  {
+    CaptureWriter out(
+        [](void *ctx, const char *s, size_t n) {
+          ((std::string *)ctx)->append(s, n);
+        },
+        &text);
+    c.writeSub(out, 433920000, "FuriHalSubGhzPresetOok650Async");
+  }
+  const char *head = "Filetype: Flipper SubGhz RAW File\nVersion: 1\n"
+                     "Frequency: 433920000\n"
+                     "Preset: FuriHalSubGhzPresetOok650Async\n"
+                     "Protocol: RAW\nRAW_Data: 500 -1500 500 ";
+  TEST_ASSERT_EQUAL_INT(0, text.compare(0, strlen(head), head));
+
+  std::vector<std::string> lines;
+  size_t pos = text.find("RAW_Data:");
+  while (pos != std::string::npos) {
+    size_t end = text.find('\n', pos);
+    TEST_ASSERT_TRUE(end != std::string::npos);
+    lines.push_back(text.substr(pos, end - pos));
+    pos = text.find("RAW_Data:", end);
+  }
+  TEST_ASSERT_EQUAL(2, lines.size());
+  TEST_ASSERT_EQUAL(512, std::count(lines[0].begin(), lines[0].end(), ' '));
+  TEST_ASSERT_EQUAL(88, std::count(lines[1].begin(), lines[1].end(), ' '));
+  TEST_ASSERT_TRUE(lines[1].compare(lines[1].size() - 6, 6, " -1500") == 0);
+}
+
+// Loads widths (mark first) as edges, returns the decoded bits
+static std::string decodeWidths(SignalCapture &c,
+                                const std::vector<unsigned long> &w,
+                                CaptureDecode &d) {
+  unsigned long t = 1000000;
+  c.reset();
+  c.edge(t);
+  for (size_t i = 0; i < w.size(); i++)
+    c.edge(t += w[i]);
+  std::string bits;
+  d = c.classify(1, c.samplecount - 1);
+  CaptureWriter out(
+      [](void *ctx, const char *s, size_t n) {
+        ((std::string *)ctx)->append(s, n);
+      },
+      &bits);
+  c.writeBits(out, 1, c.samplecount - 1, d);
+  out.flush();
+  return bits;
+}
+
+void test_line_codes(void) {
+  SignalCapture c;
+  CaptureDecode d;
+  const char *data = "110100101110001011010011";
+  std::vector<unsigned long> w;
+
+  // PWM 1:3 with 40 us of jitter, the last bit without its space
+  for (int i = 0; data[i]; i++) {
+    bool one = data[i] == '1';
+    w.push_back((one ? 1050 : 350) + (i % 3) * 20);
+    if (data[i + 1])
+      w.push_back(one ? 350 : 1050);
+  }
+  TEST_ASSERT_EQUAL_STRING(data, decodeWidths(c, w, d).c_str());
+  TEST_ASSERT_EQUAL(CAPTURE_CODE_PWM, d.code);
+  TEST_ASSERT_EQUAL(100, d.confidence);
+
+  // PPM: 500 us marks, 1000 / 2000 us spaces, a closing mark
+  w.clear();
+  for (int i = 0; data[i]; i++) {
+    w.push_back(500);
+    w.push_back(data[i] == '1' ? 2000 : 1000);
+  }
+  w.push_back(500);
+  TEST_ASSERT_EQUAL_STRING(data, decodeWidths(c, w, d).c_str());
+  TEST_ASSERT_EQUAL(CAPTURE_CODE_PPM, d.code);
+
+  // Manchester, 400 us half bits: levels of the half bits, merged into
+  // pulses, starting at the first high half
+  std::string halves;
+  for (int i = 0; data[i]; i++)
+    halves += data[i] == '1' ? "10" : "01";
+  size_t start = halves.find('1');
+  w.clear();
+  for (size_t i = start; i < halves.size();) {
+    size_t j = i;
+    while (j < halves.size() && halves[j] == halves[i])
+      j++;
+    w.push_back((j - i) * 400);
+    i = j;
+  }
+  std::string bits = decodeWidths(c, w, d);
+  TEST_ASSERT_EQUAL(CAPTURE_CODE_MANCHESTER, d.code);
+  TEST_ASSERT_TRUE(d.confidence >= CAPTURE_CODE_CONFIDENT);
+  // data starts with a 1, so nothing was lost to the silence
+  TEST_ASSERT_EQUAL_STRING(std::string(data).substr(0, bits.size()).c_str(),
+                           bits.c_str());
+  TEST_ASSERT_TRUE(bits.size() >= strlen(data) - 1);
+
+  // Irregular multiples of 300 us are NRZ
+  w.clear();
+  const int runs[] = {1, 1, 4, 2, 1, 3, 1, 1, 5, 2, 2, 1, 3, 4, 1, 2, 1, 1};
+  std::string nrz;
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    w.push_back(runs[i] * 300);
+    nrz.append(runs[i], (i & 1) ? '0' : '1');
+  }
+  TEST_ASSERT_EQUAL_STRING(nrz.c_str(), decodeWidths(c, w, d).c_str());
+  TEST_ASSERT_EQUAL(CAPTURE_CODE_NRZ, d.code);
+}
+
+void test_cycle_ticks(void) {
+  std::string us, ticks;
+  SignalCapture a, b;
+  b.setTickRate(240);
+  unsigned long t = 1000000;
+  a.edge(t);
+  b.edge(t * 240);
+  for (int i = 0; i < 40; i++) {
+    unsigned long w = (i % 4 == 0) ? 1050 : 350;
+    t += w;
+    a.edge(t);
+    b.edge(t * 240 + (i % 3) * 40);
+  }
+  TEST_ASSERT_FALSE(b.complete(t * 240 + CAPTURE_GAP_US));
+  TEST_ASSERT_TRUE(b.complete(t * 240 + CAPTURE_GAP_US * 240 + 240));
+
+  CaptureSink append = [](void *ctx, const char *s, size_t n) {
+    ((std::string *)ctx)->append(s, n);
+  };
+  CaptureWriter outA(append, &us), outB(append, &ticks);
+  a.writeRaw(outA, 433.92);
+  b.writeRaw(outB, 433.92);
+  a.analyse(outA);
+  b.analyse(outB);
+  outA.flush();
+  outB.flush();
+  TEST_ASSERT_EQUAL_STRING(us.c_str(), ticks.c_str());
+}
+
+void test_replay_subghz_corpus(void) {
+  std::string root = projectRoot();
+  std::vector<std::string> files;
+  findSubFiles(root + "/SD/SUBGHZ", files);
+  TEST_ASSERT_TRUE_MESSAGE(!files.empty(), "no .sub files found");
+
+  unsigned long samples = 0, captures = 0;
+  double edgeNs = 0, analyseNs = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    std::vector<long> raw;
+    if (!loadRaw(files[i], raw))
+      continue; // protocol files carry keys, not timings
+    FileResult r = {files[i].substr(root.size() + 11), 0, 0, 0, 0, 0};
+    for (int n = 0; n < BENCH_REPEAT; n++)
+      replay(raw, r);
+    r.samples /= BENCH_REPEAT;
+    r.captures /= BENCH_REPEAT;
+    r.logBytes /= BENCH_REPEAT;
+    r.edgeNs /= BENCH_REPEAT;
+    r.analyseNs /= BENCH_REPEAT;
+    results.push_back(r);
+    samples += r.samples;
+    captures += r.captures;
+    edgeNs += r.edgeNs;
+    analyseNs += r.analyseNs;
+  }
+  TEST_ASSERT_TRUE(samples > 0);
+  TEST_ASSERT_TRUE(captures > 0);
+
+  double nsPerSample = edgeNs / samples;
+  double capturesPerS = captures / (analyseNs / 1e9);
+  const char *path = getenv("CAPTURE_BENCH_JSON");
+  std::string def = root + "/.pio/capture_bench.json";
+  mkdir((root + "/.pio").c_str(), 0755);
+  writeJson(path ? path : def.c_str(), nsPerSample, capturesPerS, samples,
+            captures);
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "%lu samples, %lu captures, %.1f ns/sample, %.0f captures/s",
+           samples, captures, nsPerSample, capturesPerS);
+  TEST_MESSAGE(msg);
+
+  const char *limit = getenv("CAPTURE_BENCH_MAX_NS");
+  if (limit != NULL)
+    TEST_ASSERT_TRUE_MESSAGE(nsPerSample <= atof(limit),
+                             "edge() slower than CAPTURE_BENCH_MAX_NS");
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_analyse_symbol_time);
+  RUN_TEST(test_edge_counters);
+  RUN_TEST(test_cycle_ticks);
+  RUN_TEST(test_filter_merge);
+  RUN_TEST(test_filter_rate_and_length);
+  RUN_TEST(test_gated_burst);
+  RUN_TEST(test_segment_frames);
+  RUN_TEST(test_fold_repeats);
+  RUN_TEST(test_write_sub);
+  RUN_TEST(test_line_codes);
+  RUN_TEST(test_replay_subghz_corpus);
+  return UNITY_END();
+}
@@ -0,0 +1,384 @@
+#include <CC1101Sim.h>
+#include <ELECHOUSE_CC1101_SRC_DRV.h>
+#include <unity.h>
+
+// Board wiring (src/main.cpp): shared HSPI, one CSn/GDO0/GDO2 per module
+#define SCK 14
+#define MISO 12
+#define MOSI 13
+static const byte CS[2] = {5, 27};
+static const byte GDO0[2] = {2, 25};
+static const byte GDO2[2] = {4, 26};
+
+// CSn low periods during Init(): the reset pulse plus one per register
+// access. Update it deliberately when the init sequence changes.
+#define INIT_TRANSACTIONS 40
+
+static CC1101Sim *chip[2];
+static ELECHOUSE_CC1101 *radio[2];
+
+void setUp(void) {
+  simReset();
+  for (int i = 0; i < 2; i++) {
+    chip[i] = new CC1101Sim();
+    chip[i]->attach(CS[i], GDO0[i], GDO2[i]);
+    radio[i] = new ELECHOUSE_CC1101();
+    radio[i]->setSpiPin(SCK, MISO, MOSI, CS[i]);
+  }
+}
+
+void tearDown(void) {
+  for (int i = 0; i < 2; i++) {
+    delete radio[i];
+    delete chip[i];
+  }
+}
+
+// Packet mode with GDO0 as sync/end-of-packet input
+static void packetMode(ELECHOUSE_CC1101 &r, byte m) {
+  r.Init();
+  r.setGDO0(GDO0[m]);
+  r.setCCMode(1);
+  r.setModulation(0);
+  r.setSyncMode(2);
+  r.setDRate(38.4);
+}
+
+void test_init_matches_driver_shadow(void) {
+  radio[0]->Init();
+  for (byte a = 0; a < CC1101_CONFIG_SIZE; a++)
+    TEST_ASSERT_EQUAL_HEX8_MESSAGE(radio[0]->getShadowReg(a), chip[0]->reg(a),
+                                   "register differs from shadow");
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_IDLE, chip[0]->marcState());
+  TEST_ASSERT_TRUE(radio[0]->getCC1101());
+}
+
+void test_init_transaction_budget(void) {
+  radio[0]->Init();
+  const CC1101SimCounters &c = chip[0]->counters();
+  TEST_ASSERT_EQUAL_UINT32(INIT_TRANSACTIONS, c.transactions);
+  TEST_ASSERT_EQUAL_UINT32(1, c.strobes); // SRES
+  TEST_ASSERT_EQUAL_UINT32(0, chip[1]->counters().transactions);
+}
+
+void test_set_mhz_writes_frequency_word(void) {
+  radio[0]->Init();
+  radio[0]->setMHZ(433.92);
+  TEST_ASSERT_EQUAL_HEX8(0x10, chip[0]->reg(CC1101_FREQ2));
+  TEST_ASSERT_EQUAL_HEX8(0xB0, chip[0]->reg(CC1101_FREQ1));
+  TEST_ASSERT_EQUAL_HEX8(0x71, chip[0]->reg(CC1101_FREQ0));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 433.92, chip[0]->frequency());
+}
+
+void test_modules_do_not_interfere(void) {
+  radio[0]->Init();
+  radio[1]->Init();
+  radio[0]->setMHZ(315);
+  radio[1]->setMHZ(868.35);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 315, chip[0]->frequency());
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 868.35, chip[1]->frequency());
+}
+
+void test_strobes_follow_state_machine(void) {
+  radio[0]->Init();
+  chip[0]->clearCounters();
+
+  // MCSM0.FS_AUTOCAL = 1: IDLE -> RX calibrates first
+  radio[0]->SetRx();
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_STARTCAL, chip[0]->marcState());
+  delay(1);
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_RX, chip[0]->marcState());
+  TEST_ASSERT_EQUAL_UINT32(1, chip[0]->counters().calibrations);
+
+  radio[0]->setSidle();
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_IDLE, chip[0]->marcState());
+  radio[0]->SetTx();
+  delay(1);
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_TX, chip[0]->marcState());
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_TX,
+                         radio[0]->SpiReadStatus(CC1101_MARCSTATE));
+}
+
+void test_patable_burst_write(void) {
+  radio[0]->Init();
+  radio[0]->setMHZ(433.92);
+  radio[0]->setPA(10);
+  // ASK: index 0 is "off", index 1 the programmed power
+  TEST_ASSERT_EQUAL_HEX8(0x00, chip[0]->patable(0));
+  TEST_ASSERT_EQUAL_HEX8(0xC0, chip[0]->patable(1));
+}
+
+void test_preset_roundtrip(void) {
+  byte preset[CC1101_CONFIG_SIZE];
+  radio[0]->Init();
+  chip[0]->clearCounters();
+  radio[0]->getPreset(preset);
+  TEST_ASSERT_EQUAL_UINT32(1, chip[0]->counters().transactions);
+
+  preset[CC1101_FREQ2] = 0x21;
+  chip[0]->clearCounters();
+  radio[0]->setPreset(preset);
+  TEST_ASSERT_EQUAL_UINT32(2, chip[0]->counters().transactions);
+  TEST_ASSERT_EQUAL_HEX8(0x21, chip[0]->reg(CC1101_FREQ2));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, chip[0]->frequency(), radio[0]->getMHZ());
+}
+
+void test_calibrate_freq_reads_back_scal(void) {
+  byte freq[3] = {0x10, 0xB0, 0x71};
+  byte fscal[3];
+  radio[0]->Init();
+  uint64_t start = simNanos();
+  radio[0]->calibrateFreq(freq, fscal);
+  TEST_ASSERT_TRUE(simNanos() - start >= CC1101_SIM_CAL_NS);
+  TEST_ASSERT_EQUAL_HEX8(chip[0]->reg(CC1101_FSCAL3), fscal[0]);
+  TEST_ASSERT_EQUAL_HEX8(chip[0]->reg(CC1101_FSCAL2), fscal[1]);
+  TEST_ASSERT_EQUAL_HEX8(chip[0]->reg(CC1101_FSCAL1), fscal[2]);
+}
+
+void test_packet_tx_from_fifo(void) {
+  byte data[5] = {1, 2, 3, 4, 5};
+  packetMode(*radio[0], 0);
+  radio[0]->SendData(data, 5);
+  TEST_ASSERT_EQUAL(1, chip[0]->sent().size());
+  TEST_ASSERT_EQUAL(6, chip[0]->sent()[0].size());
+  TEST_ASSERT_EQUAL_HEX8(5, chip[0]->sent()[0][0]);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, &chip[0]->sent()[0][1], 5);
+  TEST_ASSERT_EQUAL(0, chip[0]->txBytes());
+}
+
+void test_packet_rx_to_fifo(void) {
+  byte data[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+  byte buf[64];
+  packetMode(*radio[0], 0);
+  radio[0]->SetRx();
+  delay(1);
+  chip[0]->setRssi(-60);
+  TEST_ASSERT_TRUE(chip[0]->receive(data, 4, true, 0x30));
+
+  int polls = 0;
+  while (!radio[0]->CheckReceiveFlag() && polls++ < 100000)
+    ;
+  TEST_ASSERT_EQUAL(4, radio[0]->ReceiveData(buf));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, buf, 4);
+  TEST_ASSERT_TRUE(radio[0]->CheckCRC());
+  TEST_ASSERT_EQUAL(-60, radio[0]->getRssi());
+  TEST_ASSERT_EQUAL_UINT32(1, chip[0]->counters().rxPackets);
+}
+
+void test_carrier_sense_on_gdo0(void) {
+  radio[0]->Init();
+  radio[0]->setCarrierSense(true, 0);
+  TEST_ASSERT_EQUAL_HEX8(0x0E, chip[0]->reg(CC1101_IOCFG0));
+  radio[0]->SetRx();
+  delay(1);
+  chip[0]->setRssi(-110);
+  simAdvance(1000);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(GDO0[0]));
+  chip[0]->setRssi(-40);
+  simAdvance(1000);
+  TEST_ASSERT_EQUAL(HIGH, digitalRead(GDO0[0]));
+
+  // A higher threshold keeps a weak carrier out
+  radio[0]->setCarrierSense(true, 7);
+  chip[0]->setRssi(-78);
+  simAdvance(1000);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(GDO0[0]));
+
+  radio[0]->setCarrierSense(false, 0);
+  TEST_ASSERT_EQUAL_HEX8(0x0D, chip[0]->reg(CC1101_IOCFG0));
+  TEST_ASSERT_EQUAL_HEX8(0x00, chip[0]->reg(CC1101_AGCCTRL1));
+}
+
+void test_wor_sleeps_until_woken(void) {
+  radio[0]->Init();
+  radio[0]->setCarrierSense(true, 0);
+  radio[0]->setWorTimer(3466, 4, 0); // 100 ms
+  radio[0]->setRxTimeout(7, true, false);
+  TEST_ASSERT_EQUAL_HEX8(0x0D, chip[0]->reg(CC1101_WOREVT1));
+  TEST_ASSERT_EQUAL_HEX8(0x8A, chip[0]->reg(CC1101_WOREVT0));
+  TEST_ASSERT_EQUAL_HEX8(0x48, chip[0]->reg(CC1101_WORCTRL));
+  TEST_ASSERT_EQUAL_HEX8(0x17, chip[0]->reg(CC1101_MCSM2));
+
+  radio[0]->SetWor();
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_SLEEP, chip[0]->marcState());
+  TEST_ASSERT_EQUAL(2, radio[0]->getMode());
+  // Any later access wakes the chip, the configuration is kept
+  radio[0]->setSidle();
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_IDLE, chip[0]->marcState());
+  TEST_ASSERT_EQUAL_HEX8(0x17, chip[0]->reg(CC1101_MCSM2));
+}
+
+// GDO2: RX FIFO threshold, GDO0: sync word / end of packet
+static volatile bool fifoIrq = false;
+static void fifoIsr(void) { fifoIrq = true; }
+
+static void chunkedMode(ELECHOUSE_CC1101 &r, byte m, byte *buf,
+                        uint16_t size, uint16_t length) {
+  packetMode(r, m);
+  r.SpiWriteReg(CC1101_IOCFG2, 0x00);
+  r.SpiWriteReg(CC1101_IOCFG0, 0x06);
+  r.setFifoThreshold(7); // 32 bytes
+  r.BeginPacketRx(buf, size, length);
+  fifoIrq = false;
+  attachInterrupt(GDO2[m], fifoIsr, RISING);
+  attachInterrupt(GDO0[m], fifoIsr, FALLING);
+  delay(1);
+}
+
+// Services the module on interrupts only, like the radio task
+static int serviceUntilPacket(ELECHOUSE_CC1101 &r, CC1101PacketStatus &st,
+                              int *calls) {
+  for (int i = 0; i < 200000; i++) {
+    if (!fifoIrq) {
+      delayMicroseconds(20);
+      continue;
+    }
+    fifoIrq = false;
+    int n;
+    while ((n = r.ServicePacketRx(st)) != CC1101_RX_PENDING) {
+      if (n > 0 || n == CC1101_RX_OVERFLOW)
+        return n;
+    }
+    (*calls)++;
+  }
+  return CC1101_RX_PENDING;
+}
+
+void test_chunked_rx_longer_than_fifo(void) {
+  byte data[200];
+  byte buf[512];
+  for (int i = 0; i < 200; i++)
+    data[i] = i * 7 + 3;
+  chunkedMode(*radio[0], 0, buf, sizeof(buf), 0);
+  chip[0]->setRssi(-52);
+  TEST_ASSERT_TRUE(chip[0]->receive(data, 200, true, 0x2A));
+
+  CC1101PacketStatus st = {};
+  int calls = 0;
+  TEST_ASSERT_EQUAL(200, serviceUntilPacket(*radio[0], st, &calls));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, buf, 200);
+  TEST_ASSERT_EQUAL(-52, st.rssi);
+  TEST_ASSERT_EQUAL_HEX8(0x2A, st.lqi);
+  TEST_ASSERT_TRUE(st.crcOk);
+  // Read in threshold sized chunks, never overflowed
+  TEST_ASSERT_TRUE(calls >= 5);
+  TEST_ASSERT_EQUAL_UINT32(0, chip[0]->counters().rxOverflows);
+
+  // Still in RX: the next packet, fixed length, bad CRC
+  radio[0]->EndPacketRx();
+  chunkedMode(*radio[0], 0, buf, sizeof(buf), 20);
+  TEST_ASSERT_TRUE(chip[0]->receive(data, 20, false, 0x11));
+  calls = 0;
+  TEST_ASSERT_EQUAL(20, serviceUntilPacket(*radio[0], st, &calls));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, buf, 20);
+  TEST_ASSERT_FALSE(st.crcOk);
+  TEST_ASSERT_TRUE(chip[0]->receive(data + 20, 20, true, 0x11));
+  TEST_ASSERT_EQUAL(20, serviceUntilPacket(*radio[0], st, &calls));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data + 20, buf, 20);
+  TEST_ASSERT_TRUE(st.crcOk);
+}
+
+void test_chunked_rx_overflow_restarts(void) {
+  byte data[100];
+  byte buf[512];
+  memset(data, 0x5A, sizeof(data));
+  chunkedMode(*radio[0], 0, buf, sizeof(buf), 0);
+  detachInterrupt(GDO2[0]);
+  detachInterrupt(GDO0[0]);
+  TEST_ASSERT_TRUE(chip[0]->receive(data, 100, true, 0x20));
+  delay(30); // nobody drains the FIFO
+
+  CC1101PacketStatus st = {};
+  TEST_ASSERT_EQUAL(CC1101_RX_OVERFLOW, radio[0]->ServicePacketRx(st));
+  delay(1);
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_RX, chip[0]->marcState());
+  TEST_ASSERT_EQUAL(0, chip[0]->rxBytes());
+  TEST_ASSERT_EQUAL(CC1101_RX_PENDING, radio[0]->ServicePacketRx(st));
+}
+
+// GDO2: TX FIFO above threshold, GDO0: sync word / end of packet
+static void streamMode(ELECHOUSE_CC1101 &r, byte m) {
+  packetMode(r, m);
+  r.SpiWriteReg(CC1101_IOCFG2, 0x02);
+  r.SpiWriteReg(CC1101_IOCFG0, 0x06);
+  r.setFifoThreshold(7); // refill below 33 bytes
+  fifoIrq = false;
+  attachInterrupt(GDO2[m], fifoIsr, FALLING);
+  attachInterrupt(GDO0[m], fifoIsr, FALLING);
+}
+
+static int serviceUntilSent(ELECHOUSE_CC1101 &r, int *calls) {
+  for (int i = 0; i < 200000; i++) {
+    if (!fifoIrq) {
+      delayMicroseconds(20);
+      continue;
+    }
+    fifoIrq = false;
+    (*calls)++;
+    int n = r.ServicePacketTx();
+    if (n != CC1101_TX_PENDING)
+      return n;
+  }
+  return CC1101_TX_PENDING;
+}
+
+void test_streamed_tx_infinite_length(void) {
+  byte data[300];
+  for (int i = 0; i < 300; i++)
+    data[i] = i * 13 + 1;
+  streamMode(*radio[0], 0);
+  radio[0]->BeginPacketTx(data, 300, true);
+  TEST_ASSERT_EQUAL_HEX8(0x02, chip[0]->reg(CC1101_PKTCTRL0) & 0x03);
+
+  int calls = 0;
+  TEST_ASSERT_EQUAL(CC1101_TX_DONE, serviceUntilSent(*radio[0], &calls));
+  TEST_ASSERT_EQUAL(1, chip[0]->sent().size());
+  TEST_ASSERT_EQUAL(300, chip[0]->sent()[0].size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, chip[0]->sent()[0].data(), 300);
+  TEST_ASSERT_EQUAL_UINT32(0, chip[0]->counters().txUnderflows);
+  TEST_ASSERT_TRUE(calls >= 8);
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_IDLE, chip[0]->marcState());
+
+  // Variable length, more than one FIFO
+  chip[0]->clearCounters();
+  radio[0]->BeginPacketTx(data, 100, true);
+  TEST_ASSERT_EQUAL(CC1101_TX_DONE, serviceUntilSent(*radio[0], &calls));
+  TEST_ASSERT_EQUAL(2, chip[0]->sent().size());
+  TEST_ASSERT_EQUAL(101, chip[0]->sent()[1].size());
+  TEST_ASSERT_EQUAL_HEX8(100, chip[0]->sent()[1][0]);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(data, &chip[0]->sent()[1][1], 100);
+}
+
+void test_streamed_tx_reports_underflow(void) {
+  byte data[200];
+  memset(data, 0xA5, sizeof(data));
+  streamMode(*radio[0], 0);
+  detachInterrupt(GDO2[0]);
+  radio[0]->BeginPacketTx(data, 200, true);
+  delay(30); // nobody refills the FIFO
+  TEST_ASSERT_EQUAL(CC1101_TX_UNDERFLOW, radio[0]->ServicePacketTx());
+  TEST_ASSERT_EQUAL_HEX8(CC1101_SIM_IDLE, chip[0]->marcState());
+  TEST_ASSERT_EQUAL(0, chip[0]->txBytes());
+  TEST_ASSERT_EQUAL_UINT32(1, chip[0]->counters().txUnderflows);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_init_matches_driver_shadow);
+  RUN_TEST(test_init_transaction_budget);
+  RUN_TEST(test_set_mhz_writes_frequency_word);
+  RUN_TEST(test_modules_do_not_interfere);
+  RUN_TEST(test_strobes_follow_state_machine);
+  RUN_TEST(test_patable_burst_write);
+  RUN_TEST(test_preset_roundtrip);
+  RUN_TEST(test_calibrate_freq_reads_back_scal);
+  RUN_TEST(test_packet_tx_from_fifo);
+  RUN_TEST(test_packet_rx_to_fifo);
+  RUN_TEST(test_carrier_sense_on_gdo0);
+  RUN_TEST(test_wor_sleeps_until_woken);
+  RUN_TEST(test_chunked_rx_longer_than_fifo);
+  RUN_TEST(test_chunked_rx_overflow_restarts);
+  RUN_TEST(test_streamed_tx_infinite_length);
+  RUN_TEST(test_streamed_tx_reports_underflow);
+  return UNITY_END();
+}
@@ -0,0 +1,494 @@
+#include <CC1101Sim.h>
+#include <ELECHOUSE_CC1101_SRC_DRV.h>
+#include <SignalCapture.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unity.h>
+
+// ==========================================
+// EDGE INJECTION HARNESS
+// ==========================================
+// Drives the simulated module's GDO2 serial output with known edge times
+// and lets receiver() capture them through the simulated interrupt path,
+// with a configurable interrupt entry latency, handler time and periodic
+// windows with interrupts masked (Wi-Fi, SD). The recovered pulses are
+// compared against the injected ones:
+//   clean   one recovered pulse for one injected pulse; its width error
+//           is the jitter
+//   merged  one recovered pulse spanning several injected ones, because
+//           edges arrived while the interrupt was masked or still pending
+//   lost    injected pulses with no clean counterpart
+//   spurious injected glitches (narrower than the filter) that latency
+//           stretched enough to be stored
+// Only pulses injected while the interrupt was attached are counted; the
+// firmware listens again 700 ms after a capture (loop()). Results go to
+// .pio/edge_injection.json (or $EDGE_INJECTION_JSON).
+
+// Module 1 wiring, the capture listens on GDO2 like enableReceive()
+#define SCK 14
+#define MISO 12
+#define MOSI 13
+#define CS 5
+#define GDO2 4
+
+#define POLL_US 1000         // loop() checks for a finished burst every ms
+#define REARM_US 700000      // delay(700) in loop() after a capture
+#define FILE_GAP_US 1000000  // silence between replayed files
+#define FAST_BURSTS 20
+#define FAST_PULSES 400
+
+// Interrupts masked for maskUs, every periodUs +- jitterUs
+struct LoadProfile {
+  const char *name;
+  uint32_t periodUs;
+  uint32_t jitterUs;
+  uint32_t maskUs;
+};
+
+// Rough stand-ins, tune them against a logic analyser trace
+static const LoadProfile WIFI_LOAD = {"wifi", 300, 150, 8};
+static const LoadProfile SD_LOAD = {"sd", 5000, 1000, 150};
+
+struct CaptureConfig {
+  const char *name;
+  uint32_t entryNs; // edge to first instruction of receiver()
+  uint32_t bodyNs;  // time spent in receiver() and the GPIO dispatcher
+  unsigned int minPulse;
+  const LoadProfile *load[2];
+};
+
+static const CaptureConfig CONFIGS[] = {
+    {"ideal", 0, 0, CAPTURE_MIN_PULSE_US, {NULL, NULL}},
+    {"isr", 2000, 1500, CAPTURE_MIN_PULSE_US, {NULL, NULL}},
+    {"isr+wifi", 2000, 1500, CAPTURE_MIN_PULSE_US, {&WIFI_LOAD, NULL}},
+    {"isr+sd", 2000, 1500, CAPTURE_MIN_PULSE_US, {&SD_LOAD, NULL}},
+    {"isr+wifi+sd", 2000, 1500, CAPTURE_MIN_PULSE_US, {&WIFI_LOAD, &SD_LOAD}},
+    {"isr+wifi+sd/min50", 2000, 1500, 50, {&WIFI_LOAD, &SD_LOAD}},
+};
+#define CONFIG_COUNT (sizeof(CONFIGS) / sizeof(CONFIGS[0]))
+
+struct TrueEdge {
+  uint64_t ns;
+  int segment; // armed period the edge fell into, -1 if not listening
+};
+
+struct Result {
+  std::string stimulus;
+  const CaptureConfig *config;
+  unsigned long edges;
+  unsigned long unarmed;
+  unsigned long coalesced;
+  unsigned long expected;
+  unsigned long clean;
+  unsigned long merged;
+  unsigned long spurious;
+  unsigned long captures;
+  unsigned long overflows;
+  std::vector<double> jitter;
+};
+
+static SignalCapture capture;
+static std::vector<TrueEdge> truth;
+static std::vector<Result> results;
+static Result *run;
+static int segment;
+static int segments;
+static size_t nextTrue;
+static bool havePrev;
+static size_t prevTrue;
+static uint32_t rng;
+
+static uint32_t xorshift(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static uint32_t spread(uint32_t base, uint32_t jitter) {
+  if (jitter == 0)
+    return base;
+  return base - jitter + xorshift() % (2 * jitter + 1);
+}
+
+// receiver() from main.cpp plus bookkeeping: the edge that raised the
+// interrupt is the oldest one not yet seen, everything up to now was
+// absorbed into the same interrupt.
+static void receiver(void) {
+  unsigned long now = micros();
+  unsigned long duration = now - capture.lastTime;
+  bool stored = capture.edge(now);
+  if (!stored) {
+    // the pulse that fills the buffer is not kept either
+    detachInterrupt(GDO2);
+    segment = -1;
+    run->overflows++;
+  }
+  stored = stored && duration >= capture.getFilter().minPulse;
+
+  size_t trigger = nextTrue;
+  while (nextTrue < truth.size() && truth[nextTrue].ns <= simNanos())
+    nextTrue++;
+  if (havePrev && duration <= CAPTURE_GAP_US) {
+    size_t span = trigger - prevTrue;
+    if (span > 1) {
+      run->merged++;
+    } else if (span == 1 && stored) {
+      double injected = (truth[trigger].ns - truth[prevTrue].ns) / 1000.0;
+      if (injected < capture.getFilter().minPulse) {
+        run->spurious++;
+      } else {
+        run->clean++;
+        run->jitter.push_back(fabs((double)duration - injected));
+      }
+    }
+  }
+  havePrev = true;
+  prevTrue = trigger;
+}
+
+static void arm(void) {
+  capture.reset();
+  attachInterrupt(GDO2, receiver, CHANGE);
+  segment = segments++;
+  nextTrue = truth.size();
+  havePrev = false;
+}
+
+// ==========================================
+// STIMULI
+// ==========================================
+static std::string projectRoot(void) {
+  const char *env = getenv("PROJECT_DIR");
+  if (env != NULL)
+    return env;
+  std::string p = __FILE__;
+  for (int i = 0; i < 3; i++) {
+    size_t cut = p.find_last_of('/');
+    p = cut == std::string::npos ? "." : p.substr(0, cut);
+  }
+  return p;
+}
+
+static void findSubFiles(const std::string &dir, std::vector<std::string> &out) {
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL)
+    return;
+  while (struct dirent *e = readdir(d)) {
+    if (e->d_name[0] == '.')
+      continue;
+    std::string path = dir + "/" + e->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode))
+      findSubFiles(path, out);
+    else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".sub") == 0)
+      out.push_back(path);
+  }
+  closedir(d);
+}
+
+// Every RAW_Data file under SD/SUBGHZ back to back, as edge offsets in us
+static void corpusEdges(std::vector<uint64_t> &edges) {
+  std::vector<std::string> files;
+  findSubFiles(projectRoot() + "/SD/SUBGHZ", files);
+  std::sort(files.begin(), files.end());
+  uint64_t t = FILE_GAP_US;
+  for (size_t i = 0; i < files.size(); i++) {
+    FILE *f = fopen(files[i].c_str(), "r");
+    if (f == NULL)
+      continue;
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "RAW_Data:", 9) != 0)
+        continue;
+      char *p = line + 9;
+      char *end;
+      for (long v = strtol(p, &end, 10); end != p; v = strtol(p, &end, 10)) {
+        edges.push_back(t);
+        t += labs(v);
+        p = end;
+      }
+    }
+    fclose(f);
+    t += FILE_GAP_US;
+  }
+}
+
+// Bursts of pulses 100-300 us wide, the densest spacing seen in practice
+static void fastEdges(std::vector<uint64_t> &edges) {
+  rng = 0x2545F491;
+  uint64_t t = FILE_GAP_US;
+  for (int b = 0; b < FAST_BURSTS; b++) {
+    for (int i = 0; i < FAST_PULSES; i++) {
+      edges.push_back(t);
+      t += 100 + xorshift() % 201;
+    }
+    edges.push_back(t);
+    t += FILE_GAP_US;
+  }
+}
+
+// ==========================================
+// REPLAY
+// ==========================================
+static uint64_t nextWindow[2];
+static uint64_t nextPoll;
+static uint64_t rearmAt;
+
+// Moves the clock to target, opening load windows and running the loop()
+// side of the capture (burst complete -> detach -> re-arm) on the way.
+static void advanceTo(uint64_t target, const CaptureConfig &cfg) {
+  for (;;) {
+    uint64_t at = target;
+    int which = -1;
+    for (int j = 0; j < 2; j++) {
+      if (cfg.load[j] != NULL && nextWindow[j] < at) {
+        at = nextWindow[j];
+        which = j;
+      }
+    }
+    if (rearmAt < at) {
+      at = rearmAt;
+      which = 2;
+    }
+    if (nextPoll < at) {
+      at = nextPoll;
+      which = 3;
+    }
+    if (at > simNanos())
+      simAdvance(at - simNanos());
+
+    if (segment >= 0 && capture.complete(micros())) {
+      detachInterrupt(GDO2);
+      segment = -1;
+      run->captures++;
+      rearmAt = simNanos() + (uint64_t)REARM_US * 1000;
+    } else if (segment < 0 && rearmAt == UINT64_MAX &&
+               micros() - capture.lastTime > CAPTURE_GAP_US) {
+      // buffer filled up: the capture is processed once the burst ends
+      run->captures++;
+      rearmAt = simNanos() + (uint64_t)REARM_US * 1000;
+    }
+
+    if (which < 0)
+      return;
+    if (which == 3) {
+      nextPoll += POLL_US * 1000ULL;
+      continue;
+    }
+    if (which == 2) {
+      rearmAt = UINT64_MAX;
+      arm();
+      continue;
+    }
+    const LoadProfile *l = cfg.load[which];
+    simMaskInterrupts((uint64_t)l->maskUs * 1000);
+    nextWindow[which] += (uint64_t)spread(l->periodUs, l->jitterUs) * 1000;
+  }
+}
+
+static void replay(const char *name, const std::vector<uint64_t> &edges,
+                   const CaptureConfig &cfg) {
+  simReset();
+  CC1101Sim sim;
+  sim.attach(CS, 2, GDO2);
+  ELECHOUSE_CC1101 radio;
+  radio.setSpiPin(SCK, MISO, MOSI, CS);
+  radio.Init();
+  radio.setCCMode(0);
+  radio.setModulation(2);
+  radio.setMHZ(433.92);
+  radio.SetRx();
+  delay(1);
+  pinMode(GDO2, INPUT);
+
+  Result r = {name, &cfg, 0, 0, 0, 0, 0, 0, 0, 0, 0, {}};
+  results.push_back(r);
+  run = &results.back();
+  truth.clear();
+  rng = 0x9E3779B9;
+  segment = -1;
+  segments = 0;
+  rearmAt = UINT64_MAX;
+  CaptureFilter filter = capture.getFilter();
+  filter.minPulse = cfg.minPulse;
+  capture.setFilter(filter);
+  simSetIsrTiming(cfg.entryNs, cfg.bodyNs);
+  uint64_t t0 = simNanos();
+  nextPoll = t0 + POLL_US * 1000ULL;
+  for (int j = 0; j < 2; j++)
+    nextWindow[j] = t0 + (cfg.load[j] ? cfg.load[j]->periodUs * 1000ULL : 0);
+  arm();
+
+  uint8_t level = LOW;
+  for (size_t i = 0; i < edges.size(); i++) {
+    advanceTo(t0 + edges[i] * 1000, cfg);
+    TrueEdge e = {simNanos(), segment};
+    truth.push_back(e);
+    level = !level;
+    sim.setSerialData(level);
+  }
+  advanceTo(simNanos() + 2ULL * CAPTURE_GAP_US * 1000, cfg);
+  detachInterrupt(GDO2);
+
+  // Pulses the capture should have kept: both edges in the same armed
+  // period, wider than the glitch filter and not a burst gap
+  for (size_t i = 1; i < truth.size(); i++) {
+    if (truth[i].segment < 0) {
+      run->unarmed++;
+      continue;
+    }
+    run->edges++;
+    double width = (truth[i].ns - truth[i - 1].ns) / 1000.0;
+    if (truth[i - 1].segment == truth[i].segment && width >= cfg.minPulse &&
+        width <= CAPTURE_GAP_US)
+      run->expected++;
+  }
+  run->expected -= run->overflows;
+  run->coalesced = simIsrStats().coalesced;
+}
+
+// ==========================================
+// REPORT
+// ==========================================
+static double dropRate(const Result &r) {
+  return r.expected ? (double)(r.expected - r.clean) / r.expected : 0;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1))];
+}
+
+static double mean(const std::vector<double> &v) {
+  double sum = 0;
+  for (size_t i = 0; i < v.size(); i++)
+    sum += v[i];
+  return v.empty() ? 0 : sum / v.size();
+}
+
+static void writeJson(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL)
+    return;
+  fprintf(f, "{\"benchmark\":\"edge_injection\",\"runs\":[");
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    const CaptureConfig &c = *r.config;
+    std::string load;
+    for (int j = 0; j < 2; j++) {
+      if (c.load[j] == NULL)
+        continue;
+      if (!load.empty())
+        load += "+";
+      load += c.load[j]->name;
+    }
+    fprintf(f,
+            "%s{\"stimulus\":\"%s\",\"config\":\"%s\",\"entry_ns\":%u,"
+            "\"body_ns\":%u,\"min_pulse_us\":%u,\"load\":\"%s\","
+            "\"edges\":%lu,\"edges_unarmed\":%lu,\"edges_coalesced\":%lu,"
+            "\"captures\":%lu,\"buffer_full\":%lu,\"pulses_expected\":%lu,\"pulses_clean\":%lu,"
+            "\"pulses_merged\":%lu,\"pulses_spurious\":%lu,\"pulses_lost\":%lu,\"drop_rate\":%.5f,"
+            "\"jitter_mean_us\":%.2f,\"jitter_p99_us\":%.2f,"
+            "\"jitter_max_us\":%.2f}",
+            i ? "," : "", r.stimulus.c_str(), c.name, c.entryNs, c.bodyNs,
+            c.minPulse, load.c_str(), r.edges, r.unarmed, r.coalesced,
+            r.captures, r.overflows, r.expected, r.clean, r.merged, r.spurious, r.expected - r.clean,
+            dropRate(r), mean(r.jitter), percentile(r.jitter, 0.99),
+            percentile(r.jitter, 1.0));
+  }
+  fprintf(f, "]}\n");
+  fclose(f);
+}
+
+static void report(const Result &r) {
+  char msg[192];
+  snprintf(msg, sizeof(msg),
+           "%-6s %-18s expected %6lu lost %5lu (%.2f%%) merged %5lu "
+           "coalesced %5lu jitter p99 %.1f us",
+           r.stimulus.c_str(), r.config->name, r.expected, r.expected - r.clean,
+           100 * dropRate(r), r.merged, r.coalesced, percentile(r.jitter, 0.99));
+  TEST_MESSAGE(msg);
+}
+
+static const Result &find(const char *stimulus, const char *config) {
+  for (size_t i = 0; i < results.size(); i++)
+    if (results[i].stimulus == stimulus && strcmp(results[i].config->name, config) == 0)
+      return results[i];
+  TEST_FAIL_MESSAGE("missing run");
+  return results[0];
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_ideal_interrupts_recover_every_pulse(void) {
+  std::vector<uint64_t> edges;
+  fastEdges(edges);
+  replay("fast", edges, CONFIGS[0]);
+  const Result &r = find("fast", "ideal");
+  TEST_ASSERT_EQUAL_UINT32(FAST_BURSTS * FAST_PULSES, r.expected);
+  TEST_ASSERT_EQUAL_UINT32(r.expected, r.clean);
+  TEST_ASSERT_EQUAL_UINT32(0, r.merged);
+  TEST_ASSERT_EQUAL_UINT32(FAST_BURSTS, r.captures);
+  TEST_ASSERT_TRUE(percentile(r.jitter, 1.0) <= 1.0);
+  results.clear();
+}
+
+void test_masked_window_merges_edges(void) {
+  std::vector<uint64_t> edges;
+  fastEdges(edges);
+  replay("fast", edges, CONFIGS[1]);
+  replay("fast", edges, CONFIGS[3]);
+  const Result &quiet = find("fast", "isr");
+  const Result &busy = find("fast", "isr+sd");
+  TEST_ASSERT_EQUAL_UINT32(quiet.expected, quiet.clean);
+  TEST_ASSERT_EQUAL_UINT32(0, quiet.coalesced);
+  TEST_ASSERT_TRUE(busy.coalesced > 0);
+  TEST_ASSERT_TRUE(busy.merged > 0);
+  TEST_ASSERT_TRUE(busy.clean < busy.expected);
+  results.clear();
+}
+
+void test_report_all_configs(void) {
+  std::vector<uint64_t> corpus, fast;
+  corpusEdges(corpus);
+  fastEdges(fast);
+  TEST_ASSERT_TRUE_MESSAGE(!corpus.empty(), "no RAW_Data under SD/SUBGHZ");
+
+  for (size_t c = 0; c < CONFIG_COUNT; c++) {
+    replay("corpus", corpus, CONFIGS[c]);
+    report(results.back());
+  }
+  for (size_t c = 0; c < CONFIG_COUNT; c++) {
+    replay("fast", fast, CONFIGS[c]);
+    report(results.back());
+  }
+  const Result &ideal = find("corpus", "ideal");
+  TEST_ASSERT_EQUAL_UINT32(ideal.expected, ideal.clean);
+
+  std::string root = projectRoot();
+  const char *path = getenv("EDGE_INJECTION_JSON");
+  std::string def = root + "/.pio/edge_injection.json";
+  mkdir((root + "/.pio").c_str(), 0755);
+  writeJson(path ? path : def.c_str());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ideal_interrupts_recover_every_pulse);
+  RUN_TEST(test_masked_window_merges_edges);
+  RUN_TEST(test_report_all_configs);
+  return UNITY_END();
+}
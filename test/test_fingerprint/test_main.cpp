@@ -0,0 +1,235 @@
+#include <SignalCapture.h>
+#include <SubFingerprint.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unity.h>
+
+// ==========================================
+// FINGERPRINT MATCHING
+// ==========================================
+// Indexes every RAW file under SD/SUBGHZ like the firmware does, then
+// replays each one through the capture path with timing jitter and looks
+// its longest burst up in the index. Its own file (or an identical
+// recording) has to come out on top, unless nothing scores FP_CONFIDENT:
+// a few doorbell recordings are mostly noise.
+
+#define JITTER_US 60  // +- per edge
+#define CHUNK 100     // bytes fed to the parser at a time
+#define FP_CONFIDENT 50
+
+typedef std::chrono::steady_clock Clock;
+
+struct Entry {
+  std::string name;
+  Fingerprint fp;
+  std::vector<long> raw;
+};
+
+static std::vector<Entry> library;
+static SubParser parser;
+static SignalCapture capture;
+static uint32_t rng = 1;
+
+static long jitter(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return (long)(rng % (2 * JITTER_US + 1)) - JITTER_US;
+}
+
+static std::string projectRoot(void) {
+  const char *env = getenv("PROJECT_DIR");
+  if (env != NULL)
+    return env;
+  std::string p = __FILE__;
+  for (int i = 0; i < 3; i++) {
+    size_t cut = p.find_last_of('/');
+    p = cut == std::string::npos ? "." : p.substr(0, cut);
+  }
+  return p;
+}
+
+static void findSubFiles(const std::string &dir, std::vector<std::string> &out) {
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL)
+    return;
+  while (struct dirent *e = readdir(d)) {
+    if (e->d_name[0] == '.')
+      continue;
+    std::string path = dir + "/" + e->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+      continue;
+    if (S_ISDIR(st.st_mode))
+      findSubFiles(path, out);
+    else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".sub") == 0)
+      out.push_back(path);
+  }
+  closedir(d);
+}
+
+// Feeds the file in CHUNK byte pieces, so tokens straddle the chunks
+static bool indexFile(const std::string &path, Entry &e) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+    return false;
+  parser.begin();
+  char buf[CHUNK];
+  size_t n;
+  std::string text;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    parser.feed(buf, n);
+    text.append(buf, n);
+  }
+  fclose(f);
+  if (!parser.finish(e.fp))
+    return false;
+
+  // The widths again, for the replay
+  for (size_t pos = text.find("RAW_Data:"); pos != std::string::npos;
+       pos = text.find("RAW_Data:", pos + 1)) {
+    const char *p = text.c_str() + pos + 9;
+    char *end;
+    for (long v = strtol(p, &end, 10); end != p; v = strtol(p, &end, 10)) {
+      e.raw.push_back(v);
+      p = end;
+    }
+  }
+  return true;
+}
+
+// Longest burst of the recording as the edge interrupt would see it: a
+// file may start with noise, the radio is silent until the first mark
+static bool captureLongest(const std::vector<long> &raw,
+                           std::vector<unsigned long> &best) {
+  unsigned long t = 1000000;
+  capture.reset();
+  capture.lastTime = 0;
+  best.clear();
+  size_t i = 0;
+  while (i < raw.size() && raw[i] < 0)
+    i++;
+  bool listening = true;
+  for (; i <= raw.size(); i++) {
+    bool end = i == raw.size();
+    if (end)
+      t += 2 * CAPTURE_GAP_US;
+    if (capture.complete(t)) {
+      if (capture.samplecount > (int)best.size())
+        best.assign(capture.sample, capture.sample + capture.samplecount);
+      capture.reset();
+      listening = true;
+    }
+    if (end)
+      break;
+    if (listening && !capture.edge(t))
+      listening = false;
+    t += labs(raw[i]) + jitter();
+  }
+  return best.size() >= CAPTURE_MIN_SAMPLES;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_parser_chunks_and_keys(void) {
+  const char *sub = "Filetype: Flipper SubGhz RAW File\nVersion: 1\n"
+                    "Protocol: RAW\nRAW_Data: 350 -1050 1050 -350\n"
+                    "RAW_Data: -2";
+  parser.begin();
+  for (const char *p = sub; *p; p++)
+    parser.feed(p, 1);
+  Fingerprint fp;
+  parser.finish(fp);
+  TEST_ASSERT_EQUAL(5, parser.count());
+
+  const char *key = "Filetype: Flipper SubGhz Key File\nProtocol: Princeton\n"
+                    "Key: 00 00 00 00 00 9A 25 A8\nTE: 203\n";
+  parser.begin();
+  parser.feed(key, strlen(key));
+  TEST_ASSERT_FALSE(parser.finish(fp));
+  TEST_ASSERT_EQUAL(0, parser.count());
+}
+
+void test_identical_and_unrelated(void) {
+  unsigned long a[64], b[64];
+  for (int i = 0; i < 64; i++) {
+    a[i] = (i % 4 == 0) ? 1050 : 350;
+    b[i] = a[i] + (i % 3) * 40; // jitter within a symbol
+  }
+  Fingerprint fa, fb, fc;
+  TEST_ASSERT_TRUE(fingerprint(a, NULL, 64, FP_TOLERANCE_US, fa));
+  TEST_ASSERT_TRUE(fingerprint(b, NULL, 64, FP_TOLERANCE_US, fb));
+  TEST_ASSERT_EQUAL(100, fingerprintScore(fa, fb));
+  for (int i = 0; i < 64; i++)
+    a[i] = (i % 2) ? 500 : 500 + (i % 5) * 500;
+  TEST_ASSERT_TRUE(fingerprint(a, NULL, 64, FP_TOLERANCE_US, fc));
+  TEST_ASSERT_TRUE(fingerprintScore(fa, fc) < 20);
+}
+
+void test_match_subghz_corpus(void) {
+  std::string root = projectRoot();
+  std::vector<std::string> files;
+  findSubFiles(root + "/SD/SUBGHZ", files);
+  for (size_t i = 0; i < files.size(); i++) {
+    Entry e;
+    e.name = files[i].substr(root.size() + 11);
+    if (indexFile(files[i], e))
+      library.push_back(e);
+  }
+  TEST_ASSERT_TRUE_MESSAGE(library.size() > 10, "no RAW .sub files found");
+
+  int queries = 0, hits = 0;
+  unsigned long ownScore = 0;
+  double lookupNs = 0;
+  for (size_t q = 0; q < library.size(); q++) {
+    std::vector<unsigned long> burst;
+    if (!captureLongest(library[q].raw, burst))
+      continue;
+    // as fingerprint(capture) does: sample[0] is the silence before it
+    Fingerprint fp;
+    if (!fingerprint(burst.data() + 1, NULL, burst.size() - 1,
+                     FP_TOLERANCE_US, fp))
+      continue;
+    queries++;
+    Clock::time_point t0 = Clock::now();
+    uint8_t best = 0;
+    for (size_t i = 0; i < library.size(); i++) {
+      uint8_t s = fingerprintScore(fp, library[i].fp);
+      if (s > best)
+        best = s;
+    }
+    lookupNs += std::chrono::duration<double, std::nano>(Clock::now() - t0)
+                    .count();
+    uint8_t own = fingerprintScore(fp, library[q].fp);
+    ownScore += own;
+    if (own == best)
+      hits++;
+    // Recordings that are mostly noise match nothing with confidence
+    else if (best >= FP_CONFIDENT)
+      TEST_FAIL_MESSAGE(library[q].name.c_str());
+  }
+  char msg[128];
+  snprintf(msg, sizeof(msg),
+           "%d queries, %d top-1, mean own score %lu, %.0f ns per lookup",
+           queries, hits, queries ? ownScore / queries : 0,
+           queries ? lookupNs / queries : 0);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_TRUE(queries > 10);
+  TEST_ASSERT_TRUE(hits * 4 >= queries * 3);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_parser_chunks_and_keys);
+  RUN_TEST(test_identical_and_unrelated);
+  RUN_TEST(test_match_subghz_corpus);
+  return UNITY_END();
+}
@@ -0,0 +1,73 @@
+#include <radio_state.h>
+#include <unity.h>
+
+// ==========================================
+// RADIO STATE TRANSITIONS
+// ==========================================
+// The table in src/radio_state.cpp, as the radio service relies on it:
+// a module in TX only stops or resumes, a sweep refuses TX, and every
+// refusal leaves the state alone.
+
+static RadioState *state;
+
+void setUp(void) { state = new RadioState(); }
+
+void tearDown(void) { delete state; }
+
+void test_starts_idle(void) {
+  TEST_ASSERT_EQUAL(RADIO_MODE_IDLE, state->mode(0));
+  TEST_ASSERT_EQUAL(RADIO_MODE_IDLE, state->mode(1));
+  TEST_ASSERT_FALSE(state->any(RADIO_MODE_RX_ASYNC));
+}
+
+void test_tx_resumes_interrupted_rx(void) {
+  TEST_ASSERT_TRUE(state->enter(0, RADIO_MODE_RX_ASYNC));
+  TEST_ASSERT_TRUE(state->enter(0, RADIO_MODE_TX));
+  TEST_ASSERT_EQUAL(RADIO_MODE_RX_ASYNC, state->suspended(0));
+  TEST_ASSERT_EQUAL(RADIO_MODE_RX_ASYNC, state->endTx(0));
+  TEST_ASSERT_EQUAL(RADIO_MODE_RX_ASYNC, state->mode(0));
+
+  TEST_ASSERT_TRUE(state->enter(1, RADIO_MODE_RX_PACKET));
+  TEST_ASSERT_TRUE(state->enter(1, RADIO_MODE_TX));
+  TEST_ASSERT_EQUAL(RADIO_MODE_RX_PACKET, state->endTx(1));
+}
+
+void test_tx_takes_no_new_work(void) {
+  TEST_ASSERT_TRUE(state->enter(0, RADIO_MODE_TX));
+  for (int to = RADIO_MODE_RX_ASYNC; to < RADIO_MODE_COUNT; to++) {
+    TEST_ASSERT_FALSE(state->allowed(0, (RadioMode)to));
+    TEST_ASSERT_FALSE(state->enter(0, (RadioMode)to));
+    TEST_ASSERT_EQUAL(RADIO_MODE_TX, state->mode(0));
+  }
+  TEST_ASSERT_EQUAL_UINT32(RADIO_MODE_COUNT - 1, state->refused());
+  // The other module is not affected
+  TEST_ASSERT_TRUE(state->enter(1, RADIO_MODE_RX_ASYNC));
+  TEST_ASSERT_TRUE(state->enter(0, RADIO_MODE_IDLE));
+}
+
+void test_cancelled_resume_ends_idle(void) {
+  state->enter(0, RADIO_MODE_RX_ASYNC);
+  state->enter(0, RADIO_MODE_TX);
+  state->cancelResume(0);
+  TEST_ASSERT_EQUAL(RADIO_MODE_IDLE, state->endTx(0));
+  // Outside TX endTx() changes nothing
+  state->enter(0, RADIO_MODE_SWEEP);
+  TEST_ASSERT_EQUAL(RADIO_MODE_SWEEP, state->endTx(0));
+}
+
+void test_sweep_refuses_tx(void) {
+  TEST_ASSERT_TRUE(state->enter(0, RADIO_MODE_SWEEP));
+  TEST_ASSERT_FALSE(state->enter(0, RADIO_MODE_TX));
+  TEST_ASSERT_TRUE(state->enter(0, RADIO_MODE_RX_ASYNC));
+  TEST_ASSERT_TRUE(state->enter(0, RADIO_MODE_TX));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_starts_idle);
+  RUN_TEST(test_tx_resumes_interrupted_rx);
+  RUN_TEST(test_tx_takes_no_new_work);
+  RUN_TEST(test_cancelled_resume_ends_idle);
+  RUN_TEST(test_sweep_refuses_tx);
+  return UNITY_END();
+}
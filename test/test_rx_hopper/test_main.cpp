@@ -0,0 +1,108 @@
+#include <CC1101Sim.h>
+#include <SimHost.h>
+#include <rx_hopper.h>
+#include <string.h>
+#include <unity.h>
+
+// ==========================================
+// HOPPER SCHEDULING
+// ==========================================
+// RxHopper::tick() as the radio service calls it, against one simulated
+// module: a burst on air holds the channel up to maxhold, a complete
+// burst that loop() has not processed yet holds it until it is cleared.
+
+#define SCK 14
+#define MISO 12
+#define MOSI 13
+#define CS 5
+#define GDO0 2
+#define GDO2 4
+
+#define DWELL_MS 20
+#define MAXHOLD_MS 50
+
+static const HopChannel channels[2] = {
+    {433.92, 2, 58, 0, 5, DWELL_MS},
+    {315.00, 2, 58, 0, 5, DWELL_MS},
+};
+
+static CC1101Sim *chip;
+static ELECHOUSE_CC1101 *radio;
+static RxHopper *hopper;
+
+void setUp(void) {
+  simReset();
+  chip = new CC1101Sim();
+  chip->attach(CS, GDO0, GDO2);
+  radio = new ELECHOUSE_CC1101();
+  radio->setSpiPin(SCK, MISO, MOSI, CS);
+  radio->Init();
+  hopper = new RxHopper();
+  // RSSI sensing with the simulated noise floor well below the threshold
+  TEST_ASSERT_TRUE(hopper->begin(*radio, 0, channels, 2, HOP_SENSE_RSSI, -70,
+                                 MAXHOLD_MS));
+}
+
+void tearDown(void) {
+  delete hopper;
+  delete radio;
+  delete chip;
+}
+
+static void waitMs(unsigned long ms) { simAdvance(ms * 1000000ULL); }
+
+static bool statsHave(const char *field) {
+  return strstr(hopper->statsJson().c_str(), field) != NULL;
+}
+
+void test_hops_after_dwell(void) {
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 433.92, chip->frequency());
+  waitMs(DWELL_MS / 2);
+  TEST_ASSERT_FALSE(hopper->tick(false, false));
+  waitMs(DWELL_MS);
+  TEST_ASSERT_TRUE(hopper->tick(false, false));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 315.00, chip->frequency());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 315.00, hopper->current().frequency);
+}
+
+void test_burst_across_dwell_boundary_stays(void) {
+  // On air when the dwell runs out
+  waitMs(DWELL_MS - 5);
+  TEST_ASSERT_FALSE(hopper->tick(true, false));
+  waitMs(10);
+  TEST_ASSERT_FALSE(hopper->tick(true, false));
+
+  // Complete, recorded on its channel, then processed for longer than
+  // maxhold: the channel must not change under it
+  hopper->burstCaptured();
+  for (int i = 0; i < 4; i++) {
+    waitMs(MAXHOLD_MS / 2);
+    TEST_ASSERT_FALSE(hopper->tick(false, true));
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 433.92, chip->frequency());
+  TEST_ASSERT_TRUE(statsHave("\"channel\":0"));
+  TEST_ASSERT_TRUE(statsHave("{\"frequency\":433.92,\"mod\":2,\"dwell\":20,"
+                             "\"visits\":1,\"holds\":1,\"bursts\":1"));
+
+  // Re-armed: the overdue hop happens right away
+  TEST_ASSERT_TRUE(hopper->tick(false, false));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 315.00, chip->frequency());
+}
+
+void test_capture_holds_at_most_maxhold(void) {
+  waitMs(DWELL_MS);
+  TEST_ASSERT_FALSE(hopper->tick(true, false));
+  waitMs(MAXHOLD_MS - 5);
+  TEST_ASSERT_FALSE(hopper->tick(true, false));
+  waitMs(10);
+  TEST_ASSERT_TRUE(hopper->tick(true, false));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 315.00, chip->frequency());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_hops_after_dwell);
+  RUN_TEST(test_burst_across_dwell_boundary_stays);
+  RUN_TEST(test_capture_holds_at_most_maxhold);
+  return UNITY_END();
+}